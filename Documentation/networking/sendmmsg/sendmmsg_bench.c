@@ -0,0 +1,170 @@
+/*
+ * Compares the cost of transmitting UDP datagrams with one sendto() per
+ * datagram and with sendmmsg(), which hands a whole vector of datagrams
+ * to the kernel in a single system call.
+ *
+ * Usage: sendmmsg_bench [-c count] [-s size] [-b batch] host port
+ *
+ * The defaults (1316 byte datagrams, 7 MPEG-TS packets each) mimic an
+ * IPTV stream. Nothing needs to listen on the far end, but the
+ * destination should be reachable, e.g. another host on the LAN or
+ * 127.0.0.1.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef __NR_sendmmsg
+# if defined(__sh__)
+#  define __NR_sendmmsg 359
+# else
+#  error "__NR_sendmmsg not known for this architecture"
+# endif
+#endif
+
+struct bench_mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+
+static int do_sendmmsg(int fd, struct bench_mmsghdr *vec, unsigned int vlen,
+		       unsigned int flags)
+{
+	return syscall(__NR_sendmmsg, fd, vec, vlen, flags);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char *name, unsigned long count, size_t size,
+		   double secs)
+{
+	printf("%-9s %8lu datagrams in %7.3f s: %9.0f pps, %7.1f Mbit/s, "
+	       "%6.2f us/datagram\n", name, count, secs, count / secs,
+	       count * size * 8 / secs / 1e6, secs * 1e6 / count);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c count] [-s size] [-b batch] "
+		"host port\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long count = 100000, sent;
+	unsigned int batch = 32, i;
+	size_t size = 1316;
+	struct sockaddr_in addr;
+	struct bench_mmsghdr *vec;
+	struct iovec *iov;
+	struct hostent *he;
+	char *buf;
+	double start;
+	int fd, opt, ret;
+
+	while ((opt = getopt(argc, argv, "c:s:b:")) != -1) {
+		switch (opt) {
+		case 'c':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || !count || !size || !batch)
+		usage(argv[0]);
+
+	he = gethostbyname(argv[optind]);
+	if (!he) {
+		fprintf(stderr, "%s: unknown host\n", argv[optind]);
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(atoi(argv[optind + 1]));
+	memcpy(&addr.sin_addr, he->h_addr, sizeof(addr.sin_addr));
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	buf = calloc(batch, size);
+	vec = calloc(batch, sizeof(*vec));
+	iov = calloc(batch, sizeof(*iov));
+	if (!buf || !vec || !iov) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < batch; i++) {
+		iov[i].iov_base = buf + i * size;
+		iov[i].iov_len = size;
+		vec[i].msg_hdr.msg_name = &addr;
+		vec[i].msg_hdr.msg_namelen = sizeof(addr);
+		vec[i].msg_hdr.msg_iov = &iov[i];
+		vec[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	printf("%lu datagrams of %zu bytes to %s:%s, batch %u\n", count,
+	       size, inet_ntoa(addr.sin_addr), argv[optind + 1], batch);
+
+	start = now();
+	for (sent = 0; sent < count; sent++) {
+		if (sendto(fd, buf, size, 0, (struct sockaddr *)&addr,
+			   sizeof(addr)) < 0 && errno != ENOBUFS) {
+			perror("sendto");
+			return 1;
+		}
+	}
+	report("sendto", count, size, now() - start);
+
+	start = now();
+	for (sent = 0; sent < count; sent += ret) {
+		unsigned int vlen = batch;
+
+		if (count - sent < vlen)
+			vlen = count - sent;
+		ret = do_sendmmsg(fd, vec, vlen, 0);
+		if (ret < 0) {
+			if (errno == ENOBUFS) {
+				ret = 0;
+				continue;
+			}
+			perror("sendmmsg");
+			return 1;
+		}
+	}
+	report("sendmmsg", count, size, now() - start);
+
+	close(fd);
+	return 0;
+}
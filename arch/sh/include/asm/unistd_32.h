@@ -376,8 +376,9 @@
 #define __NR_recvmsg		356
 #define __NR_recvmmsg		357
 #define __NR_accept4		358
+#define __NR_sendmmsg		359
 
-#define NR_syscalls 359
+#define NR_syscalls 360
 
 #ifdef __KERNEL__
 
@@ -5,50 +5,452 @@
  */
 
 #include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/blktrans.h>
 
-static int mtdblock_readsect(struct mtd_blktrans_dev *dev,
+/*
+ * Read cache.
+ *
+ * The block layer hands us one 512 byte sector at a time, and reading each
+ * of them separately from NAND means reading the same flash page over and
+ * over again. Instead, we read whole windows of up to one eraseblock with a
+ * single mtd->read() call, keep the last few of them around and serve the
+ * sectors from there.
+ *
+ * When reads are sequential, a per-device thread reads the next window
+ * ahead while the current one is being copied out to the block layer.
+ * The windows and the thread only exist while the device is open.
+ */
+
+#define MTDBLK_RO_MAX_WINDOW	(128 * 1024)
+#define MTDBLK_RO_MAX_WINDOWS	16
+
+static int cache_windows = 4;
+module_param(cache_windows, int, 0444);
+MODULE_PARM_DESC(cache_windows, "Number of eraseblock sized windows cached "
+		 "per open device, 0 disables the cache (default 4)");
+
+enum { WIN_EMPTY, WIN_FILLING, WIN_VALID };
+
+struct mtdblk_ro_window {
+	unsigned char *data;
+	loff_t ofs;
+	int state;
+	int readahead;		/* filled ahead and not read from yet */
+	unsigned long stamp;
+};
+
+struct mtdblk_ro_dev {
+	struct mtd_blktrans_dev mbd;
+	int count;
+	unsigned int win_size;
+
+	/* cache_mutex protects everything below. The windows are only
+	   freed once the read-ahead thread has been stopped. */
+	struct mutex cache_mutex;
+	wait_queue_head_t wait;
+	struct mtdblk_ro_window *win;
+	int nr_win;
+	unsigned long stamp;
+	loff_t last_ofs;
+	loff_t ra_ofs;
+	struct task_struct *ra_thread;
+
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int ra_reads;
+};
+
+static inline struct mtdblk_ro_dev *to_ro_dev(struct mtd_blktrans_dev *mbd)
+{
+	return container_of(mbd, struct mtdblk_ro_dev, mbd);
+}
+
+static int mtdblock_read_window(struct mtd_info *mtd, loff_t ofs,
+				unsigned int win_size, unsigned char *buf)
+{
+	size_t len = min_t(uint64_t, win_size, mtd->size - ofs);
+	size_t retlen;
+	int ret;
+
+	ret = mtd->read(mtd, ofs, len, &retlen, buf);
+	/* Corrected bitflips are no reason to fail the read */
+	if (ret == -EUCLEAN)
+		ret = 0;
+	if (!ret && retlen != len)
+		ret = -EIO;
+	return ret;
+}
+
+static struct mtdblk_ro_window *mtdblock_find_window(struct mtdblk_ro_dev *dev,
+						     loff_t ofs)
+{
+	int i;
+
+	for (i = 0; i < dev->nr_win; i++)
+		if (dev->win[i].state != WIN_EMPTY && dev->win[i].ofs == ofs)
+			return &dev->win[i];
+	return NULL;
+}
+
+/* Pick the least recently used window that is not being filled */
+static struct mtdblk_ro_window *mtdblock_victim(struct mtdblk_ro_dev *dev)
+{
+	struct mtdblk_ro_window *victim = NULL;
+	int i;
+
+	for (i = 0; i < dev->nr_win; i++) {
+		struct mtdblk_ro_window *w = &dev->win[i];
+
+		if (w->state == WIN_FILLING)
+			continue;
+		if (w->state == WIN_EMPTY)
+			return w;
+		if (!victim || time_before(w->stamp, victim->stamp))
+			victim = w;
+	}
+	return victim;
+}
+
+static void mtdblock_start_readahead(struct mtdblk_ro_dev *dev, loff_t ofs)
+{
+	if (!dev->ra_thread || dev->nr_win < 2 || ofs >= dev->mbd.mtd->size)
+		return;
+	if (mtdblock_find_window(dev, ofs))
+		return;
+
+	dev->ra_ofs = ofs;
+	wake_up_process(dev->ra_thread);
+}
+
+static int mtdblock_ra_thread(void *arg)
+{
+	struct mtdblk_ro_dev *dev = arg;
+	struct mtd_info *mtd = dev->mbd.mtd;
+
+	while (!kthread_should_stop()) {
+		struct mtdblk_ro_window *w = NULL;
+		loff_t ofs;
+		int ret;
+
+		mutex_lock(&dev->cache_mutex);
+		ofs = dev->ra_ofs;
+		dev->ra_ofs = -1;
+		if (ofs != -1 && dev->win && !mtdblock_find_window(dev, ofs)) {
+			w = mtdblock_victim(dev);
+			if (w) {
+				w->state = WIN_FILLING;
+				w->ofs = ofs;
+				w->readahead = 1;
+			}
+		}
+		mutex_unlock(&dev->cache_mutex);
+
+		if (w) {
+			ret = mtdblock_read_window(mtd, ofs, dev->win_size,
+						   w->data);
+
+			mutex_lock(&dev->cache_mutex);
+			w->state = ret ? WIN_EMPTY : WIN_VALID;
+			w->stamp = ++dev->stamp;
+			dev->ra_reads++;
+			mutex_unlock(&dev->cache_mutex);
+			wake_up_all(&dev->wait);
+		}
+
+		if (w)
+			continue;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (dev->ra_ofs == -1 && !kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+/* Called with cache_mutex held, which may be dropped while waiting */
+static int mtdblock_cache_read(struct mtdblk_ro_dev *dev, loff_t pos,
+			       char *buf)
+{
+	loff_t ofs = pos & ~((loff_t)dev->win_size - 1);
+	struct mtdblk_ro_window *w;
+	int sequential;
+	int ret;
+
+again:
+	if (!dev->win)
+		return -ENOMEM;
+
+	w = mtdblock_find_window(dev, ofs);
+	if (w && w->state == WIN_FILLING) {
+		mutex_unlock(&dev->cache_mutex);
+		wait_event(dev->wait, w->state != WIN_FILLING);
+		mutex_lock(&dev->cache_mutex);
+		goto again;
+	}
+
+	if (w) {
+		sequential = w->readahead;
+		w->readahead = 0;
+		dev->hits++;
+	} else {
+		w = mtdblock_victim(dev);
+		if (!w)
+			return -EBUSY;
+
+		sequential = (ofs == dev->last_ofs + dev->win_size);
+		ret = mtdblock_read_window(dev->mbd.mtd, ofs, dev->win_size,
+					   w->data);
+		if (ret) {
+			w->state = WIN_EMPTY;
+			return ret;
+		}
+		w->ofs = ofs;
+		w->state = WIN_VALID;
+		w->readahead = 0;
+		dev->misses++;
+	}
+
+	memcpy(buf, w->data + (pos - ofs), 512);
+	w->stamp = ++dev->stamp;
+	dev->last_ofs = ofs;
+
+	if (sequential)
+		mtdblock_start_readahead(dev, ofs + dev->win_size);
+
+	return 0;
+}
+
+static int mtdblock_readsect(struct mtd_blktrans_dev *mbd,
 			      unsigned long block, char *buf)
 {
+	struct mtdblk_ro_dev *dev = to_ro_dev(mbd);
 	size_t retlen;
+	int ret;
+
+	mutex_lock(&dev->cache_mutex);
+	ret = mtdblock_cache_read(dev, (loff_t)block << 9, buf);
+	mutex_unlock(&dev->cache_mutex);
+	if (!ret)
+		return 0;
 
-	if (dev->mtd->read(dev->mtd, (block * 512), 512, &retlen, buf))
+	/*
+	 * No cache, or the window could not be read as a whole: fall back
+	 * to reading just this sector, so that an uncorrectable page only
+	 * fails the sectors it holds.
+	 */
+	if (mbd->mtd->read(mbd->mtd, (block * 512), 512, &retlen, buf))
 		return 1;
 	return 0;
 }
 
-static int mtdblock_writesect(struct mtd_blktrans_dev *dev,
+static int mtdblock_writesect(struct mtd_blktrans_dev *mbd,
 			      unsigned long block, char *buf)
 {
+	struct mtdblk_ro_dev *dev = to_ro_dev(mbd);
+	loff_t pos = (loff_t)block << 9;
+	struct mtdblk_ro_window *w;
 	size_t retlen;
 
-	if (dev->mtd->write(dev->mtd, (block * 512), 512, &retlen, buf))
+	mutex_lock(&dev->cache_mutex);
+	if (dev->win) {
+		pos &= ~((loff_t)dev->win_size - 1);
+		w = mtdblock_find_window(dev, pos);
+		if (w && w->state == WIN_VALID)
+			w->state = WIN_EMPTY;
+	}
+	mutex_unlock(&dev->cache_mutex);
+
+	if (mbd->mtd->write(mbd->mtd, (block * 512), 512, &retlen, buf))
 		return 1;
 	return 0;
 }
 
+/*
+ * Windows come from the linear map where possible: controllers that DMA
+ * straight into the caller's buffer (stm_nand_bch) have to bounce every
+ * page of a vmalloc()ed one, which splits the window read up again.
+ */
+static void *mtdblock_alloc_window(unsigned int size)
+{
+	void *buf = kmalloc(size, GFP_KERNEL | __GFP_NOWARN);
+
+	if (!buf)
+		buf = vmalloc(size);
+	return buf;
+}
+
+static void mtdblock_free_window(void *buf)
+{
+	if (is_vmalloc_addr(buf))
+		vfree(buf);
+	else
+		kfree(buf);
+}
+
+static void mtdblock_free_windows(struct mtdblk_ro_dev *dev)
+{
+	int i;
+
+	if (!dev->win)
+		return;
+
+	for (i = 0; i < dev->nr_win; i++)
+		mtdblock_free_window(dev->win[i].data);
+	kfree(dev->win);
+	dev->win = NULL;
+	dev->nr_win = 0;
+}
+
+static void mtdblock_alloc_windows(struct mtdblk_ro_dev *dev)
+{
+	int i, nr = min(cache_windows, MTDBLK_RO_MAX_WINDOWS);
+
+	if (nr <= 0 || !dev->win_size)
+		return;
+
+	dev->win = kcalloc(nr, sizeof(struct mtdblk_ro_window), GFP_KERNEL);
+	if (!dev->win)
+		goto fail;
+	dev->nr_win = nr;
+
+	for (i = 0; i < nr; i++) {
+		dev->win[i].data = mtdblock_alloc_window(dev->win_size);
+		if (!dev->win[i].data)
+			goto fail;
+	}
+
+	dev->stamp = 0;
+	dev->last_ofs = -(loff_t)dev->win_size;
+	dev->ra_ofs = -1;
+	dev->hits = dev->misses = dev->ra_reads = 0;
+	return;
+
+fail:
+	printk(KERN_WARNING "mtdblock%d: no memory for read cache\n",
+	       dev->mbd.devnum);
+	mtdblock_free_windows(dev);
+}
+
+/*
+ * Open and release are serialised by the block device's bd_mutex, so the
+ * windows and the read-ahead thread come and go with the first open and
+ * the last release without racing each other.
+ */
+static int mtdblock_open(struct mtd_blktrans_dev *mbd)
+{
+	struct mtdblk_ro_dev *dev = to_ro_dev(mbd);
+	struct task_struct *thread;
+
+	mutex_lock(&dev->cache_mutex);
+	if (!dev->count++) {
+		mtdblock_alloc_windows(dev);
+		if (dev->nr_win >= 2) {
+			thread = kthread_run(mtdblock_ra_thread, dev,
+					     "mtdblkra%d", mbd->devnum);
+			if (!IS_ERR(thread))
+				dev->ra_thread = thread;
+		}
+	}
+	mutex_unlock(&dev->cache_mutex);
+
+	return 0;
+}
+
+static int mtdblock_release(struct mtd_blktrans_dev *mbd)
+{
+	struct mtdblk_ro_dev *dev = to_ro_dev(mbd);
+	struct task_struct *thread = NULL;
+	int last;
+
+	mutex_lock(&dev->cache_mutex);
+	last = !--dev->count;
+	if (last) {
+		if (dev->win)
+			DEBUG(MTD_DEBUG_LEVEL1, "mtdblock%d: %u hits, %u misses, "
+			      "%u windows read ahead\n", mbd->devnum,
+			      dev->hits, dev->misses, dev->ra_reads);
+		dev->ra_ofs = -1;
+		thread = dev->ra_thread;
+		dev->ra_thread = NULL;
+	}
+	mutex_unlock(&dev->cache_mutex);
+
+	if (!last)
+		return 0;
+
+	/* The thread takes cache_mutex, so it is stopped without holding it */
+	if (thread)
+		kthread_stop(thread);
+
+	mutex_lock(&dev->cache_mutex);
+	mtdblock_free_windows(dev);
+	mutex_unlock(&dev->cache_mutex);
+
+	return 0;
+}
+
+static int mtdblock_flush(struct mtd_blktrans_dev *mbd)
+{
+	struct mtdblk_ro_dev *dev = to_ro_dev(mbd);
+	int i;
+
+	/* A window being filled is being read afresh, so it is left alone */
+	mutex_lock(&dev->cache_mutex);
+	for (i = 0; i < dev->nr_win; i++)
+		if (dev->win[i].state == WIN_VALID)
+			dev->win[i].state = WIN_EMPTY;
+	dev->ra_ofs = -1;
+	mutex_unlock(&dev->cache_mutex);
+
+	return 0;
+}
+
 static void mtdblock_add_mtd(struct mtd_blktrans_ops *tr, struct mtd_info *mtd)
 {
-	struct mtd_blktrans_dev *dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	struct mtdblk_ro_dev *dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	unsigned int win_size;
 
 	if (!dev)
 		return;
 
-	dev->mtd = mtd;
-	dev->devnum = mtd->index;
+	dev->mbd.mtd = mtd;
+	dev->mbd.devnum = mtd->index;
 
-	dev->size = mtd->size >> 9;
-	dev->tr = tr;
-	dev->readonly = 1;
+	dev->mbd.size = mtd->size >> 9;
+	dev->mbd.tr = tr;
+	dev->mbd.readonly = 1;
 
-	add_mtd_blktrans_dev(dev);
+	mutex_init(&dev->cache_mutex);
+	init_waitqueue_head(&dev->wait);
+	dev->ra_ofs = -1;
+
+	win_size = min_t(uint32_t, mtd->erasesize, MTDBLK_RO_MAX_WINDOW);
+	if (win_size >= 512)
+		dev->win_size = rounddown_pow_of_two(win_size);
+
+	if (add_mtd_blktrans_dev(&dev->mbd))
+		kfree(dev);
 }
 
-static void mtdblock_remove_dev(struct mtd_blktrans_dev *dev)
+static void mtdblock_remove_dev(struct mtd_blktrans_dev *mbd)
 {
-	del_mtd_blktrans_dev(dev);
+	struct mtdblk_ro_dev *dev = to_ro_dev(mbd);
+
+	del_mtd_blktrans_dev(mbd);
 	kfree(dev);
 }
 
@@ -57,6 +459,9 @@ static struct mtd_blktrans_ops mtdblock_tr = {
 	.major		= 31,
 	.part_bits	= 0,
 	.blksize 	= 512,
+	.open		= mtdblock_open,
+	.release	= mtdblock_release,
+	.flush		= mtdblock_flush,
 	.readsect	= mtdblock_readsect,
 	.writesect	= mtdblock_writesect,
 	.add_mtd	= mtdblock_add_mtd,
@@ -1346,6 +1346,7 @@ int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 	struct mtd_ecc_stats stats;
 	int blkcheck = (1 << (chip->phys_erase_shift - chip->page_shift)) - 1;
 	int sndcmd = 1;
+	int cacherd, incache = 0, seq;
 	int ret = 0;
 	uint32_t readlen = ops->len;
 	uint32_t oobreadlen = ops->ooblen;
@@ -1371,12 +1372,22 @@ int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		reenable_ondie_ecc = 1;
 	}
 
+	/*
+	 * Cache read lets the chip load the next page while the current one
+	 * is transferred. It needs ECC modes which read the page with no
+	 * further command, and is not supported with on-die ECC.
+	 */
+	cacherd = (chip->options & (NAND_CACHERD | NAND_USE_CACHE_OPS)) ==
+		  (NAND_CACHERD | NAND_USE_CACHE_OPS) &&
+		  chip->ecc.mode != NAND_ECC_HW_OOB_FIRST &&
+		  chip->ecc.mode != NAND_ECC_4BITONDIE;
+
 	while(1) {
 		bytes = min(mtd->writesize - col, readlen);
 		aligned = (bytes == mtd->writesize);
 
 		/* Is the current page in the buffer ? */
-		if (realpage != chip->pagebuf || oob) {
+		if (realpage != chip->pagebuf || oob || incache) {
 			bufpoi = aligned ? buf : chip->buffers->databuf;
 
 			if (likely(sndcmd)) {
@@ -1384,11 +1395,28 @@ int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 				sndcmd = 0;
 			}
 
+			/*
+			 * Start loading the next page if it is read too and
+			 * is in the same block, or end the cache read.
+			 */
+			seq = incache;
+			if (cacherd && readlen > bytes &&
+			    ((page + 1) & blkcheck)) {
+				chip->cmdfunc(mtd, NAND_CMD_READCACHESEQ,
+					      -1, -1);
+				incache = seq = 1;
+			} else if (incache) {
+				chip->cmdfunc(mtd, NAND_CMD_READCACHEEND,
+					      -1, -1);
+				incache = 0;
+			}
+
 			/* Now read the page into the buffer */
 			if (unlikely(ops->mode == MTD_OOB_RAW))
 				ret = chip->ecc.read_page_raw(mtd, chip,
 							      bufpoi, page);
-			else if (!aligned && NAND_SUBPAGE_READ(chip) && !oob)
+			else if (!aligned && NAND_SUBPAGE_READ(chip) && !oob &&
+				 !seq)
 				ret = chip->ecc.read_subpage(mtd, chip, col, bytes, bufpoi);
 			else
 				ret = chip->ecc.read_page(mtd, chip, bufpoi,
@@ -1459,10 +1487,14 @@ int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		/* Check, if the chip supports auto page increment
 		 * or if we have hit a block boundary.
 		 */
-		if (!NAND_CANAUTOINCR(chip) || !(page & blkcheck))
+		if (!incache && (!NAND_CANAUTOINCR(chip) || !(page & blkcheck)))
 			sndcmd = 1;
 	}
 
+	/* Do not leave the chip in the middle of a cache read */
+	if (incache)
+		chip->cmdfunc(mtd, NAND_CMD_READCACHEEND, -1, -1);
+
 	ops->retlen = ops->len - (size_t) readlen;
 	if (oob)
 		ops->oobretlen = ops->ooblen - oobreadlen;
@@ -1971,7 +2003,7 @@ static void nand_write_page_syndrome(struct mtd_info *mtd,
 static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 			   const uint8_t *buf, int page, int cached, int raw)
 {
-	int status;
+	int status, fail = NAND_STATUS_FAIL;
 
 	chip->cmdfunc(mtd, NAND_CMD_SEQIN, 0x00, page);
 
@@ -1981,15 +2013,30 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 		chip->ecc.write_page(mtd, chip, buf);
 
 	/*
-	 * Cached progamming disabled for now, Not sure if its worth the
-	 * trouble. The speed gain is not very impressive. (2.3->2.6Mib/s)
+	 * Cached programming returns as soon as the cache register is free,
+	 * while the previous page is still being programmed. This is only
+	 * done if the board driver knows about the command, and not if
+	 * pages are read back to verify them.
 	 */
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
 	cached = 0;
+#endif
+	if ((chip->options & (NAND_CACHEPRG | NAND_USE_CACHE_OPS)) !=
+	    (NAND_CACHEPRG | NAND_USE_CACHE_OPS))
+		cached = 0;
 
-	if (!cached || !(chip->options & NAND_CACHEPRG)) {
+	/*
+	 * During a cached program sequence the status reports the pages
+	 * before the current one: FAIL and FAIL_N1 may be set for any page of
+	 * the sequence, the last program command reports all of them.
+	 */
+	if (cached || chip->state == FL_CACHEDPRG)
+		fail |= NAND_STATUS_FAIL_N1;
 
+	if (!cached) {
 		chip->cmdfunc(mtd, NAND_CMD_PAGEPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
+		chip->state = FL_WRITING;
 		/*
 		 * See if operation failed and additional status checks are
 		 * available
@@ -1997,14 +2044,15 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 		if ((status & NAND_STATUS_FAIL) && (chip->errstat))
 			status = chip->errstat(mtd, chip, FL_WRITING, status,
 					       page);
-
-		if (status & NAND_STATUS_FAIL)
-			return -EIO;
 	} else {
 		chip->cmdfunc(mtd, NAND_CMD_CACHEDPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
+		chip->state = FL_CACHEDPRG;
 	}
 
+	if (status & fail)
+		return -EIO;
+
 #ifdef CONFIG_MTD_NAND_VERIFY_WRITE
 	/* Send command to read back the data */
 	chip->cmdfunc(mtd, NAND_CMD_READ0, 0, page);
@@ -2386,6 +2434,27 @@ static void multi_erase_cmd(struct mtd_info *mtd, int page)
 	chip->cmdfunc(mtd, NAND_CMD_ERASE2, -1, -1);
 }
 
+/**
+ * nand_erase_pair - [Internal] erase two blocks with a multi-plane erase
+ * @mtd:	MTD device structure
+ * @page:	the page address of the first block, in plane 0
+ *
+ * Returns the status of the erase. If it failed, it is not known which one
+ * of the blocks could not be erased.
+ */
+static int nand_erase_pair(struct mtd_info *mtd, int page)
+{
+	struct nand_chip *chip = mtd->priv;
+	int pages_per_block = 1 << (chip->phys_erase_shift - chip->page_shift);
+
+	chip->cmdfunc(mtd, NAND_CMD_ERASE1, -1, page);
+	chip->cmdfunc(mtd, NAND_CMD_MULTI_ERASE2, -1, -1);
+	chip->cmdfunc(mtd, NAND_CMD_ERASE1, -1, page + pages_per_block);
+	chip->cmdfunc(mtd, NAND_CMD_ERASE2, -1, -1);
+
+	return chip->waitfunc(mtd, chip);
+}
+
 /**
  * nand_erase - [MTD Interface] erase block(s)
  * @mtd:	MTD device structure
@@ -2410,7 +2479,7 @@ static int nand_erase(struct mtd_info *mtd, struct erase_info *instr)
 int nand_erase_nand(struct mtd_info *mtd, struct erase_info *instr,
 		    int allowbbt)
 {
-	int page, status, pages_per_block, ret, chipnr;
+	int page, status, pages_per_block, ret, chipnr, multiplane;
 	struct nand_chip *chip = mtd->priv;
 	loff_t rewrite_bbt[NAND_MAX_CHIPS]={0};
 	unsigned int bbt_masked_page = 0xffffffff;
@@ -2472,6 +2541,18 @@ int nand_erase_nand(struct mtd_info *mtd, struct erase_info *instr,
 	if (chip->options & BBT_AUTO_REFRESH && !allowbbt)
 		bbt_masked_page = chip->bbt_td->pages[chipnr] & BBT_PAGE_MASK;
 
+	/*
+	 * Blocks are interleaved between planes, so on a chip with two planes
+	 * per LUN, an even block and the next one may be erased at once.
+	 */
+	multiplane = (chip->options &
+		      (NAND_MULTIPLANE_PROG_ERASE | NAND_USE_MULTIPLANE)) ==
+		     (NAND_MULTIPLANE_PROG_ERASE | NAND_USE_MULTIPLANE) &&
+		     chip->erase_cmd == single_erase_cmd &&
+		     chip->luns_per_chip > 0 &&
+		     chip->planes_per_chip / chip->luns_per_chip == 2 &&
+		     bbt_masked_page == 0xffffffff;
+
 	/* Loop through the pages */
 	len = instr->len;
 
@@ -2495,9 +2576,24 @@ int nand_erase_nand(struct mtd_info *mtd, struct erase_info *instr,
 		 * contains the current cached page
 		 */
 		if (page <= chip->pagebuf && chip->pagebuf <
-		    (page + pages_per_block))
+		    (page + 2 * pages_per_block))
 			chip->pagebuf = -1;
 
+		if (multiplane && len >= 2 * mtd->erasesize &&
+		    !(page & pages_per_block) &&
+		    (nand_erasebb ||
+		     !nand_block_checkbad(mtd, ((loff_t)(page +
+				pages_per_block)) << chip->page_shift,
+				0, allowbbt))) {
+			status = nand_erase_pair(mtd, page & chip->pagemask);
+			if (!(status & NAND_STATUS_FAIL)) {
+				len -= 2 * mtd->erasesize;
+				page += 2 * pages_per_block;
+				goto next_block;
+			}
+			/* Erase them one by one to find out the bad one */
+		}
+
 		chip->erase_cmd(mtd, page & chip->pagemask);
 
 		status = chip->waitfunc(mtd, chip);
@@ -2533,6 +2629,7 @@ int nand_erase_nand(struct mtd_info *mtd, struct erase_info *instr,
 		len -= (1 << chip->phys_erase_shift);
 		page += pages_per_block;
 
+next_block:
 		/* Check, if we cross a chip boundary */
 		if (len && !(page & chip->pagemask)) {
 			chipnr++;
@@ -3277,6 +3374,15 @@ int nand_scan_tail(struct mtd_info *mtd)
 	/* propagate ecc.layout to mtd_info */
 	mtd->ecclayout = chip->ecc.layout;
 
+	if ((chip->options & NAND_USE_CACHE_OPS) &&
+	    (chip->options & (NAND_CACHEPRG | NAND_CACHERD)))
+		printk(KERN_INFO "%s: using cache%s%s\n", mtd->name,
+		       chip->options & NAND_CACHEPRG ? " program" : "",
+		       chip->options & NAND_CACHERD ? " read" : "");
+	if ((chip->options & NAND_USE_MULTIPLANE) &&
+	    (chip->options & NAND_MULTIPLANE_PROG_ERASE))
+		printk(KERN_INFO "%s: using multi-plane erase\n", mtd->name);
+
 	/* Check, if we should skip the bad block table scan */
 	if (chip->options & NAND_SKIP_BBTSCAN)
 		return 0;
@@ -41,6 +41,7 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/pagemap.h>
+#include <linux/ktime.h>
 
 /* Default simulator parameters values */
 #if !defined(CONFIG_NANDSIM_FIRST_ID_BYTE)  || \
@@ -104,6 +105,8 @@ static char *gravepages = NULL;
 static unsigned int rptwear = 0;
 static unsigned int overridesize = 0;
 static char *cache_file = NULL;
+static unsigned int cache_ops = 0;
+static unsigned int planes = 1;
 
 module_param(first_id_byte,  uint, 0400);
 module_param(second_id_byte, uint, 0400);
@@ -127,6 +130,8 @@ module_param(gravepages,     charp, 0400);
 module_param(rptwear,        uint, 0400);
 module_param(overridesize,   uint, 0400);
 module_param(cache_file,     charp, 0400);
+module_param(cache_ops,      uint, 0400);
+module_param(planes,         uint, 0400);
 
 MODULE_PARM_DESC(first_id_byte,  "The first byte returned by NAND Flash 'read ID' command (manufacturer ID)");
 MODULE_PARM_DESC(second_id_byte, "The second byte returned by NAND Flash 'read ID' command (chip ID)");
@@ -159,6 +164,10 @@ MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the I
 				 "The size is specified in erase blocks and as the exponent of a power of two"
 				 " e.g. 5 means a size of 32 erase blocks");
 MODULE_PARM_DESC(cache_file,     "File to use to cache nand pages instead of memory");
+MODULE_PARM_DESC(cache_ops,      "Support cache program and cache read commands if not zero"
+				 " (large page chips only)");
+MODULE_PARM_DESC(planes,         "Number of planes, 2 means two-plane erase is supported"
+				 " (large page chips only)");
 
 /* The largest possible page size */
 #define NS_LARGEST_PAGE_SIZE	2048
@@ -354,6 +363,14 @@ struct nandsim {
 	void *file_buf;
 	struct page *held_pages[NS_MAX_HELD_PAGES];
 	int held_cnt;
+
+	/* Fields needed for cache and multi-plane operations */
+	ktime_t array_busy; /* When the array finishes the background operation */
+	uint cache_row;     /* Page in the data register for cache read */
+	int cached_prog;    /* The program command is a cache program */
+	int plane_cmd;      /* The erase command is a two-plane erase first one */
+	int multi_erase;    /* First block of a two-plane erase, or -1 */
+	int multi_erase_failed; /* Erasure of the first block failed */
 };
 
 /*
@@ -1568,6 +1585,30 @@ static int prog_page(struct nandsim *ns, int num)
 	return 0;
 }
 
+/*
+ * Wait until the array finishes the operation which a cache program or
+ * cache read command left running in the background.
+ */
+static void ns_wait_array(struct nandsim *ns)
+{
+	s64 us;
+
+	if (!do_delays)
+		return;
+
+	us = ktime_us_delta(ns->array_busy, ktime_get());
+	if (us > 0)
+		udelay(us);
+}
+
+/*
+ * Start an array operation of @us microseconds in the background.
+ */
+static void ns_start_array(struct nandsim *ns, uint us)
+{
+	ns->array_busy = ktime_add_us(ktime_get(), us);
+}
+
 /*
  * If state has any action bit, perform this action.
  *
@@ -1587,6 +1628,11 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 		return -1;
 	}
 
+	/* The array must have finished any background operation */
+	if (action == ACTION_CPY || action == ACTION_PRGPAGE ||
+	    action == ACTION_SECERASE)
+		ns_wait_array(ns);
+
 	switch (action) {
 
 	case ACTION_CPY:
@@ -1601,6 +1647,7 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 		}
 		num = ns->geom.pgszoob - ns->regs.off - ns->regs.column;
 		read_page(ns, num);
+		ns->cache_row = ns->regs.row;
 
 		NS_DBG("do_state_action: (ACTION_CPY:) copy %d bytes to int buf, raw offset %d\n",
 			num, NS_RAW_OFFSET(ns) + ns->regs.off);
@@ -1645,16 +1692,36 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 
 		erase_sector(ns);
 
-		NS_MDELAY(erase_delay);
+		if (ns->plane_cmd) {
+			/* Both planes are erased after the last command */
+			ns->multi_erase = erase_block_no;
+			ns->multi_erase_failed = 0;
+		} else {
+			if (ns->multi_erase >= 0 &&
+			    !((ns->multi_erase ^ erase_block_no) & 1))
+				NS_WARN("two-plane erase of blocks %d and %u in the same plane\n",
+					ns->multi_erase, erase_block_no);
+			NS_MDELAY(erase_delay);
+		}
 
 		if (erase_block_wear)
 			update_wear(erase_block_no);
 
 		if (erase_error(erase_block_no)) {
 			NS_WARN("simulating erase failure in erase block %u\n", erase_block_no);
+			if (ns->plane_cmd)
+				ns->multi_erase_failed = 1;
+			else
+				ns->multi_erase = -1;
 			return -1;
 		}
 
+		if (!ns->plane_cmd && ns->multi_erase >= 0) {
+			ns->multi_erase = -1;
+			if (ns->multi_erase_failed)
+				return -1;
+		}
+
 		break;
 
 	case ACTION_PRGPAGE:
@@ -1683,7 +1750,11 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 			num, ns->regs.row, ns->regs.column, NS_RAW_OFFSET(ns) + ns->regs.off);
 		NS_LOG("programm page %d\n", ns->regs.row);
 
-		NS_UDELAY(programm_delay);
+		if (ns->cached_prog)
+			/* The page is programmed while the next one is input */
+			ns_start_array(ns, programm_delay);
+		else
+			NS_UDELAY(programm_delay);
 		NS_UDELAY(output_cycle * ns->geom.pgsz / 1000 / busdiv);
 
 		if (write_error(page_no)) {
@@ -1942,6 +2013,45 @@ static u_char ns_nand_read_byte(struct mtd_info *mtd)
 	return outb;
 }
 
+/*
+ * Cache read commands output the page from the data register. The
+ * sequential one also starts loading the next page in the background.
+ */
+static void ns_cache_read(struct nandsim *ns, u_char cmd)
+{
+	static uint32_t states[] = {STATE_CMD_READSTART, STATE_DATAOUT,
+				    STATE_READY, STATE_READY};
+	int busdiv = ns->busw == 8 ? 1 : 2;
+
+	if (ns->cache_row >= ns->geom.pgnum) {
+		NS_WARN("cache read: wrong page number (%#x)\n", ns->cache_row);
+		switch_to_ready_state(ns, NS_STATUS_FAILED(ns));
+		return;
+	}
+
+	ns_wait_array(ns);
+
+	switch_to_ready_state(ns, NS_STATUS_OK(ns));
+	ns->regs.command = cmd;
+	ns->regs.row = ns->cache_row;
+	read_page(ns, ns->geom.pgszoob);
+	NS_LOG("cache read page %d\n", ns->regs.row);
+
+	if (cmd == NAND_CMD_READCACHESEQ) {
+		ns->cache_row += 1;
+		ns_start_array(ns, access_delay);
+	}
+
+	NS_UDELAY(output_cycle * ns->geom.pgsz / 1000 / busdiv);
+
+	/* Continue as the data output of a page read */
+	ns->op = &states[0];
+	ns->stateidx = 1;
+	ns->state = STATE_DATAOUT;
+	ns->nxstate = STATE_READY;
+	ns->regs.num = ns->geom.pgszoob;
+}
+
 static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 {
         struct nandsim *ns = (struct nandsim *)((struct nand_chip *)mtd->priv)->priv;
@@ -1967,6 +2077,26 @@ static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 			return;
 		}
 
+		if (cache_ops && (byte == NAND_CMD_READCACHESEQ ||
+				  byte == NAND_CMD_READCACHEEND)) {
+			ns_cache_read(ns, byte);
+			return;
+		}
+
+		/*
+		 * Cache program and two-plane erase go through the same
+		 * states as the basic commands.
+		 */
+		ns->cached_prog = 0;
+		ns->plane_cmd = 0;
+		if (cache_ops && byte == NAND_CMD_CACHEDPROG) {
+			ns->cached_prog = 1;
+			byte = NAND_CMD_PAGEPROG;
+		} else if (planes == 2 && byte == NAND_CMD_MULTI_ERASE2) {
+			ns->plane_cmd = 1;
+			byte = NAND_CMD_ERASE2;
+		}
+
 		/* Check that the command byte is correct */
 		if (check_command(byte)) {
 			NS_ERR("write_byte: unknown command %#x\n", (uint)byte);
@@ -2273,6 +2403,7 @@ static int __init ns_init_module(void)
 	nand->ids[1] = second_id_byte;
 	nand->ids[2] = third_id_byte;
 	nand->ids[3] = fourth_id_byte;
+	nand->multi_erase = -1;
 	if (bus_width == 16) {
 		nand->busw = 16;
 		chip->options |= NAND_BUSWIDTH_16;
@@ -2289,7 +2420,21 @@ static int __init ns_init_module(void)
 	if ((retval = parse_gravepages()) != 0)
 		goto error;
 
-	if ((retval = nand_scan(nsmtd, 1)) != 0) {
+	retval = nand_scan_ident(nsmtd, 1);
+	if (!retval && nsmtd->writesize > 512) {
+		if (cache_ops)
+			chip->options |= NAND_CACHEPRG | NAND_CACHERD |
+					 NAND_USE_CACHE_OPS;
+		if (planes == 2) {
+			chip->options |= NAND_MULTIPLANE_PROG_ERASE |
+					 NAND_USE_MULTIPLANE;
+			chip->planes_per_chip = 2;
+			chip->luns_per_chip = 1;
+		}
+	}
+	if (!retval)
+		retval = nand_scan_tail(nsmtd);
+	if (retval != 0) {
 		NS_ERR("can't register NAND Simulator\n");
 		if (retval > 0)
 			retval = -ENXIO;
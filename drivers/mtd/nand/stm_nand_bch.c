@@ -33,6 +33,7 @@
 
 #include "stm_nand_regs.h"
 #include "stm_nand_bbt.h"
+#include "stm_nand_ecc.h"
 
 #define NAME	"stm-nand-bch"
 
@@ -42,6 +43,9 @@
 #define NANDI_BCH_DMA_ALIGNMENT			64
 #define NANDI_BCH_MAX_BUF_LIST			8
 #define NANDI_BCH_BUF_LIST_SIZE			(4 * NANDI_BCH_MAX_BUF_LIST)
+#define NANDI_BCH_BUF_LIST_SLOT			ALIGN(NANDI_BCH_BUF_LIST_SIZE, \
+						      NANDI_BCH_DMA_ALIGNMENT)
+#define NANDI_BCH_READ_QUEUE			8
 
 /* BCH ECC sizes */
 static int bch_ecc_sizes[] = {
@@ -112,6 +116,14 @@ struct nandi_info {
 	struct	mtd_partition 	*parts;		/* MTD partitions */
 };
 
+/* Queued BCH page read */
+struct bch_read_req {
+	loff_t			offs;		/* Page offset */
+	uint8_t			*buf;		/* Destination buffer */
+	dma_addr_t		buf_phys;
+	int			ecc_err;	/* ECC score, '-1' if not read */
+};
+
 /* NANDi Controller (Hamming/BCH) */
 struct nandi_controller {
 	void __iomem		*base;		/* Controller base*/
@@ -140,7 +152,15 @@ struct nandi_controller {
 	uint8_t			*buf;		/* Some buffers to use */
 	uint8_t			*page_buf;
 	uint8_t			*oob_buf;
-	uint32_t		*buf_list;
+	uint32_t		*buf_list;	/* One list per queued read, */
+	dma_addr_t		buf_list_phys;	/*  mapped at probe */
+
+						/* Queued page reads: */
+	struct bch_read_req	rq[NANDI_BCH_READ_QUEUE];
+	int			rq_count;	/*   queued */
+	int			rq_len;		/*   started, '0' if idle */
+	int			rq_done;	/*   completed, set by IRQ */
+	wait_queue_head_t	rq_wait;
 
 	int			cached_page;	/* page number of page in
 						 *  'page_buf' */
@@ -268,6 +288,8 @@ static void bch_configure_progs(struct nandi_controller *nandi)
 	}
 }
 
+static void bch_read_done(struct nandi_controller *nandi);
+
 /*
  * NANDi Interrupts (shared by Hamming and BCH controllers)
  */
@@ -282,7 +304,10 @@ static irqreturn_t nandi_irq_handler(int irq, void *dev)
 		/* BCH */
 		writel(NANDBCH_INT_CLR_SEQNODESOVER,
 		       nandi->base + NANDBCH_INT_CLR);
-		complete(&nandi->seq_completed);
+		if (nandi->rq_len)
+			bch_read_done(nandi);
+		else
+			complete(&nandi->seq_completed);
 	}
 	if (status & NAND_INT_RBN) {
 		/* Hamming */
@@ -359,100 +384,150 @@ static uint8_t bch_erase_block(struct nandi_controller *nandi,
 }
 
 /*
- * Detect an erased page, tolerating and correcting up to a specified number of
- * bits at '0'.  (For many devices, it is now deemed within spec for an erased
- * page to include a number of bits at '0', either as a result of read-disturb
- * behaviour or 'stuck-at-zero' failures.)  Returns the number of corrected
- * bits, or a '-1' if we have exceeded the maximum number of bits at '0' (likely
- * to be a genuine uncorrectable ECC error).  In the latter case, the data must
- * be returned unmodified, in accordance with the MTD API.
+ * Queued page reads.  Pages are queued with bch_queue_read(), then read
+ * back-to-back: the IRQ handler starts the next page as soon as the current
+ * one completes, while the caller checks and copies the pages already read
+ * with bch_wait_read().
  */
-static int check_erased_page(uint8_t *data, uint32_t page_size, int max_zeros)
+static void bch_start_read(struct nandi_controller *nandi, int i)
 {
-	uint8_t *b = data;
-	int i;
-	int zeros = 0;
+	struct bch_prog *prog = &bch_prog_read_page;
 
-	for (i = 0; i < page_size; i++) {
-		zeros += hweight8(~*b++);
-		if (zeros > max_zeros)
-			return -1;
-	}
+	/* Reset ECC stats */
+	writel(CFG_RESET_ECC_ALL | CFG_ENABLE_AFM,
+	       nandi->base + NANDBCH_CONTROLLER_CFG);
+	writel(CFG_ENABLE_AFM, nandi->base + NANDBCH_CONTROLLER_CFG);
 
-	if (zeros)
-		memset(data, 0xff, page_size);
+	prog->addr = (uint32_t)((nandi->rq[i].offs >> (nandi->page_shift - 8)) &
+				0xffffff00);
 
-	return zeros;
+	writel(nandi->buf_list_phys + i * NANDI_BCH_BUF_LIST_SLOT,
+	       nandi->base + NANDBCH_BUFFER_LIST_PTR);
+
+	bch_load_prog_cpu(nandi, prog);
 }
 
-/* Returns the number of ECC errors, or '-1' for uncorrectable error */
-static int bch_read_page(struct nandi_controller *nandi,
-			 loff_t offs,
-			 uint8_t *buf)
+/* Called from the IRQ handler when a queued read completes */
+static void bch_read_done(struct nandi_controller *nandi)
 {
-	struct bch_prog *prog = &bch_prog_read_page;
-	uint32_t page_size = nandi->info.mtd.writesize;
-	unsigned long list_phys;
-	unsigned long buf_phys;
-	uint32_t ecc_err;
-	int ret = 0;
+	int i = nandi->rq_done;
 
-	dev_dbg(nandi->dev, "%s: offs = 0x%012llx\n", __func__, offs);
+	/* Use the maximum per-sector ECC count! */
+	nandi->rq[i].ecc_err = readl(nandi->base +
+				     NANDBCH_ECC_SCORE_REG_A) & 0xff;
 
+	if (++i < nandi->rq_len)
+		bch_start_read(nandi, i);
+
+	nandi->rq_done = i;
+	wake_up(&nandi->rq_wait);
+}
+
+static void bch_queue_read(struct nandi_controller *nandi,
+			   loff_t offs, uint8_t *buf)
+{
+	int i = nandi->rq_count;
+	struct bch_read_req *rq = &nandi->rq[i];
+	uint32_t *list = (uint32_t *)((uint8_t *)nandi->buf_list +
+				      i * NANDI_BCH_BUF_LIST_SLOT);
+
+	BUG_ON(i >= NANDI_BCH_READ_QUEUE);
 	BUG_ON((unsigned long)buf & (NANDI_BCH_DMA_ALIGNMENT - 1));
 	BUG_ON(offs & (NANDI_BCH_DMA_ALIGNMENT - 1));
 
-	emiss_nandi_select(STM_NANDI_BCH);
+	rq->offs = offs;
+	rq->buf = buf;
+	rq->buf_phys = dma_map_single(NULL, buf, nandi->info.mtd.writesize,
+				      DMA_FROM_DEVICE);
+	rq->ecc_err = -1;
 
-	nandi_enable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
-	INIT_COMPLETION(nandi->seq_completed);
+	memset(list, 0x00, NANDI_BCH_BUF_LIST_SIZE);
+	list[0] = rq->buf_phys | (nandi->sectors_per_page - 1);
 
-	/* Reset ECC stats */
-	writel(CFG_RESET_ECC_ALL | CFG_ENABLE_AFM,
-	       nandi->base + NANDBCH_CONTROLLER_CFG);
-	writel(CFG_ENABLE_AFM, nandi->base + NANDBCH_CONTROLLER_CFG);
+	nandi->rq_count++;
+}
 
-	prog->addr = (uint32_t)((offs >> (nandi->page_shift - 8)) & 0xffffff00);
+static void bch_start_reads(struct nandi_controller *nandi)
+{
+	dma_sync_single_for_device(NULL, nandi->buf_list_phys,
+				   nandi->rq_count * NANDI_BCH_BUF_LIST_SLOT,
+				   DMA_TO_DEVICE);
 
-	buf_phys = dma_map_single(NULL, buf, page_size, DMA_FROM_DEVICE);
+	emiss_nandi_select(STM_NANDI_BCH);
 
-	memset(nandi->buf_list, 0x00, NANDI_BCH_BUF_LIST_SIZE);
-	nandi->buf_list[0] = buf_phys | (nandi->sectors_per_page - 1);
+	nandi->rq_done = 0;
+	nandi->rq_len = nandi->rq_count;
 
-	list_phys = dma_map_single(NULL, nandi->buf_list,
-				   NANDI_BCH_BUF_LIST_SIZE, DMA_TO_DEVICE);
+	nandi_enable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
 
-	writel(list_phys, nandi->base + NANDBCH_BUFFER_LIST_PTR);
+	bch_start_read(nandi, 0);
+}
 
-	bch_load_prog_cpu(nandi, prog);
+static void bch_end_reads(struct nandi_controller *nandi)
+{
+	nandi_disable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
 
-	bch_wait_seq(nandi);
+	nandi->rq_len = 0;
+	nandi->rq_count = 0;
+}
 
-	nandi_disable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
+/*
+ * Wait for the queued read 'i' to complete.  Returns the number of ECC errors,
+ * or '-1' for uncorrectable error.
+ */
+static int bch_wait_read(struct nandi_controller *nandi, int i)
+{
+	struct bch_read_req *rq = &nandi->rq[i];
+	uint32_t page_size = nandi->info.mtd.writesize;
+	int ret;
 
-	dma_unmap_single(NULL, list_phys, NANDI_BCH_BUF_LIST_SIZE,
-			 DMA_TO_DEVICE);
-	dma_unmap_single(NULL, buf_phys, page_size, DMA_FROM_DEVICE);
+	if (!wait_event_timeout(nandi->rq_wait, nandi->rq_done > i, HZ/2)) {
+		dev_err(nandi->dev, "BCH Seq timeout\n");
 
-	/* Use the maximum per-sector ECC count! */
-	ecc_err = readl(nandi->base + NANDBCH_ECC_SCORE_REG_A) & 0xff;
-	if (ecc_err == 0xff) {
+		/* Give up on the pages not read yet */
+		nandi_disable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
+		nandi->rq_done = nandi->rq_len;
+	}
+
+	dma_unmap_single(NULL, rq->buf_phys, page_size, DMA_FROM_DEVICE);
+
+	if (rq->ecc_err < 0)
+		return -1;
+
+	if (rq->ecc_err == 0xff) {
 		/* Downgrade uncorrectable ECC error for an erased page,
 		 * tolerating 'sectors_per_page' bits at zero.
 		 */
-		ret = check_erased_page(buf, page_size,
-					nandi->sectors_per_page);
+		ret = stmnand_check_erased(rq->buf, page_size,
+					   nandi->sectors_per_page);
 		if (ret >= 0)
 			dev_dbg(nandi->dev, "%s: erased page detected: "
 				"downgrading uncorrectable ECC error.\n",
 				__func__);
 	} else {
-		ret = (int)ecc_err;
+		ret = rq->ecc_err;
 	}
 
 	return ret;
 }
 
+/* Returns the number of ECC errors, or '-1' for uncorrectable error */
+static int bch_read_page(struct nandi_controller *nandi,
+			 loff_t offs,
+			 uint8_t *buf)
+{
+	int ret;
+
+	dev_dbg(nandi->dev, "%s: offs = 0x%012llx\n", __func__, offs);
+
+	bch_queue_read(nandi, offs, buf);
+	bch_start_reads(nandi);
+	ret = bch_wait_read(nandi, 0);
+	bch_end_reads(nandi);
+
+	return ret;
+}
+
 /* Returns the status of the NAND device following the write operation */
 static uint8_t bch_write_page(struct nandi_controller *nandi,
 			      loff_t offs, const uint8_t *buf)
@@ -460,7 +535,6 @@ static uint8_t bch_write_page(struct nandi_controller *nandi,
 	struct bch_prog *prog = &bch_prog_write_page;
 	uint32_t page_size = nandi->info.mtd.writesize;
 	uint8_t *p = (uint8_t *)buf;
-	unsigned long list_phys;
 	unsigned long buf_phys;
 	uint8_t status;
 
@@ -480,10 +554,10 @@ static uint8_t bch_write_page(struct nandi_controller *nandi,
 	memset(nandi->buf_list, 0x00, NANDI_BCH_BUF_LIST_SIZE);
 	nandi->buf_list[0] = buf_phys | (nandi->sectors_per_page - 1);
 
-	list_phys = dma_map_single(NULL, nandi->buf_list,
+	dma_sync_single_for_device(NULL, nandi->buf_list_phys,
 				   NANDI_BCH_BUF_LIST_SIZE, DMA_TO_DEVICE);
 
-	writel(list_phys, nandi->base + NANDBCH_BUFFER_LIST_PTR);
+	writel(nandi->buf_list_phys, nandi->base + NANDBCH_BUFFER_LIST_PTR);
 
 	bch_load_prog_cpu(nandi, prog);
 
@@ -491,8 +565,6 @@ static uint8_t bch_write_page(struct nandi_controller *nandi,
 
 	nandi_disable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
 
-	dma_unmap_single(NULL, list_phys, NANDI_BCH_BUF_LIST_SIZE,
-			 DMA_TO_DEVICE);
 	dma_unmap_single(NULL, buf_phys, page_size, DMA_FROM_DEVICE);
 
 	status = (uint8_t)(readl(nandi->base +
@@ -501,6 +573,50 @@ static uint8_t bch_write_page(struct nandi_controller *nandi,
 	return status;
 }
 
+/* Does reading 'bytes' to 'buf' need to go through 'page_buf'? */
+static inline int bch_must_bounce(struct nandi_controller *nandi,
+				  size_t bytes, u_char *buf)
+{
+	return (bytes != nandi->info.mtd.writesize) ||
+		((unsigned int)buf & (NANDI_BCH_DMA_ALIGNMENT - 1)) ||
+		(!virt_addr_valid(buf)); /* vmalloc'd buffer! */
+}
+
+/*
+ * Queue reads of the pages of a request, stopping at the cached page or after
+ * the first page which must be bounced through 'page_buf'.  Returns the number
+ * of pages queued.
+ */
+static int bch_queue_pages(struct nandi_controller *nandi,
+			   loff_t page_offs, uint32_t col_offs,
+			   size_t len, u_char *buf)
+{
+	uint32_t page_size = nandi->info.mtd.writesize;
+	int page_num = (int)(page_offs >> nandi->page_shift);
+	size_t bytes;
+	int n;
+
+	for (n = 0; len > 0 && n < NANDI_BCH_READ_QUEUE; n++) {
+		if (page_num == nandi->cached_page)
+			break;
+
+		bytes = min((page_size - col_offs), len);
+		if (bch_must_bounce(nandi, bytes, buf)) {
+			bch_queue_read(nandi, page_offs, nandi->page_buf);
+			return n + 1;
+		}
+		bch_queue_read(nandi, page_offs, buf);
+
+		buf += bytes;
+		len -= bytes;
+		page_offs += page_size;
+		page_num++;
+		col_offs = 0;
+	}
+
+	return n;
+}
+
 /* Helper function for mtd_read, to handle multi-page or non-aligned reads */
 static int bch_read(struct nandi_controller *nandi,
 		    loff_t from, size_t len,
@@ -515,8 +631,7 @@ static int bch_read(struct nandi_controller *nandi,
 	int ecc_errs, max_ecc_errs = 0;
 	size_t bytes;
 	uint8_t *p;
-
-	int bounce;
+	int i, n;
 
 	dev_dbg(nandi->dev, "%s: %llu @ 0x%012llx\n", __func__,
 		(unsigned long long)len, from);
@@ -531,34 +646,36 @@ static int bch_read(struct nandi_controller *nandi,
 		*retlen = 0;
 
 	while (len > 0) {
-		bytes = min((page_size - col_offs), len);
-
-		if ((bytes != page_size) ||
-		    ((unsigned int)buf & (NANDI_BCH_DMA_ALIGNMENT - 1)) ||
-		    (!virt_addr_valid(buf))) /* vmalloc'd buffer! */
-			bounce = 1;
-		else
-			bounce = 0;
-
-		if (page_num == nandi->cached_page) {
-			memcpy(buf, nandi->page_buf + col_offs, bytes);
-		} else {
-			p = bounce ? nandi->page_buf : buf;
-
-			ecc_errs = bch_read_page(nandi, page_offs, p);
-			if (bounce)
-				memcpy(buf, p + col_offs, bytes);
-
-			if (ecc_errs < 0) {
-				dev_err(nandi->dev, "%s: uncorrectable error "
-					"at 0x%012llx\n", __func__, page_offs);
-				nandi->info.mtd.ecc_stats.failed++;
-
-				/* Do not cache uncorrectable pages */
-				if (bounce)
-					nandi->cached_page = -1;
+		/* Keep the controller busy with the next pages while the
+		 * current one is checked and copied. */
+		n = bch_queue_pages(nandi, page_offs, col_offs, len, buf);
+		if (n)
+			bch_start_reads(nandi);
+
+		i = 0;
+		do {
+			bytes = min((page_size - col_offs), len);
+
+			if (!n) {
+				/* The page is in 'page_buf' */
+				memcpy(buf, nandi->page_buf + col_offs, bytes);
 			} else {
-				if (ecc_errs) {
+				p = nandi->rq[i].buf;
+				ecc_errs = bch_wait_read(nandi, i);
+
+				if (p == nandi->page_buf) {
+					memcpy(buf, p + col_offs, bytes);
+					/* Do not cache uncorrectable pages */
+					nandi->cached_page = ecc_errs < 0 ?
+						-1 : page_num;
+				}
+
+				if (ecc_errs < 0) {
+					dev_err(nandi->dev, "%s: uncorrectable "
+						"error at 0x%012llx\n",
+						__func__, page_offs);
+					nandi->info.mtd.ecc_stats.failed++;
+				} else if (ecc_errs) {
 					dev_info(nandi->dev, "%s: corrected %u "
 						 "error(s) at 0x%012llx\n",
 						 __func__, ecc_errs, page_offs);
@@ -567,22 +684,22 @@ static int bch_read(struct nandi_controller *nandi,
 					if (ecc_errs > max_ecc_errs)
 						max_ecc_errs = ecc_errs;
 				}
-
-				if (bounce)
-					nandi->cached_page = page_num;
 			}
-		}
 
-		buf += bytes;
-		len -= bytes;
+			buf += bytes;
+			len -= bytes;
 
-		if (retlen)
-			*retlen += bytes;
+			if (retlen)
+				*retlen += bytes;
 
-		/* We are now page-aligned */
-		page_offs += page_size;
-		page_num++;
-		col_offs = 0;
+			/* We are now page-aligned */
+			page_offs += page_size;
+			page_num++;
+			col_offs = 0;
+		} while (++i < n);
+
+		if (n)
+			bch_end_reads(nandi);
 	}
 
 	/* Return '-EBADMSG' if we have encountered an uncorrectable error. */
@@ -2805,6 +2922,7 @@ static int __devinit stm_nand_bch_probe(struct platform_device *pdev)
 
 	init_completion(&nandi->seq_completed);
 	init_completion(&nandi->rbn_completed);
+	init_waitqueue_head(&nandi->rq_wait);
 
 	bank = pdata->bank;
 	nandi_init_controller(nandi, bank->csn);
@@ -2918,8 +3036,9 @@ static int __devinit stm_nand_bch_probe(struct platform_device *pdev)
 	bbt_buf_size = ALIGN(bbt_info->bbt_size, mtd->writesize);
 	buf_size += bbt_buf_size + NANDI_BCH_DMA_ALIGNMENT;
 
-	/*	- BCH BUF list */
-	buf_size += NANDI_BCH_BUF_LIST_SIZE + NANDI_BCH_DMA_ALIGNMENT;
+	/*	- BCH BUF lists, one per queued read */
+	buf_size += NANDI_BCH_READ_QUEUE * NANDI_BCH_BUF_LIST_SLOT +
+		NANDI_BCH_DMA_ALIGNMENT;
 
 	/* Allocate bufffer */
 	nandi->buf = devm_kzalloc(&pdev->dev, buf_size, GFP_KERNEL);
@@ -2935,6 +3054,10 @@ static int __devinit stm_nand_bch_probe(struct platform_device *pdev)
 				  NANDI_BCH_DMA_ALIGNMENT);
 	nandi->buf_list = (uint32_t *) PTR_ALIGN(bbt_info->bbt + bbt_buf_size,
 						 NANDI_BCH_DMA_ALIGNMENT);
+	nandi->buf_list_phys = dma_map_single(NULL, nandi->buf_list,
+					      NANDI_BCH_READ_QUEUE *
+					      NANDI_BCH_BUF_LIST_SLOT,
+					      DMA_TO_DEVICE);
 	nandi->cached_page = -1;
 	if (nandi_examine_bbts(nandi, mtd) != 0) {
 		dev_err(nandi->dev, "incompatible BBTs detected\n");
@@ -3019,6 +3142,10 @@ static int __devexit stm_nand_bch_remove(struct platform_device *pdev)
 		del_mtd_device(&info->mtd);
 	}
 
+	dma_unmap_single(NULL, nandi->buf_list_phys,
+			 NANDI_BCH_READ_QUEUE * NANDI_BCH_BUF_LIST_SLOT,
+			 DMA_TO_DEVICE);
+
 	nandi_exit_controller(nandi);
 
 	return 0;
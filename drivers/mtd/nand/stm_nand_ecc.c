@@ -22,6 +22,10 @@
 #include <linux/types.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/random.h>
 #include "stm_nand_ecc.h"
 
 static const uint8_t byte_parity_table[] =   /* Parity look up table */
@@ -564,6 +568,76 @@ unsigned char stm_afm_lp1617(const unsigned char *buf)
 }
 EXPORT_SYMBOL_GPL(stm_afm_lp1617);
 
+/*
+ * Count the bits at '0' in 'buf', giving up as soon as there are more than
+ * 'max_zeros' of them.  Returns the count, or '-1' if 'max_zeros' is exceeded.
+ *
+ * Erased data is mostly 0xff, so the bulk of the buffer is tested a few words
+ * at a time, and only words with bits at '0' are counted.
+ */
+int stmnand_count_zero_bits(const uint8_t *buf, int len, int max_zeros)
+{
+	const unsigned long *w;
+	int zeros = 0;
+
+	/* Unaligned head */
+	for (; len > 0 && ((unsigned long)buf & (sizeof(long) - 1)); len--) {
+		zeros += hweight8(~*buf++ & 0xff);
+		if (zeros > max_zeros)
+			return -1;
+	}
+
+	w = (const unsigned long *)buf;
+
+	/* Skip blocks of erased words */
+	for (; len >= 4 * sizeof(long); len -= 4 * sizeof(long), w += 4) {
+		if ((w[0] & w[1] & w[2] & w[3]) == ~0UL)
+			continue;
+		zeros += hweight_long(~w[0]) + hweight_long(~w[1]) +
+			hweight_long(~w[2]) + hweight_long(~w[3]);
+		if (zeros > max_zeros)
+			return -1;
+	}
+
+	for (; len >= sizeof(long); len -= sizeof(long), w++) {
+		zeros += hweight_long(~*w);
+		if (zeros > max_zeros)
+			return -1;
+	}
+
+	/* Tail */
+	buf = (const uint8_t *)w;
+	for (; len > 0; len--) {
+		zeros += hweight8(~*buf++ & 0xff);
+		if (zeros > max_zeros)
+			return -1;
+	}
+
+	return zeros;
+}
+EXPORT_SYMBOL_GPL(stmnand_count_zero_bits);
+
+/*
+ * Detect erased data, tolerating and correcting up to 'max_zeros' bits at '0'.
+ * (For many devices, it is now deemed within spec for an erased page to include
+ * a number of bits at '0', either as a result of read-disturb behaviour or
+ * 'stuck-at-zero' failures.)  Returns the number of corrected bits, or '-1' if
+ * there are more bits at '0' (likely to be a genuine uncorrectable ECC error).
+ * In the latter case, the data is left unmodified, in accordance with the MTD
+ * API.
+ */
+int stmnand_check_erased(uint8_t *buf, int len, int max_zeros)
+{
+	int zeros;
+
+	zeros = stmnand_count_zero_bits(buf, len, max_zeros);
+	if (zeros > 0)
+		memset(buf, 0xff, len);
+
+	return zeros;
+}
+EXPORT_SYMBOL_GPL(stmnand_check_erased);
+
 /* Test for empty/erased page (ST Hamming Controller ECC schemes) */
 int stmnand_test_empty_page(uint8_t *ecc_stored, uint8_t *ecc_calc,
 			    int eccsteps, int eccbytes,
@@ -586,23 +660,107 @@ int stmnand_test_empty_page(uint8_t *ecc_stored, uint8_t *ecc_calc,
 	}
 
 	/* Check page area is emtpy */
-	while (pagesize--) {
-		e += hweight8(~*buf++);
-		if (e > max_bit_errors)
-			return 0;
-	}
+	e = stmnand_count_zero_bits(buf, pagesize, max_bit_errors);
+	if (e < 0)
+		return 0;
 
 	/* Check OOB area is emtpy */
-	while (oobsize--) {
-		e += hweight8(~*oob++);
-		if (e > max_bit_errors)
-			return 0;
-	}
+	if (oobsize &&
+	    stmnand_count_zero_bits(oob, oobsize, max_bit_errors - e) < 0)
+		return 0;
 
 	return 1;
 }
 EXPORT_SYMBOL_GPL(stmnand_test_empty_page);
 
+#ifdef CONFIG_STM_NAND_ECC_SELFTEST
+/* Reference implementation: byte by byte, no early exit */
+static int __init selftest_count_zeros(const uint8_t *buf, int len)
+{
+	int zeros = 0;
+
+	while (len--)
+		zeros += hweight8(~*buf++ & 0xff);
+
+	return zeros;
+}
+
+static int __init selftest_one(uint8_t *buf, int offs, int len, int flips)
+{
+	int i, ref, zeros;
+
+	memset(buf, 0xff, offs + len + sizeof(long));
+	for (i = 0; i < flips; i++) {
+		int bit = random32() % (len * 8);
+
+		buf[offs + bit / 8] &= ~(1 << (bit % 8));
+	}
+	ref = selftest_count_zeros(buf + offs, len);
+
+	/* Exact count, and the limit either side of it */
+	zeros = stmnand_count_zero_bits(buf + offs, len, ref);
+	if (zeros != ref)
+		goto fail;
+	if (ref && stmnand_count_zero_bits(buf + offs, len, ref - 1) != -1)
+		goto fail;
+
+	/* Bytes either side of the buffer must not be counted */
+	if (buf[offs + len] != 0xff || (offs && buf[offs - 1] != 0xff))
+		goto fail;
+
+	/* Corrected data is all 0xff, and uncorrectable data is untouched */
+	if (ref && stmnand_check_erased(buf + offs, len, ref - 1) != -1)
+		goto fail;
+	if (selftest_count_zeros(buf + offs, len) != ref)
+		goto fail;
+	if (stmnand_check_erased(buf + offs, len, ref) != ref)
+		goto fail;
+	if (selftest_count_zeros(buf + offs, len) != 0)
+		goto fail;
+
+	return 0;
+
+fail:
+	printk(KERN_ERR "stm_nand_ecc: erased check self-test failed: "
+	       "offs %d, len %d, flips %d, expected %d, got %d\n",
+	       offs, len, flips, ref, zeros);
+	return -EINVAL;
+}
+
+static int __init stmnand_ecc_selftest(void)
+{
+	static const int lens[] = {1, 3, 16, 31, 128, 512, 2048, 4096 + 224};
+	static const int flips[] = {0, 1, 2, 8, 64};
+	uint8_t *buf;
+	int i, j, offs;
+	int err = 0;
+
+	buf = kmalloc(4096 + 224 + 2 * sizeof(long), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(lens) && !err; i++)
+		for (j = 0; j < ARRAY_SIZE(flips) && !err; j++)
+			for (offs = 0; offs < sizeof(long) && !err; offs++)
+				err = selftest_one(buf, offs, lens[i],
+						   flips[j]);
+
+	kfree(buf);
+
+	if (!err)
+		printk(KERN_INFO "stm_nand_ecc: erased check self-test "
+		       "passed\n");
+
+	return err;
+}
+module_init(stmnand_ecc_selftest);
+
+static void __exit stmnand_ecc_selftest_exit(void)
+{
+}
+module_exit(stmnand_ecc_selftest_exit);
+#endif /* CONFIG_STM_NAND_ECC_SELFTEST */
+
 
 /*****************************************************************************/
 
@@ -147,6 +147,15 @@ enum ecc_check stm_ecc_correct(uint8_t *p_data,
 
 unsigned char stm_afm_lp1617(const unsigned char *buf);
 
+/* Count bits at '0' in 'buf', giving up (returning -1) beyond 'max_zeros'.
+ */
+int stmnand_count_zero_bits(const uint8_t *buf, int len, int max_zeros);
+
+/* Detect erased data, correcting up to 'max_zeros' bits at '0' to '1'.
+   Returns the number of corrected bits, or -1 (data unmodified).
+ */
+int stmnand_check_erased(uint8_t *buf, int len, int max_zeros);
+
 int stmnand_test_empty_page(uint8_t *ecc_stored, uint8_t *ecc_calc,
 			    int eccsteps, int eccbytes,
 			    uint8_t *buf, uint8_t *oob,
@@ -457,6 +457,14 @@ int boot_correct_ecc(struct mtd_info *mtd, unsigned char *buf,
 {
 	int status;
 
+	/* No ECC was written, check that the data is erased too */
+	if (read_ecc[0] == 0xff && read_ecc[1] == 0xff &&
+	    read_ecc[2] == 0xff && read_ecc[3] == 0xff) {
+		status = stmnand_check_erased(buf, ECC_128, 1);
+		if (status >= 0)
+			return status;
+	}
+
 	status = stm_ecc_correct(buf, read_ecc, calc_ecc, ECC_128);
 
 	/* convert to MTD-compatible status */
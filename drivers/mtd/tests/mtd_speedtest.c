@@ -88,6 +88,33 @@ static int erase_eraseblock(int ebnum)
 	return 0;
 }
 
+static int multiblock_erase(int ebnum, int blocks)
+{
+	int err;
+	struct erase_info ei;
+	loff_t addr = ebnum * mtd->erasesize;
+
+	memset(&ei, 0, sizeof(struct erase_info));
+	ei.mtd  = mtd;
+	ei.addr = addr;
+	ei.len  = mtd->erasesize * blocks;
+
+	err = mtd->erase(mtd, &ei);
+	if (err) {
+		printk(PRINT_PREF "error %d while erasing EB %d, blocks %d\n",
+		       err, ebnum, blocks);
+		return err;
+	}
+
+	if (ei.state == MTD_ERASE_FAILED) {
+		printk(PRINT_PREF "some erase error occurred at EB %d, "
+		       "blocks %d\n", ebnum, blocks);
+		return -EIO;
+	}
+
+	return 0;
+}
+
 static int erase_whole_device(void)
 {
 	int err;
@@ -290,6 +317,19 @@ static long calc_speed(void)
 	return speed;
 }
 
+/*
+ * Report how much faster a multi-page or multi-block operation is than the
+ * page by page or block by block one. This is what cache and multi-plane
+ * operations of the flash gain.
+ */
+static void print_gain(const char *what, long speed, long base)
+{
+	if (base <= 0)
+		return;
+	printk(PRINT_PREF "%s gain is %ld%%\n", what,
+	       (speed - base) * 100 / base);
+}
+
 static int scan_for_bad_eraseblocks(void)
 {
 	int i, bad = 0;
@@ -320,8 +360,8 @@ out:
 
 static int __init mtd_speedtest_init(void)
 {
-	int err, i;
-	long speed;
+	int err, i, blocks, j, k;
+	long speed, ebwrite_speed, ebread_speed, erase_speed;
 	uint64_t tmp;
 
 	printk(KERN_INFO "\n");
@@ -385,6 +425,7 @@ static int __init mtd_speedtest_init(void)
 	stop_timing();
 	speed = calc_speed();
 	printk(PRINT_PREF "eraseblock write speed is %ld KiB/s\n", speed);
+	ebwrite_speed = speed;
 
 	/* Read all eraseblocks, 1 eraseblock at a time */
 	printk(PRINT_PREF "testing eraseblock read speed\n");
@@ -400,6 +441,7 @@ static int __init mtd_speedtest_init(void)
 	stop_timing();
 	speed = calc_speed();
 	printk(PRINT_PREF "eraseblock read speed is %ld KiB/s\n", speed);
+	ebread_speed = speed;
 
 	err = erase_whole_device();
 	if (err)
@@ -419,6 +461,7 @@ static int __init mtd_speedtest_init(void)
 	stop_timing();
 	speed = calc_speed();
 	printk(PRINT_PREF "page write speed is %ld KiB/s\n", speed);
+	print_gain("eraseblock write", ebwrite_speed, speed);
 
 	/* Read all eraseblocks, 1 page at a time */
 	printk(PRINT_PREF "testing page read speed\n");
@@ -434,6 +477,7 @@ static int __init mtd_speedtest_init(void)
 	stop_timing();
 	speed = calc_speed();
 	printk(PRINT_PREF "page read speed is %ld KiB/s\n", speed);
+	print_gain("eraseblock read", ebread_speed, speed);
 
 	err = erase_whole_device();
 	if (err)
@@ -483,6 +527,35 @@ static int __init mtd_speedtest_init(void)
 	stop_timing();
 	speed = calc_speed();
 	printk(PRINT_PREF "erase speed is %ld KiB/s\n", speed);
+	erase_speed = speed;
+
+	/* Multi-block erase all eraseblocks */
+	for (k = 1; k < 7; k++) {
+		blocks = 1 << k;
+		printk(PRINT_PREF "Testing %dx multi-block erase speed\n",
+		       blocks);
+		start_timing();
+		for (i = 0; i < ebcnt; ) {
+			for (j = 0; j < blocks && (i + j) < ebcnt; j++)
+				if (bbt[i + j])
+					break;
+			if (j < 1) {
+				i++;
+				continue;
+			}
+			err = multiblock_erase(i, j);
+			if (err)
+				goto out;
+			cond_resched();
+			i += j;
+		}
+		stop_timing();
+		speed = calc_speed();
+		printk(PRINT_PREF "%dx multi-block erase speed is %ld KiB/s\n",
+		       blocks, speed);
+		if (k == 1)
+			print_gain("2x multi-block erase", speed, erase_speed);
+	}
 
 	printk(PRINT_PREF "finished\n");
 out:
@@ -98,6 +98,9 @@ static struct class_attribute ubi_version =
 
 static ssize_t dev_attribute_show(struct device *dev,
 				  struct device_attribute *attr, char *buf);
+static ssize_t dev_attribute_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count);
 
 /* UBI device attributes (correspond to files in '/<sysfs>/class/ubi/ubiX') */
 static struct device_attribute dev_eraseblock_size =
@@ -122,6 +125,15 @@ static struct device_attribute dev_bgt_enabled =
 	__ATTR(bgt_enabled, S_IRUGO, dev_attribute_show, NULL);
 static struct device_attribute dev_mtd_num =
 	__ATTR(mtd_num, S_IRUGO, dev_attribute_show, NULL);
+static struct device_attribute dev_erased_pool =
+	__ATTR(erased_pool, S_IRUGO | S_IWUSR, dev_attribute_show,
+	       dev_attribute_store);
+static struct device_attribute dev_write_stalls =
+	__ATTR(write_stalls, S_IRUGO, dev_attribute_show, NULL);
+static struct device_attribute dev_write_stall_time =
+	__ATTR(write_stall_time, S_IRUGO, dev_attribute_show, NULL);
+static struct device_attribute dev_write_stall_max =
+	__ATTR(write_stall_max, S_IRUGO, dev_attribute_show, NULL);
 
 /**
  * ubi_volume_notify - send a volume change notification.
@@ -346,6 +358,19 @@ static ssize_t dev_attribute_show(struct device *dev,
 		ret = sprintf(buf, "%d\n", ubi->thread_enabled);
 	else if (attr == &dev_mtd_num)
 		ret = sprintf(buf, "%d\n", ubi->mtd->index);
+	else if (attr == &dev_erased_pool)
+		ret = sprintf(buf, "%d\n", ubi->erased_pool);
+	else if (attr == &dev_write_stalls)
+		ret = sprintf(buf, "%u\n", ubi->stall_count);
+	else if (attr == &dev_write_stall_time) {
+		unsigned long long stall_time;
+
+		spin_lock(&ubi->wl_lock);
+		stall_time = ubi->stall_time;
+		spin_unlock(&ubi->wl_lock);
+		ret = sprintf(buf, "%llu\n", stall_time);
+	} else if (attr == &dev_write_stall_max)
+		ret = sprintf(buf, "%u\n", ubi->stall_max);
 	else
 		ret = -EINVAL;
 
@@ -353,6 +378,35 @@ static ssize_t dev_attribute_show(struct device *dev,
 	return ret;
 }
 
+/* "Store" method for writable files in '/<sysfs>/class/ubi/ubiX/' */
+static ssize_t dev_attribute_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	ssize_t ret = count;
+	unsigned long val;
+	struct ubi_device *ubi;
+
+	ubi = container_of(dev, struct ubi_device, dev);
+	ubi = ubi_get_device(ubi->ubi_num);
+	if (!ubi)
+		return -ENODEV;
+
+	if (attr == &dev_erased_pool) {
+		if (strict_strtoul(buf, 0, &val) || val > ubi->peb_count)
+			ret = -EINVAL;
+		else {
+			spin_lock(&ubi->wl_lock);
+			ubi->erased_pool = val;
+			spin_unlock(&ubi->wl_lock);
+		}
+	} else
+		ret = -EINVAL;
+
+	ubi_put_device(ubi);
+	return ret;
+}
+
 static void dev_release(struct device *dev)
 {
 	struct ubi_device *ubi = container_of(dev, struct ubi_device, dev);
@@ -410,6 +464,18 @@ static int ubi_sysfs_init(struct ubi_device *ubi)
 	if (err)
 		return err;
 	err = device_create_file(&ubi->dev, &dev_mtd_num);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_erased_pool);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_write_stalls);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_write_stall_time);
+	if (err)
+		return err;
+	err = device_create_file(&ubi->dev, &dev_write_stall_max);
 	return err;
 }
 
@@ -419,6 +485,10 @@ static int ubi_sysfs_init(struct ubi_device *ubi)
  */
 static void ubi_sysfs_close(struct ubi_device *ubi)
 {
+	device_remove_file(&ubi->dev, &dev_write_stall_max);
+	device_remove_file(&ubi->dev, &dev_write_stall_time);
+	device_remove_file(&ubi->dev, &dev_write_stalls);
+	device_remove_file(&ubi->dev, &dev_erased_pool);
 	device_remove_file(&ubi->dev, &dev_mtd_num);
 	device_remove_file(&ubi->dev, &dev_bgt_enabled);
 	device_remove_file(&ubi->dev, &dev_min_io_size);
@@ -853,6 +923,7 @@ static int ubi_reboot_notifier(struct notifier_block *n, unsigned long state,
 	ubi = container_of(n, struct ubi_device, reboot_notifier);
 	if (ubi->bgt_thread)
 		kthread_stop(ubi->bgt_thread);
+	ubi_cp_write(ubi);
 	ubi_sync(ubi->ubi_num);
 	return NOTIFY_DONE;
 }
@@ -939,6 +1010,9 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	mutex_init(&ubi->buf_mutex);
 	mutex_init(&ubi->ckvol_mutex);
 	mutex_init(&ubi->device_mutex);
+	mutex_init(&ubi->cp_mutex);
+	mutex_init(&ubi->cp_inval_mutex);
+	init_rwsem(&ubi->cp_sem);
 	spin_lock_init(&ubi->volumes_lock);
 
 	ubi_msg("attaching mtd%d to ubi%d", mtd->index, ubi_num);
@@ -969,12 +1043,22 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 		goto out_free;
 	}
 
+	err = ubi_cp_init(ubi);
+	if (err)
+		goto out_detach;
+
 	if (ubi->autoresize_vol_id != -1) {
 		err = autoresize(ubi, ubi->autoresize_vol_id);
 		if (err)
 			goto out_detach;
 	}
 
+	/*
+	 * Write a checkpoint right away - the one the device was attached
+	 * from, if any, has already been erased.
+	 */
+	ubi_cp_write(ubi);
+
 	err = uif_init(ubi);
 	if (err)
 		goto out_nofree;
@@ -1029,6 +1113,7 @@ out_nofree:
 	do_free = 0;
 out_detach:
 	ubi_wl_close(ubi);
+	ubi_cp_close(ubi);
 	if (do_free)
 		free_user_volumes(ubi);
 	free_internal_volumes(ubi);
@@ -1094,6 +1179,9 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 	if (ubi->bgt_thread)
 		kthread_stop(ubi->bgt_thread);
 
+	/* Save the state of the device to make the next attach fast */
+	ubi_cp_write(ubi);
+
 	/*
 	 * Get a reference to the device in order to prevent 'dev_release()'
 	 * from freeing @ubi object.
@@ -1102,6 +1190,7 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 
 	uif_close(ubi);
 	ubi_wl_close(ubi);
+	ubi_cp_close(ubi);
 	free_internal_volumes(ubi);
 	vfree(ubi->vtbl);
 	put_mtd_device(ubi->mtd);
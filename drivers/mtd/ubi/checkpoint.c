@@ -0,0 +1,648 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * UBI checkpoint (fast attach).
+ *
+ * Attaching an MTD device by scanning means reading the EC and VID headers of
+ * every physical eraseblock, which takes time proportional to the flash size.
+ * A checkpoint is a snapshot of the eraseblock association table of dynamic
+ * volumes and of the erase counters, stored in the only logical eraseblock of
+ * the checkpoint volume (%UBI_CP_VOLUME_ID). When attaching, the first
+ * %UBI_CP_MAX_START physical eraseblocks are looked at, and if a valid
+ * checkpoint is found there, only the physical eraseblocks it does not
+ * describe are scanned. The on-flash format is described in ubi-media.h.
+ *
+ * For this to work, the flash has to stay describable by the checkpoint: when
+ * it is written, a pool of free physical eraseblocks is left out of it (they
+ * are scanned when attaching), and until the next checkpoint the WL sub-system
+ * only hands out physical eraseblocks from the pool and defers erasure of the
+ * physical eraseblocks the checkpoint records as used (see wl.c). The EBA
+ * sub-system holds @ubi->cp_sem in read mode while it changes the eraseblock
+ * association, so a checkpoint is written while nothing changes.
+ *
+ * A new checkpoint is written by the background thread when the pool runs
+ * low or many erasures are deferred, by 'ubi_wl_flush()' so that unmapped
+ * logical eraseblocks stay unmapped, and when the device is detached. If the
+ * pool is exhausted before, or writing fails, the checkpoint is dropped by
+ * erasing it, and the next attach scans the whole flash. A checkpoint is only
+ * used if it is the newest one on the flash and it is consistent, otherwise
+ * the flash is scanned, and checkpoints found when scanning are erased.
+ *
+ * Checkpoints are erased right after they have been used to attach, so
+ * nothing written before the new checkpoint is written can make them stale.
+ */
+
+#include <linux/crc32.h>
+#include <linux/vmalloc.h>
+#include "ubi.h"
+
+/* Number of physical eraseblocks reserved for the checkpoint */
+#define CP_RESERVED_PEBS 1
+
+/* Bounds of the size of the pool of physical eraseblocks */
+#define CP_MIN_POOL 8
+#define CP_MAX_POOL 256
+
+/**
+ * cp_fixed_size - size of the part of the checkpoint not depending on volumes.
+ * @ubi: UBI device description object
+ */
+static int cp_fixed_size(const struct ubi_device *ubi)
+{
+	return UBI_CP_HDR_SIZE + ALIGN(ubi->peb_count, 4) +
+	       ubi->peb_count * sizeof(__be32);
+}
+
+/**
+ * find_anchor - find the newest checkpoint.
+ * @ubi: UBI device description object
+ * @vid_hdr: VID header buffer to use
+ * @anchors: bitmap of physical eraseblocks holding checkpoints, filled
+ * @sqnum: sequence number of the newest checkpoint is returned here
+ *
+ * This function returns the physical eraseblock holding the newest
+ * checkpoint, %-1 if there is none, or a negative error code in case of
+ * failure.
+ */
+static int find_anchor(struct ubi_device *ubi, struct ubi_vid_hdr *vid_hdr,
+		       unsigned long *anchors, unsigned long long *sqnum)
+{
+	int err, pnum, anchor = -1;
+
+	for (pnum = 0; pnum < UBI_CP_MAX_START && pnum < ubi->peb_count;
+	     pnum++) {
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			return err;
+		if (err)
+			continue;
+
+		err = ubi_io_read_vid_hdr(ubi, pnum, vid_hdr, 0);
+		if (err < 0)
+			return err;
+		if (err && err != UBI_IO_BITFLIPS)
+			continue;
+		if (be32_to_cpu(vid_hdr->vol_id) != UBI_CP_VOLUME_ID)
+			continue;
+
+		__set_bit(pnum, anchors);
+		if (anchor == -1 || be64_to_cpu(vid_hdr->sqnum) > *sqnum) {
+			anchor = pnum;
+			*sqnum = be64_to_cpu(vid_hdr->sqnum);
+		}
+	}
+
+	return anchor;
+}
+
+/**
+ * read_cp - read and check the checkpoint.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock holding the checkpoint
+ * @sqnum: sequence number from the VID header of @pnum
+ * @buf: buffer of logical eraseblock size to read to
+ *
+ * This function returns zero if the checkpoint has been read and its headers
+ * and checksums are correct, and %1 if not.
+ */
+static int read_cp(struct ubi_device *ubi, int pnum, unsigned long long sqnum,
+		   void *buf)
+{
+	int err, size;
+	uint32_t crc;
+	struct ubi_cp_hdr *cph = buf;
+
+	err = ubi_io_read_data(ubi, buf, pnum, 0, UBI_CP_HDR_SIZE);
+	if (err && err != UBI_IO_BITFLIPS) {
+		ubi_warn("cannot read checkpoint header from PEB %d, error %d",
+			 pnum, err);
+		return 1;
+	}
+
+	crc = crc32(UBI_CRC32_INIT, cph, UBI_CP_HDR_SIZE_CRC);
+	if (be32_to_cpu(cph->magic) != UBI_CP_HDR_MAGIC ||
+	    be32_to_cpu(cph->hdr_crc) != crc) {
+		ubi_warn("bad checkpoint header at PEB %d", pnum);
+		return 1;
+	}
+
+	if (cph->version != UBI_CP_FORMAT_VERSION) {
+		ubi_warn("checkpoint format version %d is not supported",
+			 cph->version);
+		return 1;
+	}
+
+	size = be32_to_cpu(cph->data_size);
+	if (be64_to_cpu(cph->sqnum) != sqnum ||
+	    be32_to_cpu(cph->peb_count) != ubi->peb_count ||
+	    size < cp_fixed_size(ubi) - UBI_CP_HDR_SIZE ||
+	    size > ubi->leb_size - UBI_CP_HDR_SIZE) {
+		ubi_warn("checkpoint at PEB %d does not match the device",
+			 pnum);
+		return 1;
+	}
+
+	err = ubi_io_read_data(ubi, buf + UBI_CP_HDR_SIZE, pnum,
+			       UBI_CP_HDR_SIZE, size);
+	if (err && err != UBI_IO_BITFLIPS) {
+		ubi_warn("cannot read checkpoint from PEB %d, error %d",
+			 pnum, err);
+		return 1;
+	}
+
+	crc = crc32(UBI_CRC32_INIT, buf + UBI_CP_HDR_SIZE, size);
+	if (be32_to_cpu(cph->data_crc) != crc) {
+		ubi_warn("bad checkpoint data CRC at PEB %d", pnum);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * check_cp - check the consistency of the checkpoint.
+ * @ubi: UBI device description object
+ * @buf: the checkpoint
+ * @anchors: bitmap of physical eraseblocks holding checkpoints
+ * @used_map: bitmap of physical eraseblocks referred to by volume records,
+ *            filled
+ *
+ * This function returns zero if the checkpoint is consistent and %1 if not.
+ */
+static int check_cp(const struct ubi_device *ubi, const void *buf,
+		    const unsigned long *anchors, unsigned long *used_map)
+{
+	int i, pnum, lnum, vol_id, prev_id = -1;
+	const struct ubi_cp_hdr *cph = buf;
+	const uint8_t *state = buf + UBI_CP_HDR_SIZE;
+	const __be32 *ec = (void *)state + ALIGN(ubi->peb_count, 4);
+	const void *p = ec + ubi->peb_count;
+	const void *end = buf + UBI_CP_HDR_SIZE + be32_to_cpu(cph->data_size);
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (state[pnum] > UBI_CP_PEB_ERASE) {
+			dbg_bld("bad state %d of PEB %d", state[pnum], pnum);
+			return 1;
+		}
+		if (state[pnum] != UBI_CP_PEB_SCAN &&
+		    be32_to_cpu(ec[pnum]) > UBI_MAX_ERASECOUNTER) {
+			dbg_bld("bad EC of PEB %d", pnum);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < be32_to_cpu(cph->vol_count); i++) {
+		const struct ubi_cp_vol *cpv = p;
+		const __be32 *pnums = p + sizeof(struct ubi_cp_vol);
+		int reserved_pebs, data_pad;
+
+		if (p + sizeof(struct ubi_cp_vol) > end)
+			goto bad;
+
+		vol_id = be32_to_cpu(cpv->vol_id);
+		reserved_pebs = be32_to_cpu(cpv->reserved_pebs);
+		data_pad = be32_to_cpu(cpv->data_pad);
+		if (vol_id <= prev_id || vol_id < 0 ||
+		    (vol_id >= UBI_MAX_VOLUMES && vol_id != UBI_LAYOUT_VOLUME_ID) ||
+		    reserved_pebs < 0 || reserved_pebs > ubi->peb_count ||
+		    data_pad < 0 || data_pad >= ubi->leb_size)
+			goto bad;
+		prev_id = vol_id;
+
+		p += sizeof(struct ubi_cp_vol) + reserved_pebs * sizeof(__be32);
+		if (p > end)
+			goto bad;
+
+		for (lnum = 0; lnum < reserved_pebs; lnum++) {
+			if (be32_to_cpu(pnums[lnum]) == UBI_CP_UNMAPPED)
+				continue;
+
+			pnum = be32_to_cpu(pnums[lnum]);
+			if (pnum < 0 || pnum >= ubi->peb_count ||
+			    state[pnum] != UBI_CP_PEB_USED ||
+			    (pnum < UBI_CP_MAX_START &&
+			     test_bit(pnum, anchors)) ||
+			    test_and_set_bit(pnum, used_map)) {
+				dbg_bld("bad PEB %d of LEB %d:%d",
+					pnum, vol_id, lnum);
+				return 1;
+			}
+		}
+	}
+
+	if (p != end)
+		goto bad;
+
+	return 0;
+
+bad:
+	dbg_bld("bad volume record %d", i);
+	return 1;
+}
+
+/**
+ * fill_si - build scanning information from the checkpoint.
+ * @ubi: UBI device description object
+ * @si: scanning information to fill
+ * @buf: the checkpoint
+ * @anchors: bitmap of physical eraseblocks holding checkpoints
+ * @used_map: bitmap of physical eraseblocks referred to by volume records
+ * @scan_map: bitmap of physical eraseblocks which have to be scanned, filled
+ *
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+static int fill_si(struct ubi_device *ubi, struct ubi_scan_info *si,
+		   const void *buf, const unsigned long *anchors,
+		   const unsigned long *used_map, unsigned long *scan_map)
+{
+	int err, i, pnum, lnum, ec;
+	const struct ubi_cp_hdr *cph = buf;
+	const uint8_t *state = buf + UBI_CP_HDR_SIZE;
+	const __be32 *ecs = (void *)state + ALIGN(ubi->peb_count, 4);
+	const void *p = ecs + ubi->peb_count;
+	struct ubi_vid_hdr *vid_hdr;
+
+	/* Needed for the EC headers of the checkpoints erased below */
+	ubi->image_seq = be32_to_cpu(cph->image_seq);
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		struct list_head *list;
+
+		ec = be32_to_cpu(ecs[pnum]);
+		if (state[pnum] != UBI_CP_PEB_SCAN && pnum < UBI_CP_MAX_START &&
+		    test_bit(pnum, anchors)) {
+			/* Checkpoints, including this one, are erased at once */
+			err = ubi_scan_erase_cp(ubi, si, pnum, ec);
+			if (err)
+				return err;
+			goto account;
+		}
+
+		switch (state[pnum]) {
+		case UBI_CP_PEB_FREE:
+			list = &si->free;
+			break;
+		case UBI_CP_PEB_ERASE:
+			list = &si->erase;
+			break;
+		case UBI_CP_PEB_USED:
+			if (test_bit(pnum, used_map))
+				goto account;
+			/* Fall through */
+		default:
+			__set_bit(pnum, scan_map);
+			continue;
+		}
+
+		err = ubi_scan_add_to_list(si, pnum, ec, list);
+		if (err)
+			return err;
+account:
+		si->ec_sum += ec;
+		si->ec_count += 1;
+		if (ec > si->max_ec)
+			si->max_ec = ec;
+		if (ec < si->min_ec)
+			si->min_ec = ec;
+	}
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vid_hdr)
+		return -ENOMEM;
+
+	/*
+	 * Feed the mapped logical eraseblocks to the scanning code as if
+	 * their VID headers had been read. They all get the sequence number
+	 * of the checkpoint, which is lower than the one of anything written
+	 * later.
+	 */
+	vid_hdr->vol_type = UBI_VID_DYNAMIC;
+	vid_hdr->sqnum = cph->sqnum;
+	for (i = 0; i < be32_to_cpu(cph->vol_count); i++) {
+		const struct ubi_cp_vol *cpv = p;
+		const __be32 *pnums = p + sizeof(struct ubi_cp_vol);
+		int vol_id = be32_to_cpu(cpv->vol_id);
+		int reserved_pebs = be32_to_cpu(cpv->reserved_pebs);
+
+		vid_hdr->vol_id = cpv->vol_id;
+		vid_hdr->data_pad = cpv->data_pad;
+		if (vol_id == UBI_LAYOUT_VOLUME_ID)
+			vid_hdr->compat = UBI_LAYOUT_VOLUME_COMPAT;
+		else
+			vid_hdr->compat = 0;
+
+		for (lnum = 0; lnum < reserved_pebs; lnum++) {
+			if (be32_to_cpu(pnums[lnum]) == UBI_CP_UNMAPPED)
+				continue;
+
+			pnum = be32_to_cpu(pnums[lnum]);
+			vid_hdr->lnum = cpu_to_be32(lnum);
+			err = ubi_scan_add_used(ubi, si, pnum,
+						be32_to_cpu(ecs[pnum]),
+						vid_hdr, 0);
+			if (err)
+				goto out_free;
+		}
+
+		p += sizeof(struct ubi_cp_vol) + reserved_pebs * sizeof(__be32);
+	}
+
+	si->is_empty = 0;
+	err = 0;
+
+out_free:
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return err;
+}
+
+/**
+ * ubi_cp_scan - attach using the checkpoint.
+ * @ubi: UBI device description object
+ * @si: scanning information to fill
+ * @scan_map: bitmap of physical eraseblocks which have to be scanned, filled
+ *
+ * This function looks for a checkpoint and builds the scanning information
+ * from it. The physical eraseblocks the checkpoint does not describe are
+ * marked in @scan_map and have to be scanned by the caller. Returns zero in
+ * case of success, %1 if there is no usable checkpoint, in which case @si is
+ * left untouched and the whole flash has to be scanned, and a negative error
+ * code in case of failure.
+ */
+int ubi_cp_scan(struct ubi_device *ubi, struct ubi_scan_info *si,
+		unsigned long *scan_map)
+{
+	int err, anchor;
+	unsigned long long sqnum = 0;
+	unsigned long *used_map = NULL;
+	DECLARE_BITMAP(anchors, UBI_CP_MAX_START);
+	struct ubi_vid_hdr *vid_hdr;
+	void *buf = NULL;
+
+	if (cp_fixed_size(ubi) > ubi->leb_size)
+		return 1;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vid_hdr)
+		return -ENOMEM;
+
+	bitmap_zero(anchors, UBI_CP_MAX_START);
+	anchor = find_anchor(ubi, vid_hdr, anchors, &sqnum);
+	if (anchor < 0) {
+		err = anchor == -1 ? 1 : anchor;
+		if (err == 1)
+			dbg_bld("no checkpoint found");
+		goto out_free;
+	}
+
+	err = -ENOMEM;
+	buf = vmalloc(ubi->leb_size);
+	if (!buf)
+		goto out_free;
+
+	used_map = kcalloc(BITS_TO_LONGS(ubi->peb_count),
+			   sizeof(unsigned long), GFP_KERNEL);
+	if (!used_map)
+		goto out_free;
+
+	err = read_cp(ubi, anchor, sqnum, buf);
+	if (err)
+		goto out_free;
+
+	err = check_cp(ubi, buf, anchors, used_map);
+	if (err) {
+		ubi_warn("inconsistent checkpoint at PEB %d", anchor);
+		goto out_free;
+	}
+
+	ubi_msg("checkpoint found at PEB %d, sqnum %llu", anchor, sqnum);
+	err = fill_si(ubi, si, buf, anchors, used_map, scan_map);
+
+out_free:
+	if (err > 0)
+		ubi_msg("scanning the whole flash");
+	kfree(used_map);
+	vfree(buf);
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return err;
+}
+
+/**
+ * fill_volumes - record the eraseblock association of dynamic volumes.
+ * @ubi: UBI device description object
+ * @p: where to put the volume records
+ * @end: end of the buffer
+ * @vol_count: count of volume records is returned here
+ *
+ * This function returns the size of the volume records in case of success
+ * and %-ENOSPC if they do not fit.
+ */
+static int fill_volumes(struct ubi_device *ubi, void *p, const void *end,
+			int *vol_count)
+{
+	int i, lnum, size, len = 0;
+	struct ubi_volume *vol;
+	struct ubi_cp_vol *cpv;
+	__be32 *pnums;
+
+	*vol_count = 0;
+	spin_lock(&ubi->volumes_lock);
+	for (i = 0; i < ubi->vtbl_slots + UBI_INT_VOL_COUNT; i++) {
+		vol = ubi->volumes[i];
+		if (!vol || vol->vol_type != UBI_DYNAMIC_VOLUME)
+			continue;
+
+		size = sizeof(struct ubi_cp_vol) +
+		       vol->reserved_pebs * sizeof(__be32);
+		if (p + size > end) {
+			spin_unlock(&ubi->volumes_lock);
+			return -ENOSPC;
+		}
+
+		cpv = p;
+		cpv->vol_id = cpu_to_be32(vol->vol_id);
+		cpv->reserved_pebs = cpu_to_be32(vol->reserved_pebs);
+		cpv->data_pad = cpu_to_be32(vol->data_pad);
+		pnums = p + sizeof(struct ubi_cp_vol);
+		for (lnum = 0; lnum < vol->reserved_pebs; lnum++)
+			if (vol->eba_tbl[lnum] >= 0)
+				pnums[lnum] = cpu_to_be32(vol->eba_tbl[lnum]);
+			else
+				pnums[lnum] = cpu_to_be32(UBI_CP_UNMAPPED);
+
+		p += size;
+		len += size;
+		*vol_count += 1;
+	}
+	spin_unlock(&ubi->volumes_lock);
+
+	return len;
+}
+
+/**
+ * ubi_cp_write - write a new checkpoint.
+ * @ubi: UBI device description object
+ *
+ * This function writes a checkpoint describing the current state of the
+ * flash and makes it the current one. If this fails, the current checkpoint
+ * is dropped. Returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+int ubi_cp_write(struct ubi_device *ubi)
+{
+	int err, len, vol_count;
+	void *buf;
+	uint8_t *state;
+	__be32 *ec;
+	struct ubi_cp_hdr *cph;
+	struct ubi_vid_hdr *vid_hdr;
+	struct ubi_wl_entry *anchor = NULL;
+
+	spin_lock(&ubi->wl_lock);
+	ubi->cp_needed = 0;
+	spin_unlock(&ubi->wl_lock);
+
+	if (ubi->cp_disabled || ubi->ro_mode)
+		return 0;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
+	if (!vid_hdr) {
+		ubi_wl_cp_done(ubi, NULL, NULL, -ENOMEM);
+		return -ENOMEM;
+	}
+
+	/*
+	 * Stop the EBA sub-system and the WL works, then nobody else may be
+	 * using @ubi->peb_buf1.
+	 */
+	mutex_lock(&ubi->cp_mutex);
+	down_write(&ubi->cp_sem);
+	down_write(&ubi->work_sem);
+	mutex_lock(&ubi->buf_mutex);
+
+	buf = ubi->peb_buf1;
+	memset(buf, 0, ubi->leb_size);
+	cph = buf;
+	state = buf + UBI_CP_HDR_SIZE;
+	ec = (void *)state + ALIGN(ubi->peb_count, 4);
+
+	len = fill_volumes(ubi, ec + ubi->peb_count, buf + ubi->leb_size,
+			   &vol_count);
+	if (len < 0) {
+		ubi_warn("checkpoint does not fit a LEB, fast attach disabled");
+		ubi->cp_disabled = 1;
+		err = len;
+		goto out_done;
+	}
+	len += cp_fixed_size(ubi);
+
+	anchor = ubi_wl_cp_prepare(ubi, state, ec);
+	if (!anchor) {
+		ubi_warn("no free PEB among the first %d, cannot write "
+			 "checkpoint", UBI_CP_MAX_START);
+		err = -ENOSPC;
+		goto out_done;
+	}
+
+	cph->magic = cpu_to_be32(UBI_CP_HDR_MAGIC);
+	cph->version = UBI_CP_FORMAT_VERSION;
+	cph->sqnum = cpu_to_be64(ubi_next_sqnum(ubi));
+	cph->peb_count = cpu_to_be32(ubi->peb_count);
+	cph->vol_count = cpu_to_be32(vol_count);
+	cph->image_seq = cpu_to_be32(ubi->image_seq);
+	cph->data_size = cpu_to_be32(len - UBI_CP_HDR_SIZE);
+	cph->data_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, buf + UBI_CP_HDR_SIZE,
+					  len - UBI_CP_HDR_SIZE));
+	cph->hdr_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, cph,
+					 UBI_CP_HDR_SIZE_CRC));
+
+	vid_hdr->vol_type = UBI_CP_VOLUME_TYPE;
+	vid_hdr->vol_id = cpu_to_be32(UBI_CP_VOLUME_ID);
+	vid_hdr->compat = UBI_CP_VOLUME_COMPAT;
+	vid_hdr->sqnum = cph->sqnum;
+
+	err = ubi_io_write_vid_hdr(ubi, anchor->pnum, vid_hdr);
+	if (!err)
+		err = ubi_io_write_data(ubi, buf, anchor->pnum, 0,
+					ALIGN(len, ubi->min_io_size));
+	if (err)
+		ubi_err("cannot write checkpoint to PEB %d, error %d",
+			anchor->pnum, err);
+	else
+		dbg_gen("checkpoint written to PEB %d, %d bytes",
+			anchor->pnum, len);
+
+out_done:
+	ubi_wl_cp_done(ubi, anchor, state, err);
+	mutex_unlock(&ubi->buf_mutex);
+	up_write(&ubi->work_sem);
+	up_write(&ubi->cp_sem);
+	mutex_unlock(&ubi->cp_mutex);
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return err;
+}
+
+/**
+ * ubi_cp_init - initialize checkpoint support of an UBI device.
+ * @ubi: UBI device description object
+ *
+ * This function has to be called once the device is attached and reserves
+ * the physical eraseblock the checkpoint lives in. If there is none, or the
+ * checkpoint could not fit a logical eraseblock, checkpoints are disabled.
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+int ubi_cp_init(struct ubi_device *ubi)
+{
+	ubi->cp_scan = kcalloc(BITS_TO_LONGS(ubi->peb_count),
+			       sizeof(unsigned long), GFP_KERNEL);
+	if (!ubi->cp_scan)
+		return -ENOMEM;
+
+	ubi->cp_pool_size = clamp_t(int, ubi->peb_count / 20, CP_MIN_POOL,
+				    CP_MAX_POOL);
+
+	if (cp_fixed_size(ubi) > ubi->leb_size) {
+		ubi_warn("too many PEBs for a checkpoint, fast attach "
+			 "disabled");
+		ubi->cp_disabled = 1;
+		return 0;
+	}
+
+	spin_lock(&ubi->volumes_lock);
+	if (ubi->avail_pebs < CP_RESERVED_PEBS) {
+		spin_unlock(&ubi->volumes_lock);
+		ubi_warn("no PEBs available for the checkpoint, fast attach "
+			 "disabled");
+		ubi->cp_disabled = 1;
+		return 0;
+	}
+	ubi->avail_pebs -= CP_RESERVED_PEBS;
+	ubi->rsvd_pebs += CP_RESERVED_PEBS;
+	spin_unlock(&ubi->volumes_lock);
+
+	return 0;
+}
+
+/**
+ * ubi_cp_close - free checkpoint resources of an UBI device.
+ * @ubi: UBI device description object
+ */
+void ubi_cp_close(struct ubi_device *ubi)
+{
+	kfree(ubi->cp_scan);
+}
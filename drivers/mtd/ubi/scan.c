@@ -56,7 +56,7 @@ static struct ubi_ec_hdr *ech;
 static struct ubi_vid_hdr *vidh;
 
 /**
- * add_to_list - add physical eraseblock to a list.
+ * ubi_scan_add_to_list - add physical eraseblock to a list.
  * @si: scanning information
  * @pnum: physical eraseblock number to add
  * @ec: erase counter of the physical eraseblock
@@ -66,8 +66,8 @@ static struct ubi_vid_hdr *vidh;
  * alien lists. Returns zero in case of success and a negative error code in
  * case of failure.
  */
-static int add_to_list(struct ubi_scan_info *si, int pnum, int ec,
-		       struct list_head *list)
+int ubi_scan_add_to_list(struct ubi_scan_info *si, int pnum, int ec,
+			 struct list_head *list)
 {
 	struct ubi_scan_leb *seb;
 
@@ -459,11 +459,11 @@ int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 				return err;
 
 			if (cmp_res & 4)
-				err = add_to_list(si, seb->pnum, seb->ec,
-						  &si->corr);
+				err = ubi_scan_add_to_list(si, seb->pnum,
+							   seb->ec, &si->corr);
 			else
-				err = add_to_list(si, seb->pnum, seb->ec,
-						  &si->erase);
+				err = ubi_scan_add_to_list(si, seb->pnum,
+							   seb->ec, &si->erase);
 			if (err)
 				return err;
 
@@ -483,9 +483,11 @@ int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 			 * previously.
 			 */
 			if (cmp_res & 4)
-				return add_to_list(si, pnum, ec, &si->corr);
+				return ubi_scan_add_to_list(si, pnum, ec,
+							    &si->corr);
 			else
-				return add_to_list(si, pnum, ec, &si->erase);
+				return ubi_scan_add_to_list(si, pnum, ec,
+							    &si->erase);
 		}
 	}
 
@@ -706,6 +708,41 @@ struct ubi_scan_leb *ubi_scan_get_free_peb(struct ubi_device *ubi,
 	return ERR_PTR(-ENOSPC);
 }
 
+/**
+ * ubi_scan_erase_cp - erase a physical eraseblock holding a checkpoint.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @pnum: physical eraseblock number to erase
+ * @ec: erase counter of the physical eraseblock
+ *
+ * Checkpoints found on the flash are erased synchronously rather than
+ * scheduled for erasure, because the next attach might otherwise pick up a
+ * checkpoint which does not describe the flash anymore. The physical
+ * eraseblock is added to the free list, or marked bad if it cannot be erased.
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+int ubi_scan_erase_cp(struct ubi_device *ubi, struct ubi_scan_info *si,
+		      int pnum, int ec)
+{
+	int err;
+
+	dbg_bld("erase checkpoint PEB %d, EC %d", pnum, ec);
+	err = ubi_scan_erase_peb(ubi, si, pnum, ec + 1);
+	if (!err)
+		return ubi_scan_add_to_list(si, pnum, ec + 1, &si->free);
+
+	if (err != -EIO || !ubi->bad_allowed)
+		return err;
+
+	ubi_warn("cannot erase checkpoint PEB %d, mark it bad", pnum);
+	err = ubi_io_mark_bad(ubi, pnum);
+	if (err)
+		return err;
+	si->bad_peb_count += 1;
+	return 0;
+}
+
 /**
  * process_eb - read, check UBI headers, and add them to scanning information.
  * @ubi: UBI device description object
@@ -743,7 +780,8 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 	else if (err == UBI_IO_BITFLIPS)
 		bitflips = 1;
 	else if (err == UBI_IO_PEB_EMPTY)
-		return add_to_list(si, pnum, UBI_SCAN_UNKNOWN_EC, &si->erase);
+		return ubi_scan_add_to_list(si, pnum, UBI_SCAN_UNKNOWN_EC,
+					    &si->erase);
 	else if (err == UBI_IO_BAD_EC_HDR) {
 		/*
 		 * We have to also look at the VID header, possibly it is not
@@ -815,19 +853,27 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 	else if (err == UBI_IO_BAD_VID_HDR ||
 		 (err == UBI_IO_PEB_FREE && ec_corr)) {
 		/* VID header is corrupted */
-		err = add_to_list(si, pnum, ec, &si->corr);
+		err = ubi_scan_add_to_list(si, pnum, ec, &si->corr);
 		if (err)
 			return err;
 		goto adjust_mean_ec;
 	} else if (err == UBI_IO_PEB_FREE) {
 		/* No VID header - the physical eraseblock is free */
-		err = add_to_list(si, pnum, ec, &si->free);
+		err = ubi_scan_add_to_list(si, pnum, ec, &si->free);
 		if (err)
 			return err;
 		goto adjust_mean_ec;
 	}
 
 	vol_id = be32_to_cpu(vidh->vol_id);
+	if (vol_id == UBI_CP_VOLUME_ID && !ec_corr) {
+		/* A checkpoint which was not used to attach is stale */
+		err = ubi_scan_erase_cp(ubi, si, pnum, ec);
+		if (err)
+			return err;
+		goto adjust_mean_ec;
+	}
+
 	if (vol_id > UBI_MAX_VOLUMES && vol_id != UBI_LAYOUT_VOLUME_ID) {
 		int lnum = be32_to_cpu(vidh->lnum);
 
@@ -836,7 +882,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		case UBI_COMPAT_DELETE:
 			ubi_msg("\"delete\" compatible internal volume %d:%d"
 				" found, remove it", vol_id, lnum);
-			err = add_to_list(si, pnum, ec, &si->corr);
+			err = ubi_scan_add_to_list(si, pnum, ec, &si->corr);
 			if (err)
 				return err;
 			break;
@@ -851,7 +897,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		case UBI_COMPAT_PRESERVE:
 			ubi_msg("\"preserve\" compatible internal volume %d:%d"
 				" found", vol_id, lnum);
-			err = add_to_list(si, pnum, ec, &si->alien);
+			err = ubi_scan_add_to_list(si, pnum, ec, &si->alien);
 			if (err)
 				return err;
 			si->alien_peb_count += 1;
@@ -889,11 +935,14 @@ adjust_mean_ec:
  * @ubi: UBI device description object
  *
  * This function does full scanning of an MTD device and returns complete
- * information about it. In case of failure, an error code is returned.
+ * information about it. If there is a valid checkpoint, only the physical
+ * eraseblocks it does not describe are scanned. In case of failure, an error
+ * code is returned.
  */
 struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 {
-	int err, pnum;
+	int err, pnum, cp, scanned = 0;
+	unsigned long *scan_map;
 	struct rb_node *rb1, *rb2;
 	struct ubi_scan_volume *sv;
 	struct ubi_scan_leb *seb;
@@ -919,16 +968,34 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 	if (!vidh)
 		goto out_ech;
 
+	scan_map = kcalloc(BITS_TO_LONGS(ubi->peb_count),
+			   sizeof(unsigned long), GFP_KERNEL);
+	if (!scan_map)
+		goto out_vidh;
+
+	err = ubi_cp_scan(ubi, si, scan_map);
+	if (err < 0)
+		goto out_map;
+	cp = !err;
+
 	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
 		cond_resched();
 
+		if (cp && !test_bit(pnum, scan_map))
+			continue;
+
 		dbg_gen("process PEB %d", pnum);
 		err = process_eb(ubi, si, pnum);
 		if (err < 0)
-			goto out_vidh;
+			goto out_map;
+		scanned += 1;
 	}
 
+	kfree(scan_map);
 	dbg_msg("scanning is finished");
+	if (cp)
+		ubi_msg("attached using checkpoint, scanned %d PEBs of %d",
+			scanned, ubi->peb_count);
 
 	/* Calculate mean erase counter */
 	if (si->ec_count)
@@ -973,11 +1040,17 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 		if (seb->ec == UBI_SCAN_UNKNOWN_EC)
 			seb->ec = si->mean_ec;
 
-	err = paranoid_check_si(ubi, si);
-	if (err) {
-		if (err > 0)
-			err = -EINVAL;
-		goto out_vidh;
+	/*
+	 * The sequence numbers of the logical eraseblocks described by the
+	 * checkpoint are not the on-flash ones, skip the check.
+	 */
+	if (!cp) {
+		err = paranoid_check_si(ubi, si);
+		if (err) {
+			if (err > 0)
+				err = -EINVAL;
+			goto out_vidh;
+		}
 	}
 
 	ubi_free_vid_hdr(ubi, vidh);
@@ -985,6 +1058,8 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 
 	return si;
 
+out_map:
+	kfree(scan_map);
 out_vidh:
 	ubi_free_vid_hdr(ubi, vidh);
 out_ech:
@@ -312,6 +312,18 @@ struct ubi_vid_hdr {
 #define UBI_LAYOUT_VOLUME_NAME   "layout volume"
 #define UBI_LAYOUT_VOLUME_COMPAT UBI_COMPAT_REJECT
 
+/*
+ * The checkpoint volume holds a snapshot of the eraseblock association and
+ * erase counters, see checkpoint.c. It is not a real volume: it has a single
+ * logical eraseblock which lives in one of the first %UBI_CP_MAX_START
+ * physical eraseblocks, and implementations which do not know about it just
+ * delete it.
+ */
+#define UBI_CP_VOLUME_ID     (UBI_LAYOUT_VOLUME_ID + 1)
+#define UBI_CP_VOLUME_TYPE   UBI_VID_DYNAMIC
+#define UBI_CP_VOLUME_COMPAT UBI_COMPAT_DELETE
+#define UBI_CP_MAX_START     64
+
 /* The maximum number of volumes per one UBI device */
 #define UBI_MAX_VOLUMES 128
 
@@ -375,4 +387,94 @@ struct ubi_vtbl_record {
 	__be32  crc;
 } __attribute__ ((packed));
 
+/* Checkpoint header magic number (ASCII "UBIC") */
+#define UBI_CP_HDR_MAGIC 0x55424943
+
+/* The version of the checkpoint format */
+#define UBI_CP_FORMAT_VERSION 1
+
+/* Size of the checkpoint header and without the ending CRC */
+#define UBI_CP_HDR_SIZE     sizeof(struct ubi_cp_hdr)
+#define UBI_CP_HDR_SIZE_CRC (UBI_CP_HDR_SIZE - sizeof(__be32))
+
+/* Marks an unmapped logical eraseblock in the checkpoint */
+#define UBI_CP_UNMAPPED 0xFFFFFFFFU
+
+/*
+ * Physical eraseblock states stored in the checkpoint.
+ *
+ * @UBI_CP_PEB_SCAN: not described by the checkpoint, has to be scanned
+ * @UBI_CP_PEB_FREE: erased and has a valid EC header
+ * @UBI_CP_PEB_USED: holds data, the volume records tell which
+ * @UBI_CP_PEB_ERASE: has to be erased
+ */
+enum {
+	UBI_CP_PEB_SCAN  = 0,
+	UBI_CP_PEB_FREE  = 1,
+	UBI_CP_PEB_USED  = 2,
+	UBI_CP_PEB_ERASE = 3
+};
+
+/**
+ * struct ubi_cp_hdr - checkpoint header.
+ * @magic: checkpoint header magic number (%UBI_CP_HDR_MAGIC)
+ * @version: checkpoint format version (%UBI_CP_FORMAT_VERSION)
+ * @padding1: reserved for future, zeroes
+ * @sqnum: sequence number of the checkpoint, the same as in its VID header
+ * @peb_count: count of physical eraseblocks on the device
+ * @vol_count: count of volume records
+ * @image_seq: image sequence number
+ * @data_size: how many bytes of data follow the header
+ * @data_crc: CRC32 checksum of the data following the header
+ * @padding2: reserved for future, zeroes
+ * @hdr_crc: checkpoint header CRC checksum
+ *
+ * The header starts the data of the only logical eraseblock of the checkpoint
+ * volume and is followed by:
+ *   o @peb_count physical eraseblock states (%UBI_CP_PEB_SCAN, etc), one byte
+ *     each, padded with zeroes to a multiple of 4 bytes;
+ *   o @peb_count erase counters, __be32 each, only meaningful for physical
+ *     eraseblocks which are not in the %UBI_CP_PEB_SCAN state;
+ *   o @vol_count volume records (&struct ubi_cp_vol), each followed by
+ *     @reserved_pebs __be32 physical eraseblock numbers, indexed by logical
+ *     eraseblock number, %UBI_CP_UNMAPPED for unmapped ones.
+ *
+ * Everything written to the flash after the checkpoint goes to the physical
+ * eraseblocks in the %UBI_CP_PEB_SCAN state, which are scanned when attaching,
+ * as well as the used physical eraseblocks no volume record refers to. The
+ * checkpoint is only valid if its @sqnum is the highest one among checkpoints
+ * found on the flash.
+ */
+struct ubi_cp_hdr {
+	__be32  magic;
+	__u8    version;
+	__u8    padding1[3];
+	__be64  sqnum;
+	__be32  peb_count;
+	__be32  vol_count;
+	__be32  image_seq;
+	__be32  data_size;
+	__be32  data_crc;
+	__u8    padding2[24];
+	__be32  hdr_crc;
+} __attribute__ ((packed));
+
+/**
+ * struct ubi_cp_vol - volume record of the checkpoint.
+ * @vol_id: volume ID
+ * @reserved_pebs: count of logical eraseblocks in the record
+ * @data_pad: how many bytes at the end of logical eraseblocks are not used
+ * @padding: reserved for future, zeroes
+ *
+ * Only dynamic volumes have records. The logical eraseblocks of static
+ * volumes carry per-volume information in their VID headers, so their
+ * physical eraseblocks are recorded as used but are scanned when attaching.
+ */
+struct ubi_cp_vol {
+	__be32  vol_id;
+	__be32  reserved_pebs;
+	__be32  data_pad;
+	__u8    padding[4];
+} __attribute__ ((packed));
+
 #endif /* !__UBI_MEDIA_H__ */
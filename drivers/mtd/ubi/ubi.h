@@ -335,7 +335,9 @@ struct ubi_wl_entry;
  * @pq_head: protection queue head
  * @wl_lock: protects the @used, @free, @pq, @pq_head, @lookuptbl, @move_from,
  * 	     @move_to, @move_to_put @erase_pending, @wl_scheduled, @works,
- * 	     @erroneous, and @erroneous_peb_count fields
+ * 	     @erroneous, @erroneous_peb_count, @free_count, @erased_pool,
+ * 	     @free_waiters and the @stall_* fields, as well as the checkpoint
+ * 	     fields other than the locks
  * @move_mutex: serializes eraseblock moves
  * @work_sem: synchronizes the WL worker with use tasks
  * @wl_scheduled: non-zero if the wear-leveling was scheduled
@@ -346,11 +348,44 @@ struct ubi_wl_entry;
  * @move_to_put: if the "to" PEB was put
  * @works: list of pending works
  * @works_count: count of pending works
+ * @free_count: count of physical eraseblocks in @free
+ * @erased_pool: count of free physical eraseblocks the WL sub-system tries to
+ *               keep; while there are fewer, pending erasures are done before
+ *               moves, in batches
+ * @free_waiters: count of tasks waiting for a free physical eraseblock
+ * @stall_count: count of times a task had to wait for a free physical
+ *               eraseblock
+ * @stall_time: total time tasks waited for free physical eraseblocks
+ *              (microseconds)
+ * @stall_max: longest wait for a free physical eraseblock (microseconds)
  * @bgt_thread: background thread description object
  * @thread_enabled: if the background thread is enabled
  * @bgt_name: background thread name
  * @reboot_notifier: notifier to terminate background thread before rebooting
  *
+ * @cp_anchor: physical eraseblock holding the current checkpoint, %NULL if
+ *             there is no valid checkpoint on the flash
+ * @cp_free: free physical eraseblocks which must not be written because the
+ *           checkpoint records them as free (@free only holds the pool while
+ *           there is a valid checkpoint)
+ * @cp_erase: physical eraseblocks the checkpoint records as used, which were
+ *            put since it was written and cannot be erased until the next
+ *            one is written (index %1 is for those to be tortured)
+ * @cp_erase_count: count of physical eraseblocks in @cp_erase
+ * @cp_pool_count: count of physical eraseblocks left in the pool
+ * @cp_pool_size: count of physical eraseblocks put to the pool of a new
+ *                checkpoint
+ * @cp_pool_low: a new checkpoint is requested when the pool goes below this
+ * @cp_scan: bitmap of physical eraseblocks the checkpoint does not describe,
+ *           which may be erased and written at will
+ * @cp_needed: if the background thread has to write a new checkpoint
+ * @cp_disabled: if checkpoints are not used on this device
+ * @cp_sem: taken in read mode by the EBA sub-system for the duration of an
+ *          operation changing the LEB mapping and in write mode when writing
+ *          a checkpoint
+ * @cp_mutex: serializes checkpoint writers
+ * @cp_inval_mutex: serializes checkpoint invalidation
+ *
  * @flash_size: underlying MTD device size (in bytes)
  * @peb_count: count of physical eraseblocks on the MTD device
  * @peb_size: physical eraseblock size
@@ -432,11 +467,32 @@ struct ubi_device {
 	int move_to_put;
 	struct list_head works;
 	int works_count;
+	int free_count;
+	int erased_pool;
+	int free_waiters;
+	unsigned int stall_count;
+	u64 stall_time;
+	unsigned int stall_max;
 	struct task_struct *bgt_thread;
 	int thread_enabled;
 	char bgt_name[sizeof(UBI_BGT_NAME_PATTERN)+2];
 	struct notifier_block reboot_notifier;
 
+	/* Checkpoint stuff */
+	struct ubi_wl_entry *cp_anchor;
+	struct rb_root cp_free;
+	struct list_head cp_erase[2];
+	int cp_erase_count;
+	int cp_pool_count;
+	int cp_pool_size;
+	int cp_pool_low;
+	unsigned long *cp_scan;
+	int cp_needed;
+	int cp_disabled;
+	struct rw_semaphore cp_sem;
+	struct mutex cp_mutex;
+	struct mutex cp_inval_mutex;
+
 	/* I/O sub-system's stuff */
 	long long flash_size;
 	int peb_count;
@@ -523,6 +579,7 @@ int ubi_eba_atomic_leb_change(struct ubi_device *ubi, struct ubi_volume *vol,
 int ubi_eba_copy_leb(struct ubi_device *ubi, int from, int to,
 		     struct ubi_vid_hdr *vid_hdr);
 int ubi_eba_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
+unsigned long long ubi_next_sqnum(struct ubi_device *ubi);
 
 /* wl.c */
 int ubi_wl_get_peb(struct ubi_device *ubi, int dtype);
@@ -532,6 +589,29 @@ int ubi_wl_scrub_peb(struct ubi_device *ubi, int pnum);
 int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
 void ubi_wl_close(struct ubi_device *ubi);
 int ubi_thread(void *u);
+struct ubi_wl_entry *ubi_wl_cp_prepare(struct ubi_device *ubi, uint8_t *state,
+				       __be32 *ec);
+void ubi_wl_cp_done(struct ubi_device *ubi, struct ubi_wl_entry *anchor,
+		    const uint8_t *state, int err);
+
+/* checkpoint.c */
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+int ubi_cp_scan(struct ubi_device *ubi, struct ubi_scan_info *si,
+		unsigned long *scan_map);
+int ubi_cp_init(struct ubi_device *ubi);
+void ubi_cp_close(struct ubi_device *ubi);
+int ubi_cp_write(struct ubi_device *ubi);
+#else
+static inline int ubi_cp_scan(struct ubi_device *ubi,
+			      struct ubi_scan_info *si,
+			      unsigned long *scan_map)
+{
+	return 1;
+}
+static inline int ubi_cp_init(struct ubi_device *ubi) { return 0; }
+static inline void ubi_cp_close(struct ubi_device *ubi) {}
+static inline int ubi_cp_write(struct ubi_device *ubi) { return 0; }
+#endif
 
 /* io.c */
 int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
@@ -103,12 +103,32 @@
  * target PEB, we pick a PEB with the highest EC if our PEB is "old" and we
  * pick target PEB with an average EC if our PEB is not very "old". This is a
  * room for future re-works of the WL sub-system.
+ *
+ * When there is a valid checkpoint on the flash (see checkpoint.c), the
+ * sub-system has to keep the flash in a state the checkpoint can describe.
+ * Only the physical eraseblocks the checkpoint left for scanning (the pool)
+ * are kept in the @wl->free tree, other free physical eraseblocks are kept in
+ * the @wl->cp_free tree and are not handed out. And physical eraseblocks the
+ * checkpoint records as used are not erased when they are put, but added to
+ * the @wl->cp_erase lists, because the checkpoint still refers to them. A new
+ * checkpoint is written by the background thread when the pool runs low or
+ * too many erasures are deferred, and if the pool is exhausted before that,
+ * the checkpoint is dropped.
+ *
+ * Pending works are done in order, except that erasures go before a pending
+ * move (there is at most one) when tasks are waiting for a free physical
+ * eraseblock or there are fewer free physical eraseblocks than
+ * @wl->erased_pool. A move consumes a free physical eraseblock and keeps the
+ * flash busy for a while, so the background thread does not start one while
+ * a task is waiting, and below @wl->erased_pool it does the erasures in
+ * batches to refill the pool before anything else.
  */
 
 #include <linux/slab.h>
 #include <linux/crc32.h>
 #include <linux/freezer.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include "ubi.h"
 
 /* Number of physical eraseblocks reserved for wear-leveling purposes */
@@ -141,6 +161,16 @@
  */
 #define WL_MAX_FAILURES 32
 
+/*
+ * Maximum number of erasures the background thread does in a row when the
+ * pool of free physical eraseblocks has to be refilled.
+ */
+#define WL_ERASE_BATCH 16
+
+/* Default size of the pool of free physical eraseblocks, per 1024 PEBs */
+#define WL_ERASED_POOL_PER_1024 16
+#define WL_ERASED_POOL_MIN 4
+
 /**
  * struct ubi_work - UBI work description data structure.
  * @list: a link in the list of pending works
@@ -172,6 +202,9 @@ static int paranoid_check_in_pq(struct ubi_device *ubi, struct ubi_wl_entry *e);
 #define paranoid_check_in_pq(ubi, e) 0
 #endif
 
+static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
+				int cancel);
+
 /**
  * wl_tree_add - add a wear-leveling entry to a WL RB-tree.
  * @e: the wear-leveling entry to add
@@ -209,15 +242,83 @@ static void wl_tree_add(struct ubi_wl_entry *e, struct rb_root *root)
 }
 
 /**
- * do_work - do one pending work.
+ * free_tree_add - add a wear-leveling entry to the @wl->free tree.
  * @ubi: UBI device description object
+ * @e: the wear-leveling entry to add
  *
- * This function returns zero in case of success and a negative error code in
- * case of failure.
+ * Note, @wl->lock has to be locked.
  */
-static int do_work(struct ubi_device *ubi)
+static void free_tree_add(struct ubi_device *ubi, struct ubi_wl_entry *e)
 {
-	int err;
+	wl_tree_add(e, &ubi->free);
+	ubi->free_count += 1;
+}
+
+/**
+ * free_tree_del - remove a wear-leveling entry from the @wl->free tree.
+ * @ubi: UBI device description object
+ * @e: the wear-leveling entry to remove
+ *
+ * Note, @wl->lock has to be locked.
+ */
+static void free_tree_del(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+	rb_erase(&e->u.rb, &ubi->free);
+	ubi->free_count -= 1;
+	ubi_assert(ubi->free_count >= 0);
+}
+
+/**
+ * next_work - pick the pending work to do next.
+ * @ubi: UBI device description object
+ * @fg: non-zero if the caller is not the background thread
+ *
+ * This function returns the work which has to be done next, or %NULL if there
+ * is none or if the background thread should leave it to a task waiting for
+ * a free physical eraseblock. Note, @wl->lock has to be locked.
+ */
+static struct ubi_work *next_work(struct ubi_device *ubi, int fg)
+{
+	struct ubi_work *wrk;
+
+	if (list_empty(&ubi->works))
+		return NULL;
+
+	wrk = list_entry(ubi->works.next, struct ubi_work, list);
+	if (wrk->func != &wear_leveling_worker)
+		return wrk;
+
+	/*
+	 * There is only one move in the queue at a time, so the next work, if
+	 * any, is an erasure.
+	 */
+	if ((ubi->free_waiters || ubi->free_count < ubi->erased_pool) &&
+	    !list_is_last(&wrk->list, &ubi->works))
+		return list_entry(wrk->list.next, struct ubi_work, list);
+
+	/*
+	 * A move does not produce a free physical eraseblock. But if it is the
+	 * only work left, a waiting task does it, because it will be canceled
+	 * if there are no free physical eraseblocks.
+	 */
+	if (!fg && ubi->free_waiters)
+		return NULL;
+	return wrk;
+}
+
+/**
+ * do_work - do pending works.
+ * @ubi: UBI device description object
+ * @fg: non-zero if the caller is not the background thread
+ *
+ * This function does one pending work, or a batch of erasures if the
+ * background thread has to refill the pool of free physical eraseblocks.
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+static int do_work(struct ubi_device *ubi, int fg)
+{
+	int err = 0, batch, done = 0;
 	struct ubi_work *wrk;
 
 	cond_resched();
@@ -229,27 +330,32 @@ static int do_work(struct ubi_device *ubi)
 	 * done, and it takes the mutex in write mode.
 	 */
 	down_read(&ubi->work_sem);
-	spin_lock(&ubi->wl_lock);
-	if (list_empty(&ubi->works)) {
-		spin_unlock(&ubi->wl_lock);
-		up_read(&ubi->work_sem);
-		return 0;
-	}
+	do {
+		spin_lock(&ubi->wl_lock);
+		wrk = next_work(ubi, fg);
+		if (!wrk) {
+			spin_unlock(&ubi->wl_lock);
+			break;
+		}
 
-	wrk = list_entry(ubi->works.next, struct ubi_work, list);
-	list_del(&wrk->list);
-	ubi->works_count -= 1;
-	ubi_assert(ubi->works_count >= 0);
-	spin_unlock(&ubi->wl_lock);
+		list_del(&wrk->list);
+		ubi->works_count -= 1;
+		ubi_assert(ubi->works_count >= 0);
+		batch = !fg && wrk->func != &wear_leveling_worker &&
+			ubi->free_count < ubi->erased_pool;
+		spin_unlock(&ubi->wl_lock);
 
-	/*
-	 * Call the worker function. Do not touch the work structure
-	 * after this call as it will have been freed or reused by that
-	 * time by the worker function.
-	 */
-	err = wrk->func(ubi, wrk, 0);
-	if (err)
-		ubi_err("work failed with error code %d", err);
+		/*
+		 * Call the worker function. Do not touch the work structure
+		 * after this call as it will have been freed or reused by that
+		 * time by the worker function.
+		 */
+		err = wrk->func(ubi, wrk, 0);
+		if (err) {
+			ubi_err("work failed with error code %d", err);
+			break;
+		}
+	} while (batch && ++done < WL_ERASE_BATCH);
 	up_read(&ubi->work_sem);
 
 	return err;
@@ -273,7 +379,7 @@ static int produce_free_peb(struct ubi_device *ubi)
 		spin_unlock(&ubi->wl_lock);
 
 		dbg_wl("do one work synchronously");
-		err = do_work(ubi);
+		err = do_work(ubi, 1);
 		if (err)
 			return err;
 
@@ -376,6 +482,77 @@ static struct ubi_wl_entry *find_wl_entry(struct rb_root *root, int max)
 	return e;
 }
 
+/**
+ * in_cp - check if the checkpoint describes a physical eraseblock.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock to check
+ *
+ * This function returns non-zero if there is a valid checkpoint and it records
+ * the state of @pnum, in which case the state of @pnum must not change until
+ * a new checkpoint is written. Note, @wl->lock has to be locked.
+ */
+static int in_cp(const struct ubi_device *ubi, int pnum)
+{
+	return ubi->cp_anchor && !test_bit(pnum, ubi->cp_scan);
+}
+
+/**
+ * cp_request - ask the background thread to write a new checkpoint.
+ * @ubi: UBI device description object
+ *
+ * Note, @wl->lock has to be locked.
+ */
+static void cp_request(struct ubi_device *ubi)
+{
+	if (ubi->cp_needed)
+		return;
+	ubi->cp_needed = 1;
+	if (ubi->thread_enabled)
+		wake_up_process(ubi->bgt_thread);
+}
+
+/**
+ * cp_pool_get - account a physical eraseblock taken from the @wl->free tree.
+ * @ubi: UBI device description object
+ *
+ * Note, @wl->lock has to be locked.
+ */
+static void cp_pool_get(struct ubi_device *ubi)
+{
+	if (!ubi->cp_anchor)
+		return;
+	ubi->cp_pool_count -= 1;
+	ubi_assert(ubi->cp_pool_count >= 0);
+	if (ubi->cp_pool_count < ubi->cp_pool_low)
+		cp_request(ubi);
+}
+
+static int cp_invalidate(struct ubi_device *ubi);
+
+/**
+ * stall_done - account a wait for a free physical eraseblock.
+ * @ubi: UBI device description object
+ * @start: when the wait started
+ *
+ * Note, @wl->lock has to be locked.
+ */
+static void stall_done(struct ubi_device *ubi, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+
+	ubi->free_waiters -= 1;
+	ubi_assert(ubi->free_waiters >= 0);
+	ubi->stall_count += 1;
+	ubi->stall_time += us;
+	if (us > ubi->stall_max)
+		ubi->stall_max = us;
+
+	/* The background thread may have left a move to the waiters */
+	if (!ubi->free_waiters && !list_empty(&ubi->works) &&
+	    ubi->thread_enabled)
+		wake_up_process(ubi->bgt_thread);
+}
+
 /**
  * ubi_wl_get_peb - get a physical eraseblock.
  * @ubi: UBI device description object
@@ -386,7 +563,8 @@ static struct ubi_wl_entry *find_wl_entry(struct rb_root *root, int max)
  */
 int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
 {
-	int err, medium_ec;
+	int err, medium_ec, stalled = 0;
+	ktime_t uninitialized_var(start);
 	struct ubi_wl_entry *e, *first, *last;
 
 	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
@@ -395,9 +573,32 @@ int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
 retry:
 	spin_lock(&ubi->wl_lock);
 	if (!ubi->free.rb_node) {
+		if (!stalled) {
+			/* Let the pending erasures go first */
+			stalled = 1;
+			start = ktime_get();
+			ubi->free_waiters += 1;
+		}
+
+		if (ubi->cp_anchor) {
+			/*
+			 * The pool of the checkpoint is exhausted. Drop the
+			 * checkpoint to make all the free physical
+			 * eraseblocks usable, and ask for a new one.
+			 */
+			spin_unlock(&ubi->wl_lock);
+			err = cp_invalidate(ubi);
+			if (err)
+				goto out_stall;
+			spin_lock(&ubi->wl_lock);
+			cp_request(ubi);
+			spin_unlock(&ubi->wl_lock);
+			goto retry;
+		}
 		if (ubi->works_count == 0) {
 			ubi_assert(list_empty(&ubi->works));
 			ubi_err("no free eraseblocks");
+			stall_done(ubi, start);
 			spin_unlock(&ubi->wl_lock);
 			return -ENOSPC;
 		}
@@ -405,7 +606,7 @@ retry:
 
 		err = produce_free_peb(ubi);
 		if (err < 0)
-			return err;
+			goto out_stall;
 		goto retry;
 	}
 
@@ -455,9 +656,12 @@ retry:
 	 * Move the physical eraseblock to the protection queue where it will
 	 * be protected from being moved for some time.
 	 */
-	rb_erase(&e->u.rb, &ubi->free);
+	free_tree_del(ubi, e);
+	cp_pool_get(ubi);
 	dbg_wl("PEB %d EC %d", e->pnum, e->ec);
 	prot_queue_add(ubi, e);
+	if (stalled)
+		stall_done(ubi, start);
 	spin_unlock(&ubi->wl_lock);
 
 	err = ubi_dbg_check_all_ff(ubi, e->pnum, ubi->vid_hdr_aloffset,
@@ -468,6 +672,12 @@ retry:
 	}
 
 	return e->pnum;
+
+out_stall:
+	spin_lock(&ubi->wl_lock);
+	stall_done(ubi, start);
+	spin_unlock(&ubi->wl_lock);
+	return err;
 }
 
 /**
@@ -622,7 +832,7 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 			int cancel);
 
 /**
- * schedule_erase - schedule an erase work.
+ * __schedule_erase - schedule an erase work.
  * @ubi: UBI device description object
  * @e: the WL entry of the physical eraseblock to erase
  * @torture: if the physical eraseblock has to be tortured
@@ -630,8 +840,8 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
  * This function returns zero in case of success and a %-ENOMEM in case of
  * failure.
  */
-static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
-			  int torture)
+static int __schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
+			    int torture)
 {
 	struct ubi_work *wl_wrk;
 
@@ -650,6 +860,123 @@ static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
 	return 0;
 }
 
+/**
+ * schedule_erase - schedule an erase work or defer it.
+ * @ubi: UBI device description object
+ * @e: the WL entry of the physical eraseblock to erase
+ * @torture: if the physical eraseblock has to be tortured
+ *
+ * This function is used for physical eraseblocks which are not needed any
+ * more. If the checkpoint refers to @e, the erasure is deferred until a new
+ * checkpoint is written. This function returns zero in case of success and a
+ * %-ENOMEM in case of failure.
+ */
+static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
+			  int torture)
+{
+	spin_lock(&ubi->wl_lock);
+	if (in_cp(ubi, e->pnum)) {
+		dbg_wl("defer erasure of PEB %d, EC %d, torture %d",
+		       e->pnum, e->ec, torture);
+		list_add_tail(&e->u.list, &ubi->cp_erase[!!torture]);
+		ubi->cp_erase_count += 1;
+		if (ubi->cp_erase_count >= ubi->cp_pool_size)
+			cp_request(ubi);
+		spin_unlock(&ubi->wl_lock);
+		return 0;
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	return __schedule_erase(ubi, e, torture);
+}
+
+/**
+ * schedule_erase_list - schedule erase works for a list of WL entries.
+ * @ubi: UBI device description object
+ * @list: the list of WL entries
+ * @torture: if the physical eraseblocks have to be tortured
+ *
+ * This function empties @list and returns zero in case of success and a
+ * %-ENOMEM in case of failure, in which case UBI is switched to R/O mode.
+ */
+static int schedule_erase_list(struct ubi_device *ubi, struct list_head *list,
+			       int torture)
+{
+	int err, ret = 0;
+	struct ubi_wl_entry *e, *tmp;
+
+	list_for_each_entry_safe(e, tmp, list, u.list) {
+		list_del(&e->u.list);
+		err = __schedule_erase(ubi, e, torture);
+		if (err) {
+			kmem_cache_free(ubi_wl_entry_slab, e);
+			ubi_ro_mode(ubi);
+			ret = err;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * cp_invalidate - drop the checkpoint.
+ * @ubi: UBI device description object
+ *
+ * This function erases the physical eraseblock holding the checkpoint, so the
+ * next attach has to scan the flash. Then all the free physical eraseblocks
+ * may be used and the deferred erasures are scheduled. Returns zero in case
+ * of success and a negative error code in case of failure.
+ */
+static int cp_invalidate(struct ubi_device *ubi)
+{
+	int i, err = 0;
+	struct rb_node *rb;
+	struct ubi_wl_entry *e;
+	struct list_head erase[2];
+
+	mutex_lock(&ubi->cp_inval_mutex);
+	spin_lock(&ubi->wl_lock);
+	e = ubi->cp_anchor;
+	spin_unlock(&ubi->wl_lock);
+	if (!e)
+		goto out_unlock;
+
+	dbg_wl("drop checkpoint at PEB %d", e->pnum);
+	err = sync_erase(ubi, e, 0);
+	if (err) {
+		ubi_err("cannot erase checkpoint PEB %d, error %d",
+			e->pnum, err);
+		ubi_ro_mode(ubi);
+		goto out_unlock;
+	}
+
+	spin_lock(&ubi->wl_lock);
+	ubi->cp_anchor = NULL;
+	free_tree_add(ubi, e);
+	while ((rb = rb_first(&ubi->cp_free))) {
+		e = rb_entry(rb, struct ubi_wl_entry, u.rb);
+		rb_erase(rb, &ubi->cp_free);
+		free_tree_add(ubi, e);
+	}
+	for (i = 0; i < 2; i++) {
+		INIT_LIST_HEAD(&erase[i]);
+		list_splice_init(&ubi->cp_erase[i], &erase[i]);
+	}
+	ubi->cp_erase_count = 0;
+	spin_unlock(&ubi->wl_lock);
+
+	for (i = 0; i < 2; i++) {
+		int err1 = schedule_erase_list(ubi, &erase[i], i);
+
+		if (err1)
+			err = err1;
+	}
+
+out_unlock:
+	mutex_unlock(&ubi->cp_inval_mutex);
+	return err;
+}
+
 /**
  * wear_leveling_worker - wear-leveling worker function.
  * @ubi: UBI device description object
@@ -727,7 +1054,8 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	}
 
 	paranoid_check_in_wl_tree(e2, &ubi->free);
-	rb_erase(&e2->u.rb, &ubi->free);
+	free_tree_del(ubi, e2);
+	cp_pool_get(ubi);
 	ubi->move_from = e1;
 	ubi->move_to = e2;
 	spin_unlock(&ubi->wl_lock);
@@ -1020,7 +1348,14 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 		kfree(wl_wrk);
 
 		spin_lock(&ubi->wl_lock);
-		wl_tree_add(e, &ubi->free);
+		if (in_cp(ubi, pnum))
+			/* The checkpoint does not allow writing to it */
+			wl_tree_add(e, &ubi->cp_free);
+		else {
+			free_tree_add(ubi, e);
+			if (ubi->cp_anchor)
+				ubi->cp_pool_count += 1;
+		}
 		spin_unlock(&ubi->wl_lock);
 
 		/*
@@ -1042,7 +1377,7 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 		int err1;
 
 		/* Re-schedule the LEB for erasure */
-		err1 = schedule_erase(ubi, e, 0);
+		err1 = __schedule_erase(ubi, e, 0);
 		if (err1) {
 			err = err1;
 			goto out_ro;
@@ -1265,7 +1600,18 @@ retry:
  */
 int ubi_wl_flush(struct ubi_device *ubi)
 {
-	int err;
+	int err, cp;
+
+	/*
+	 * Erasures of physical eraseblocks the checkpoint refers to are
+	 * deferred, and they are let go by writing a new checkpoint. If that
+	 * fails, the checkpoint is dropped and the erasures are scheduled.
+	 */
+	spin_lock(&ubi->wl_lock);
+	cp = ubi->cp_anchor && ubi->cp_erase_count;
+	spin_unlock(&ubi->wl_lock);
+	if (cp)
+		ubi_cp_write(ubi);
 
 	/*
 	 * Erase while the pending works queue is not empty, but not more than
@@ -1273,7 +1619,7 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	 */
 	dbg_wl("flush (%d pending works)", ubi->works_count);
 	while (ubi->works_count) {
-		err = do_work(ubi);
+		err = do_work(ubi, 1);
 		if (err)
 			return err;
 	}
@@ -1291,14 +1637,240 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	 */
 	while (ubi->works_count) {
 		dbg_wl("flush more (%d pending works)", ubi->works_count);
-		err = do_work(ubi);
+		err = do_work(ubi, 1);
 		if (err)
 			return err;
 	}
 
+	/*
+	 * A checkpoint dropped because it could not be written, or which
+	 * found no free PEB when attaching, is written again now that the
+	 * pending erasures are done.
+	 */
+	spin_lock(&ubi->wl_lock);
+	cp = !ubi->cp_anchor;
+	spin_unlock(&ubi->wl_lock);
+	if (cp)
+		ubi_cp_write(ubi);
+
 	return 0;
 }
 
+/**
+ * cp_mark_tree - record the state of the physical eraseblocks of a WL tree.
+ * @root: the root of the tree
+ * @state: physical eraseblock states array
+ * @ec: erase counters array
+ * @st: the state to record
+ */
+static void cp_mark_tree(struct rb_root *root, uint8_t *state, __be32 *ec,
+			 int st)
+{
+	struct rb_node *rb;
+	struct ubi_wl_entry *e;
+
+	ubi_rb_for_each_entry(rb, e, root, u.rb) {
+		state[e->pnum] = st;
+		ec[e->pnum] = cpu_to_be32(e->ec);
+	}
+}
+
+/**
+ * cp_mark_one - record the state of a physical eraseblock.
+ * @e: the WL entry of the physical eraseblock
+ * @state: physical eraseblock states array
+ * @ec: erase counters array
+ * @st: the state to record
+ */
+static void cp_mark_one(struct ubi_wl_entry *e, uint8_t *state, __be32 *ec,
+			int st)
+{
+	state[e->pnum] = st;
+	ec[e->pnum] = cpu_to_be32(e->ec);
+}
+
+/**
+ * ubi_wl_cp_prepare - prepare the WL part of a new checkpoint.
+ * @ubi: UBI device description object
+ * @state: physical eraseblock states array to fill
+ * @ec: erase counters array to fill
+ *
+ * This function picks a free physical eraseblock for the new checkpoint among
+ * the first %UBI_CP_MAX_START ones and records the state of all physical
+ * eraseblocks. It also picks the pool of the new checkpoint, which is a
+ * sample of the free physical eraseblocks spread over the erase counter range,
+ * and records it as not described by the checkpoint. The caller has to make
+ * sure no other WL or EBA operation is in progress. Returns the WL entry of
+ * the picked physical eraseblock, which is not in any WL tree anymore, or
+ * %NULL if there is none.
+ */
+struct ubi_wl_entry *ubi_wl_cp_prepare(struct ubi_device *ubi, uint8_t *state,
+				       __be32 *ec)
+{
+	int i, n = 0, stride, pool = 0;
+	struct rb_node *rb;
+	struct rb_root *root = &ubi->free;
+	struct ubi_wl_entry *e, *anchor = NULL;
+	struct ubi_work *wrk;
+
+	spin_lock(&ubi->wl_lock);
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb)
+		if (e->pnum < UBI_CP_MAX_START) {
+			anchor = e;
+			break;
+		}
+	if (!anchor) {
+		root = &ubi->cp_free;
+		ubi_rb_for_each_entry(rb, e, &ubi->cp_free, u.rb)
+			if (e->pnum < UBI_CP_MAX_START) {
+				anchor = e;
+				break;
+			}
+	}
+	if (!anchor) {
+		spin_unlock(&ubi->wl_lock);
+		return NULL;
+	}
+	if (root == &ubi->free)
+		free_tree_del(ubi, anchor);
+	else
+		rb_erase(&anchor->u.rb, root);
+
+	/* The pool is picked among all the free physical eraseblocks */
+	while ((rb = rb_first(&ubi->cp_free))) {
+		e = rb_entry(rb, struct ubi_wl_entry, u.rb);
+		rb_erase(rb, &ubi->cp_free);
+		free_tree_add(ubi, e);
+	}
+
+	memset(state, UBI_CP_PEB_SCAN, ubi->peb_count);
+	memset(ec, 0, ubi->peb_count * sizeof(__be32));
+
+	cp_mark_tree(&ubi->free, state, ec, UBI_CP_PEB_FREE);
+	cp_mark_tree(&ubi->used, state, ec, UBI_CP_PEB_USED);
+	cp_mark_tree(&ubi->erroneous, state, ec, UBI_CP_PEB_USED);
+	cp_mark_tree(&ubi->scrub, state, ec, UBI_CP_PEB_USED);
+	for (i = 0; i < UBI_PROT_QUEUE_LEN; i++)
+		list_for_each_entry(e, &ubi->pq[i], u.list)
+			cp_mark_one(e, state, ec, UBI_CP_PEB_USED);
+
+	for (i = 0; i < 2; i++)
+		list_for_each_entry(e, &ubi->cp_erase[i], u.list)
+			cp_mark_one(e, state, ec, UBI_CP_PEB_ERASE);
+	list_for_each_entry(wrk, &ubi->works, list)
+		if (wrk->func == &erase_worker)
+			cp_mark_one(wrk->e, state, ec, UBI_CP_PEB_ERASE);
+	if (ubi->cp_anchor)
+		cp_mark_one(ubi->cp_anchor, state, ec, UBI_CP_PEB_ERASE);
+	cp_mark_one(anchor, state, ec, UBI_CP_PEB_ERASE);
+
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb)
+		if (e->pnum >= UBI_CP_MAX_START)
+			n += 1;
+	stride = n / ubi->cp_pool_size;
+	if (stride < 1)
+		stride = 1;
+	i = 0;
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb) {
+		if (e->pnum < UBI_CP_MAX_START)
+			continue;
+		if (i++ % stride == 0 && pool < ubi->cp_pool_size) {
+			state[e->pnum] = UBI_CP_PEB_SCAN;
+			pool += 1;
+		}
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	dbg_wl("checkpoint PEB %d, pool of %d PEBs", anchor->pnum, pool);
+	return anchor;
+}
+
+/**
+ * ubi_wl_cp_done - finish writing a checkpoint.
+ * @ubi: UBI device description object
+ * @anchor: the WL entry returned by 'ubi_wl_cp_prepare()', may be %NULL if
+ *          @err is not zero
+ * @state: physical eraseblock states recorded in the checkpoint
+ * @err: zero if the checkpoint has been written, otherwise a negative error
+ *       code
+ *
+ * If the checkpoint has been written, this function makes it the current one:
+ * the physical eraseblocks of the pool become the only ones the WL sub-system
+ * hands out and the previous checkpoint is erased, which lets the deferred
+ * erasures go. Otherwise the previous checkpoint is dropped, because the
+ * caller may have given up a change of the flash it cannot describe.
+ */
+void ubi_wl_cp_done(struct ubi_device *ubi, struct ubi_wl_entry *anchor,
+		    const uint8_t *state, int err)
+{
+	int i, pool = 0;
+	struct rb_node *rb;
+	struct ubi_wl_entry *e, *old;
+	struct list_head erase[2];
+
+	if (err) {
+		if (anchor && __schedule_erase(ubi, anchor, err == -EIO)) {
+			kmem_cache_free(ubi_wl_entry_slab, anchor);
+			ubi_ro_mode(ubi);
+		}
+		cp_invalidate(ubi);
+		return;
+	}
+
+	spin_lock(&ubi->wl_lock);
+	old = ubi->cp_anchor;
+	ubi->cp_anchor = anchor;
+	for (i = 0; i < 2; i++) {
+		INIT_LIST_HEAD(&erase[i]);
+		list_splice_init(&ubi->cp_erase[i], &erase[i]);
+	}
+	ubi->cp_erase_count = 0;
+
+	rb = rb_first(&ubi->free);
+	while (rb) {
+		e = rb_entry(rb, struct ubi_wl_entry, u.rb);
+		rb = rb_next(rb);
+		if (state[e->pnum] == UBI_CP_PEB_SCAN) {
+			pool += 1;
+			continue;
+		}
+		free_tree_del(ubi, e);
+		wl_tree_add(e, &ubi->cp_free);
+	}
+
+	for (i = 0; i < ubi->peb_count; i++)
+		if (state[i] == UBI_CP_PEB_SCAN)
+			__set_bit(i, ubi->cp_scan);
+		else
+			__clear_bit(i, ubi->cp_scan);
+	ubi->cp_pool_count = pool;
+	ubi->cp_pool_low = pool / 4;
+	spin_unlock(&ubi->wl_lock);
+
+	if (old) {
+		/*
+		 * The old checkpoint has to go before anything it does not
+		 * describe happens, otherwise the next attach could pick it
+		 * up if the new one got lost.
+		 */
+		err = sync_erase(ubi, old, 0);
+		spin_lock(&ubi->wl_lock);
+		if (err) {
+			ubi_err("cannot erase checkpoint PEB %d, error %d",
+				old->pnum, err);
+			list_add_tail(&old->u.list, &ubi->cp_erase[1]);
+			ubi->cp_erase_count += 1;
+		} else
+			wl_tree_add(old, &ubi->cp_free);
+		spin_unlock(&ubi->wl_lock);
+		if (err)
+			ubi_ro_mode(ubi);
+	}
+
+	for (i = 0; i < 2; i++)
+		schedule_erase_list(ubi, &erase[i], i);
+}
+
 /**
  * tree_destroy - destroy an RB-tree.
  * @root: the root of the tree to destroy
@@ -1344,7 +1916,7 @@ int ubi_thread(void *u)
 
 	set_freezable();
 	for (;;) {
-		int err;
+		int err, cp;
 
 		if (kthread_should_stop())
 			break;
@@ -1353,16 +1925,24 @@ int ubi_thread(void *u)
 			continue;
 
 		spin_lock(&ubi->wl_lock);
-		if (list_empty(&ubi->works) || ubi->ro_mode ||
-			       !ubi->thread_enabled) {
+		if ((!next_work(ubi, 0) && !ubi->cp_needed) ||
+		    ubi->ro_mode || !ubi->thread_enabled) {
 			set_current_state(TASK_INTERRUPTIBLE);
 			spin_unlock(&ubi->wl_lock);
 			schedule();
 			continue;
 		}
+		cp = ubi->cp_needed;
 		spin_unlock(&ubi->wl_lock);
 
-		err = do_work(ubi);
+		if (cp) {
+			/* Failures are dealt with by dropping the checkpoint */
+			ubi_cp_write(ubi);
+			cond_resched();
+			continue;
+		}
+
+		err = do_work(ubi, 0);
 		if (err) {
 			ubi_err("%s: work failed with error code %d",
 				ubi->bgt_name, err);
@@ -1421,11 +2001,16 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	struct ubi_wl_entry *e;
 
 	ubi->used = ubi->erroneous = ubi->free = ubi->scrub = RB_ROOT;
+	ubi->cp_free = RB_ROOT;
+	INIT_LIST_HEAD(&ubi->cp_erase[0]);
+	INIT_LIST_HEAD(&ubi->cp_erase[1]);
 	spin_lock_init(&ubi->wl_lock);
 	mutex_init(&ubi->move_mutex);
 	init_rwsem(&ubi->work_sem);
 	ubi->max_ec = si->max_ec;
 	INIT_LIST_HEAD(&ubi->works);
+	ubi->erased_pool = max_t(int, WL_ERASED_POOL_MIN,
+				 ubi->peb_count * WL_ERASED_POOL_PER_1024 / 1024);
 
 	sprintf(ubi->bgt_name, UBI_BGT_NAME_PATTERN, ubi->ubi_num);
 
@@ -1464,7 +2049,7 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 		e->pnum = seb->pnum;
 		e->ec = seb->ec;
 		ubi_assert(e->ec >= 0);
-		wl_tree_add(e, &ubi->free);
+		free_tree_add(ubi, e);
 		ubi->lookuptbl[e->pnum] = e;
 	}
 
@@ -1554,6 +2139,9 @@ static void protection_queue_destroy(struct ubi_device *ubi)
  */
 void ubi_wl_close(struct ubi_device *ubi)
 {
+	int i;
+	struct ubi_wl_entry *e, *tmp;
+
 	dbg_wl("close the WL sub-system");
 	cancel_pending(ubi);
 	protection_queue_destroy(ubi);
@@ -1561,6 +2149,14 @@ void ubi_wl_close(struct ubi_device *ubi)
 	tree_destroy(&ubi->erroneous);
 	tree_destroy(&ubi->free);
 	tree_destroy(&ubi->scrub);
+	tree_destroy(&ubi->cp_free);
+	for (i = 0; i < 2; i++)
+		list_for_each_entry_safe(e, tmp, &ubi->cp_erase[i], u.list) {
+			list_del(&e->u.list);
+			kmem_cache_free(ubi_wl_entry_slab, e);
+		}
+	if (ubi->cp_anchor)
+		kmem_cache_free(ubi_wl_entry_slab, ubi->cp_anchor);
 	kfree(ubi->lookuptbl);
 }
 
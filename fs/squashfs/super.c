@@ -36,6 +36,7 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/magic.h>
+#include <linux/cleancache.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -288,6 +289,8 @@ allocate_root:
 		goto failed_mount;
 	}
 
+	cleancache_init_fs(sb);
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
@@ -594,6 +594,61 @@ void ubifs_convert_page_budget(struct ubifs_info *c)
 	spin_unlock(&c->space_lock);
 }
 
+/**
+ * ubifs_budget_pages - budget for several new pages of data at once.
+ * @c: UBIFS file-system description object
+ * @cnt: how many pages to budget for
+ *
+ * This function acquires the same budget as @cnt 'ubifs_budget_space()' calls
+ * with @new_page set would do, but takes @c->space_lock only once. Like the
+ * "fast" budgeting, it does not force write-back, commit or garbage
+ * collection, so it may be called by the write path before any page is
+ * locked. Returns zero in case of success and %-ENOSPC if there is not enough
+ * space, in which case the caller is expected to budget for each page
+ * separately.
+ */
+int ubifs_budget_pages(struct ubifs_info *c, int cnt)
+{
+	int err, idx_growth, data_growth;
+
+	idx_growth = cnt * (c->max_idx_node_sz << UBIFS_BLOCKS_PER_PAGE_SHIFT);
+	data_growth = cnt * c->page_budget;
+
+	spin_lock(&c->space_lock);
+	if (unlikely(c->nospace)) {
+		spin_unlock(&c->space_lock);
+		return -ENOSPC;
+	}
+
+	c->budg_idx_growth += idx_growth;
+	c->budg_data_growth += data_growth;
+	err = do_budget_space(c);
+	if (err) {
+		c->budg_idx_growth -= idx_growth;
+		c->budg_data_growth -= data_growth;
+	}
+	spin_unlock(&c->space_lock);
+	return err;
+}
+
+/**
+ * ubifs_release_pages_budget - release budget of several new pages.
+ * @c: UBIFS file-system description object
+ * @cnt: how many pages to release the budget of
+ *
+ * This function releases budget acquired by 'ubifs_budget_pages()' which has
+ * not been used.
+ */
+void ubifs_release_pages_budget(struct ubifs_info *c, int cnt)
+{
+	struct ubifs_budget_req req;
+
+	memset(&req, 0, sizeof(struct ubifs_budget_req));
+	req.idx_growth = cnt * (c->max_idx_node_sz << UBIFS_BLOCKS_PER_PAGE_SHIFT);
+	req.data_growth = cnt * c->page_budget;
+	ubifs_release_budget(c, &req);
+}
+
 /**
  * ubifs_release_dirty_inode_budget - release dirty inode budget.
  * @c: UBIFS file-system description object
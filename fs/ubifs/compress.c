@@ -133,6 +133,71 @@ no_compr:
 	*compr_type = UBIFS_COMPR_NONE;
 }
 
+/**
+ * ubifs_compress_data - compress a data block of an inode.
+ * @c: UBIFS file-system description object
+ * @ui: UBIFS inode the data belongs to
+ * @in_buf: data to compress
+ * @in_len: length of the data to compress
+ * @out_buf: output buffer where compressed data should be stored
+ * @out_len: output buffer length is returned here
+ * @compr_type: actually used compression type is returned here
+ *
+ * This function picks the compressor according to the compression policy of
+ * inode @ui, compresses the data using 'ubifs_compress()' and accounts the
+ * result in the compression statistics.
+ *
+ * If the inode is in "auto" compression mode and a block does not compress,
+ * the following blocks are stored uncompressed without trying. The number of
+ * skipped blocks doubles every time the next tried block does not compress
+ * either, up to %UBIFS_COMPR_MAX_SKIP, and is reset once a block compresses.
+ * This saves CPU time when already compressed data are written.
+ */
+void ubifs_compress_data(struct ubifs_info *c, struct ubifs_inode *ui,
+			 const void *in_buf, int in_len, void *out_buf,
+			 int *out_len, int *compr_type)
+{
+	int type, skipped = 0, failed = 0;
+
+	if (!(ui->flags & UBIFS_COMPR_FL))
+		type = UBIFS_COMPR_NONE;
+	else
+		type = ui->compr_type;
+
+	*compr_type = type;
+	if (type != UBIFS_COMPR_NONE && (ui->flags & UBIFS_COMPR_AUTO_FL) &&
+	    ui->compr_skip) {
+		ui->compr_skip -= 1;
+		*compr_type = UBIFS_COMPR_NONE;
+		skipped = 1;
+	}
+
+	ubifs_compress(in_buf, in_len, out_buf, out_len, compr_type);
+
+	if (type != UBIFS_COMPR_NONE && !skipped &&
+	    in_len >= UBIFS_MIN_COMPR_LEN) {
+		if (*compr_type == UBIFS_COMPR_NONE) {
+			failed = 1;
+			if (ui->flags & UBIFS_COMPR_AUTO_FL) {
+				ui->compr_backoff = ui->compr_backoff ?
+					min_t(unsigned int, ui->compr_backoff * 2,
+					      UBIFS_COMPR_MAX_SKIP) : 1;
+				ui->compr_skip = ui->compr_backoff;
+			}
+		} else
+			ui->compr_backoff = 0;
+	}
+
+	spin_lock(&c->compr_lock);
+	c->compr_stats.in_bytes[type] += in_len;
+	c->compr_stats.out_bytes[type] += *out_len;
+	if (failed)
+		c->compr_stats.failed_bytes[type] += in_len;
+	if (skipped)
+		c->compr_stats.skipped_bytes[type] += in_len;
+	spin_unlock(&c->compr_lock);
+}
+
 /**
  * ubifs_decompress - decompress data.
  * @in_buf: data to decompress
@@ -51,6 +51,7 @@
  * parent directory inode @dir. UBIFS inodes inherit the following flags:
  * o %UBIFS_COMPR_FL, which is useful to switch compression on/of on
  *   sub-directory basis;
+ * o %UBIFS_COMPR_AUTO_FL - useful for the same reasons;
  * o %UBIFS_SYNC_FL - useful for the same reasons;
  * o %UBIFS_DIRSYNC_FL - similar, but relevant only to directories.
  *
@@ -68,7 +69,8 @@ static int inherit_flags(const struct inode *dir, int mode)
 		 */
 		return 0;
 
-	flags = ui->flags & (UBIFS_COMPR_FL | UBIFS_SYNC_FL | UBIFS_DIRSYNC_FL);
+	flags = ui->flags & (UBIFS_COMPR_FL | UBIFS_COMPR_AUTO_FL |
+			     UBIFS_SYNC_FL | UBIFS_DIRSYNC_FL);
 	if (!S_ISDIR(mode))
 		/* The "DIRSYNC" flag only applies to directories */
 		flags &= ~UBIFS_DIRSYNC_FL;
@@ -144,7 +146,15 @@ struct inode *ubifs_new_inode(struct ubifs_info *c, const struct inode *dir,
 
 	ui->flags = inherit_flags(dir, mode);
 	ubifs_set_inode_flags(inode);
-	if (S_ISREG(mode))
+	/*
+	 * A directory with a compressor set passes it on to new files and
+	 * sub-directories, otherwise files use the default compressor.
+	 */
+	if (S_ISDIR(dir->i_mode) &&
+	    ubifs_inode(dir)->compr_type != UBIFS_COMPR_NONE &&
+	    (S_ISREG(mode) || S_ISDIR(mode)))
+		ui->compr_type = ubifs_inode(dir)->compr_type;
+	else if (S_ISREG(mode))
 		ui->compr_type = c->default_compr;
 	else
 		ui->compr_type = UBIFS_COMPR_NONE;
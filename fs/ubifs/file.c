@@ -46,7 +46,8 @@
  * Similarly, @i_mutex is not always locked in 'ubifs_readpage()', e.g., the
  * read-ahead path does not lock it ("sys_read -> generic_file_aio_read ->
  * ondemand_readahead -> readpage"). In case of readahead, @I_LOCK flag is not
- * set as well. However, UBIFS disables readahead.
+ * set as well. UBIFS enables readahead only when bulk-read is enabled, and
+ * serves it in 'ubifs_readpages()' by means of bulk-reads.
  */
 
 #include "ubifs.h"
@@ -327,6 +328,7 @@ static int allocate_budget(struct ubifs_info *c, struct page *page,
 			   struct ubifs_inode *ui, int appending)
 {
 	struct ubifs_budget_req req = { .fast = 1 };
+	int err, reserved;
 
 	if (PagePrivate(page)) {
 		if (!appending)
@@ -384,7 +386,39 @@ static int allocate_budget(struct ubifs_info *c, struct page *page,
 		}
 	}
 
-	return ubifs_budget_space(c, &req);
+	/*
+	 * If 'ubifs_aio_write()' budgeted for pages in advance, use one of
+	 * them instead of budgeting for this page. A new page budget is
+	 * bigger than a changed page budget, so it is converted if the page
+	 * exists on the media.
+	 */
+	reserved = 0;
+	if (req.new_page || req.dirtied_page) {
+		spin_lock(&ui->ui_lock);
+		if (ui->page_rsv > 0) {
+			ui->page_rsv -= 1;
+			reserved = 1;
+		}
+		spin_unlock(&ui->ui_lock);
+	}
+	if (!reserved)
+		return ubifs_budget_space(c, &req);
+
+	if (req.dirtied_page) {
+		ubifs_convert_page_budget(c);
+		req.dirtied_page = 0;
+	} else
+		req.new_page = 0;
+
+	err = ubifs_budget_space(c, &req);
+	if (err) {
+		/* The slow path budgets for the page again */
+		if (PageChecked(page))
+			release_new_page_budget(c);
+		else
+			release_existing_page_budget(c);
+	}
+	return err;
 }
 
 /*
@@ -887,6 +921,182 @@ static int ubifs_readpage(struct file *file, struct page *page)
 	return 0;
 }
 
+/**
+ * readahead_bulk - bulk-read data nodes starting from a read-ahead page.
+ * @c: UBIFS file-system description object
+ * @bu: bulk-read information
+ * @inode: inode to read from
+ * @index: index of the first page to read
+ *
+ * This is a helper function for 'ubifs_readpages()' which reads in one go
+ * consecutive data nodes starting from page @index. If @bu has no buffer
+ * attached, it is allocated. Returns the number of pages covered by the
+ * bulk-read, %0 if the data nodes are not suitable for bulk-read, and a
+ * negative error code in case of failure.
+ */
+static int readahead_bulk(struct ubifs_info *c, struct bu_info *bu,
+			  struct inode *inode, pgoff_t index)
+{
+	int err, page_cnt;
+
+	data_key_init(c, &bu->key, inode->i_ino,
+		      index << UBIFS_BLOCKS_PER_PAGE_SHIFT);
+	err = ubifs_tnc_get_bu_keys(c, bu);
+	if (err)
+		return err;
+
+	page_cnt = bu->blk_cnt >> UBIFS_BLOCKS_PER_PAGE_SHIFT;
+	if (!page_cnt || !bu->cnt)
+		return page_cnt;
+
+	if (!bu->buf) {
+		bu->buf = kmalloc(bu->buf_len, GFP_NOFS | __GFP_NOWARN);
+		if (!bu->buf)
+			return -ENOMEM;
+	}
+
+	err = ubifs_tnc_bulk_read(c, bu);
+	if (err)
+		return err;
+	return page_cnt;
+}
+
+/**
+ * readahead_tail - add the rest of a bulk-read to the page cache.
+ * @c: UBIFS file-system description object
+ * @bu: bulk-read information
+ * @mapping: address space of the file
+ * @index: index of the first page after the read-ahead window
+ * @end: index of the first page not covered by the bulk-read
+ * @n: index of the next data node in @bu to use
+ *
+ * The last bulk-read of a read-ahead window usually covers pages beyond the
+ * window. They have been read from the media already, so this helper function
+ * of 'ubifs_readpages()' puts them to the page cache, like
+ * 'ubifs_do_bulk_read()' does, instead of letting the next window read them
+ * again.
+ */
+static void readahead_tail(struct ubifs_info *c, struct bu_info *bu,
+			   struct address_space *mapping, pgoff_t index,
+			   pgoff_t end, int *n)
+{
+	struct inode *inode = mapping->host;
+	loff_t isize = i_size_read(inode);
+	pgoff_t end_index;
+	int err = 0;
+
+	if (isize == 0)
+		return;
+	end_index = ((isize - 1) >> PAGE_CACHE_SHIFT);
+	if (end > end_index + 1)
+		end = end_index + 1;
+
+	for (; index < end && !err; index++) {
+		struct page *page;
+
+		page = find_or_create_page(mapping, index,
+					   GFP_NOFS | __GFP_COLD);
+		if (!page)
+			break;
+		if (!PageUptodate(page))
+			err = populate_page(c, page, bu, n);
+		unlock_page(page);
+		page_cache_release(page);
+		ubifs_inode(inode)->last_page_read = index;
+	}
+}
+
+/**
+ * ubifs_readpages - read pages for read-ahead.
+ * @file: file to read from
+ * @mapping: address space of the file
+ * @pages: list of pages to read
+ * @nr_pages: number of pages in @pages
+ *
+ * The VFS read-ahead code calls this function with a window of pages which
+ * grows while the file is read sequentially, and it calls it in advance,
+ * before the reader gets to the pages. This function reads the pages using as
+ * few bulk-reads as possible. Pages which cannot be bulk-read, e.g. because
+ * their data nodes are scattered, are read one by one.
+ */
+static int ubifs_readpages(struct file *file, struct address_space *mapping,
+			   struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct ubifs_inode *ui = ubifs_inode(inode);
+	struct bu_info *bu = NULL;
+	pgoff_t bu_first = 0, bu_end = 0, last = 0;
+	int err, n = 0, allocated = 0, tail = 0;
+
+	dbg_gen("ino %lu, %u pages", inode->i_ino, nr_pages);
+
+	/* Like in 'ubifs_bulk_read()', @ui->ui_mutex protects bulk-read */
+	if (c->bulk_read && mutex_trylock(&ui->ui_mutex)) {
+		if (mutex_trylock(&c->bu_mutex)) {
+			bu = &c->bu;
+			bu->buf_len = c->max_bu_buf_len;
+		} else {
+			bu = kmalloc(sizeof(struct bu_info),
+				     GFP_NOFS | __GFP_NOWARN);
+			if (bu) {
+				bu->buf = NULL;
+				bu->buf_len = c->max_bu_buf_len;
+				allocated = 1;
+			} else
+				mutex_unlock(&ui->ui_mutex);
+		}
+	}
+
+	while (!list_empty(pages)) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					  GFP_NOFS)) {
+			page_cache_release(page);
+			continue;
+		}
+
+		if (bu && (page->index < bu_first || page->index >= bu_end)) {
+			err = readahead_bulk(c, bu, inode, page->index);
+			if (err < 0) {
+				ubifs_warn("ignoring error %d and skipping "
+					   "bulk-read", err);
+				err = 0;
+			}
+			n = 0;
+			bu_first = page->index;
+			bu_end = page->index + err;
+			/* Beyond the last data node there are only holes */
+			if (err && bu->eof)
+				bu_end = ULONG_MAX;
+		}
+
+		tail = bu && page->index < bu_end;
+		if (tail)
+			populate_page(c, page, bu, &n);
+		else
+			do_readpage(page);
+
+		last = ui->last_page_read = page->index;
+		unlock_page(page);
+		page_cache_release(page);
+	}
+
+	if (bu) {
+		if (tail)
+			readahead_tail(c, bu, mapping, last + 1, bu_end, &n);
+		if (allocated) {
+			kfree(bu->buf);
+			kfree(bu);
+		} else
+			mutex_unlock(&c->bu_mutex);
+		mutex_unlock(&ui->ui_mutex);
+	}
+	return 0;
+}
+
 static int do_writepage(struct page *page, int len)
 {
 	int err = 0, i, blen;
@@ -1388,10 +1598,71 @@ static int update_mctime(struct ubifs_info *c, struct inode *inode)
 	return 0;
 }
 
+/**
+ * reserve_page_budgets - budget for the pages of a multi-page write.
+ * @c: UBIFS file-system description object
+ * @inode: inode written to
+ * @pos: position in the file the write starts at
+ * @len: length of the write
+ *
+ * Budgeting each page in 'ubifs_write_begin()' is relatively expensive for
+ * large sequential writes, so this function budgets for all the pages of a
+ * write in one go and puts them to the @ui->page_rsv reserve, where
+ * 'ubifs_write_begin()' takes them from. Returns the number of budgeted pages,
+ * which may be zero.
+ */
+static int reserve_page_budgets(struct ubifs_info *c, struct inode *inode,
+				loff_t pos, size_t len)
+{
+	struct ubifs_inode *ui = ubifs_inode(inode);
+	size_t cnt;
+
+	cnt = ((pos & ~PAGE_CACHE_MASK) + len + PAGE_CACHE_SIZE - 1) >>
+	      PAGE_CACHE_SHIFT;
+	if (cnt < 2)
+		return 0;
+	if (cnt > UBIFS_MAX_BUDGET_BATCH)
+		cnt = UBIFS_MAX_BUDGET_BATCH;
+
+	if (ubifs_budget_pages(c, cnt))
+		return 0;
+
+	spin_lock(&ui->ui_lock);
+	ui->page_rsv += cnt;
+	spin_unlock(&ui->ui_lock);
+	return cnt;
+}
+
+/**
+ * release_page_budgets - release unused page budgets of a multi-page write.
+ * @c: UBIFS file-system description object
+ * @inode: inode written to
+ * @cnt: number of pages 'reserve_page_budgets()' budgeted for
+ *
+ * Concurrent writers share the reserve, so at most @cnt pages are released,
+ * but possibly less if another writer used some of them. Each writer releases
+ * at most what it added, which makes sure the reserve is empty once the last
+ * writer is done.
+ */
+static void release_page_budgets(struct ubifs_info *c, struct inode *inode,
+				 int cnt)
+{
+	struct ubifs_inode *ui = ubifs_inode(inode);
+
+	spin_lock(&ui->ui_lock);
+	if (cnt > ui->page_rsv)
+		cnt = ui->page_rsv;
+	ui->page_rsv -= cnt;
+	spin_unlock(&ui->ui_lock);
+
+	if (cnt)
+		ubifs_release_pages_budget(c, cnt);
+}
+
 static ssize_t ubifs_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			       unsigned long nr_segs, loff_t pos)
 {
-	int err;
+	int err, rsv;
 	ssize_t ret;
 	struct inode *inode = iocb->ki_filp->f_mapping->host;
 	struct ubifs_info *c = inode->i_sb->s_fs_info;
@@ -1400,7 +1671,10 @@ static ssize_t ubifs_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (err)
 		return err;
 
+	rsv = reserve_page_budgets(c, inode, pos, iov_length(iov, nr_segs));
 	ret = generic_file_aio_write(iocb, iov, nr_segs, pos);
+	if (rsv)
+		release_page_budgets(c, inode, rsv);
 	if (ret < 0)
 		return ret;
 
@@ -1556,6 +1830,7 @@ static int ubifs_file_mmap(struct file *file, struct vm_area_struct *vma)
 
 const struct address_space_operations ubifs_file_address_operations = {
 	.readpage       = ubifs_readpage,
+	.readpages      = ubifs_readpages,
 	.writepage      = ubifs_writepage,
 	.write_begin    = ubifs_write_begin,
 	.write_end      = ubifs_write_end,
@@ -22,7 +22,10 @@
  *          Adrian Hunter
  */
 
-/* This file implements EXT2-compatible extended attribute ioctl() calls */
+/*
+ * This file implements EXT2-compatible extended attribute ioctl() calls and
+ * the UBIFS-specific compression control ioctl() calls.
+ */
 
 #include <linux/compat.h>
 #include <linux/mount.h>
@@ -124,7 +127,7 @@ static int setflags(struct inode *inode, int flags)
 		}
 	}
 
-	ui->flags = ioctl2ubifs(flags);
+	ui->flags = ioctl2ubifs(flags) | (ui->flags & UBIFS_COMPR_AUTO_FL);
 	ubifs_set_inode_flags(inode);
 	inode->i_ctime = ubifs_current_time(inode);
 	release = ui->dirty;
@@ -144,6 +147,88 @@ out_unlock:
 	return err;
 }
 
+/**
+ * ubifs_get_compr - get compression policy of an inode.
+ * @inode: inode to get the policy of
+ *
+ * This function returns the compressor type used for data of @inode
+ * (%UBIFS_COMPR_NONE, etc), or-ed with %UBIFS_IOC_COMPR_AUTO if the inode is
+ * in "auto" compression mode. For directories, this is the policy new files
+ * inherit.
+ */
+int ubifs_get_compr(const struct inode *inode)
+{
+	const struct ubifs_inode *ui = ubifs_inode(inode);
+	const struct ubifs_info *c = inode->i_sb->s_fs_info;
+	int policy;
+
+	if (!(ui->flags & UBIFS_COMPR_FL))
+		return UBIFS_COMPR_NONE;
+
+	policy = ui->compr_type;
+	if (S_ISDIR(inode->i_mode) && policy == UBIFS_COMPR_NONE)
+		policy = c->default_compr;
+	if (ui->flags & UBIFS_COMPR_AUTO_FL)
+		policy |= UBIFS_IOC_COMPR_AUTO;
+	return policy;
+}
+
+/**
+ * ubifs_set_compr - set compression policy of an inode.
+ * @inode: regular file or directory inode to change
+ * @policy: compressor type (%UBIFS_COMPR_NONE, etc), optionally or-ed with
+ *          %UBIFS_IOC_COMPR_AUTO
+ *
+ * This function sets the compressor used for data written to @inode from now
+ * on. Data which is already on the flash is not re-compressed. Directories
+ * pass the policy on to the files created in them. Returns zero in case of
+ * success and a negative error code in case of failure.
+ */
+int ubifs_set_compr(struct inode *inode, int policy)
+{
+	int err, release, type = policy & ~UBIFS_IOC_COMPR_AUTO;
+	struct ubifs_inode *ui = ubifs_inode(inode);
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct ubifs_budget_req req = { .dirtied_ino = 1,
+					.dirtied_ino_d = ui->data_len };
+
+	if (!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode))
+		return -EINVAL;
+	if (type < 0 || type >= UBIFS_COMPR_TYPES_CNT)
+		return -EINVAL;
+	if (type == UBIFS_COMPR_NONE && policy != type)
+		return -EINVAL;
+	if (!ubifs_compr_present(type))
+		return -EOPNOTSUPP;
+
+	err = ubifs_budget_space(c, &req);
+	if (err)
+		return err;
+
+	mutex_lock(&ui->ui_mutex);
+	if (type == UBIFS_COMPR_NONE)
+		ui->flags &= ~(UBIFS_COMPR_FL | UBIFS_COMPR_AUTO_FL);
+	else {
+		ui->flags |= UBIFS_COMPR_FL;
+		if (policy & UBIFS_IOC_COMPR_AUTO)
+			ui->flags |= UBIFS_COMPR_AUTO_FL;
+		else
+			ui->flags &= ~UBIFS_COMPR_AUTO_FL;
+		ui->compr_type = type;
+	}
+	ui->compr_skip = ui->compr_backoff = 0;
+	inode->i_ctime = ubifs_current_time(inode);
+	release = ui->dirty;
+	mark_inode_dirty_sync(inode);
+	mutex_unlock(&ui->ui_mutex);
+
+	if (release)
+		ubifs_release_budget(c, &req);
+	if (IS_SYNC(inode))
+		err = write_inode_now(inode, 1);
+	return err;
+}
+
 long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	int flags, err;
@@ -182,6 +267,43 @@ long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return err;
 	}
 
+	case UBIFS_IOC_GETCOMPR:
+		return put_user(ubifs_get_compr(inode), (int __user *) arg);
+
+	case UBIFS_IOC_SETCOMPR: {
+		if (IS_RDONLY(inode))
+			return -EROFS;
+
+		if (!is_owner_or_cap(inode))
+			return -EACCES;
+
+		if (IS_IMMUTABLE(inode))
+			return -EPERM;
+
+		if (get_user(flags, (int __user *) arg))
+			return -EFAULT;
+
+		err = mnt_want_write(file->f_path.mnt);
+		if (err)
+			return err;
+		dbg_gen("set compression policy: %#x", flags);
+		err = ubifs_set_compr(inode, flags);
+		mnt_drop_write(file->f_path.mnt);
+		return err;
+	}
+
+	case UBIFS_IOC_COMPR_STATS: {
+		struct ubifs_info *c = inode->i_sb->s_fs_info;
+		struct ubifs_compr_stats st;
+
+		spin_lock(&c->compr_lock);
+		st = c->compr_stats;
+		spin_unlock(&c->compr_lock);
+		if (copy_to_user((void __user *) arg, &st, sizeof(st)))
+			return -EFAULT;
+		return 0;
+	}
+
 	default:
 		return -ENOTTY;
 	}
@@ -197,6 +319,10 @@ long ubifs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case FS_IOC32_SETFLAGS:
 		cmd = FS_IOC_SETFLAGS;
 		break;
+	case UBIFS_IOC_GETCOMPR:
+	case UBIFS_IOC_SETCOMPR:
+	case UBIFS_IOC_COMPR_STATS:
+		break;
 	default:
 		return -ENOIOCTLCMD;
 	}
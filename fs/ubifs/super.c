@@ -1100,6 +1100,9 @@ again:
 		c->bulk_read = 0;
 		return;
 	}
+
+	/* Bulk-read makes read-ahead worth it, see 'ubifs_readpages()' */
+	c->bdi.ra_pages = UBIFS_READAHEAD_SZ >> PAGE_CACHE_SHIFT;
 }
 
 /**
@@ -1817,6 +1820,7 @@ static int ubifs_remount_fs(struct super_block *sb, int *flags, char *data)
 		bu_init(c);
 	else {
 		dbg_gen("disable bulk-read");
+		c->bdi.ra_pages = 0;
 		kfree(c->bu.buf);
 		c->bu.buf = NULL;
 	}
@@ -1902,6 +1906,7 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 		return -ENOMEM;
 
 	spin_lock_init(&c->cnt_lock);
+	spin_lock_init(&c->compr_lock);
 	spin_lock_init(&c->cs_lock);
 	spin_lock_init(&c->buds_lock);
 	spin_lock_init(&c->space_lock);
@@ -1951,7 +1956,9 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 	 * which means the user would have to wait not just for their own I/O
 	 * but the read-ahead I/O as well i.e. completely pointless.
 	 *
-	 * Read-ahead will be disabled because @c->bdi.ra_pages is 0.
+	 * Read-ahead is disabled because @c->bdi.ra_pages is 0. The exception
+	 * is bulk-read mode, where read-ahead is served by large bulk-reads,
+	 * see 'bu_init()'.
 	 */
 	c->bdi.name = "ubifs",
 	c->bdi.capabilities = BDI_CAP_MAP_COPY;
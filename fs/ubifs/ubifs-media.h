@@ -309,6 +309,8 @@ enum {
  * UBIFS_APPEND_FL: writes to the inode may only append data
  * UBIFS_DIRSYNC_FL: I/O on this directory inode has to be synchronous
  * UBIFS_XATTR_FL: this inode is the inode for an extended attribute value
+ * UBIFS_COMPR_AUTO_FL: stop compressing data blocks for a while once they
+ *                      turn out to be incompressible
  *
  * Note, these are on-flash flags which correspond to ioctl flags
  * (@FS_COMPR_FL, etc). They have the same values now, but generally, do not
@@ -321,10 +323,11 @@ enum {
 	UBIFS_APPEND_FL    = 0x08,
 	UBIFS_DIRSYNC_FL   = 0x10,
 	UBIFS_XATTR_FL     = 0x20,
+	UBIFS_COMPR_AUTO_FL = 0x40,
 };
 
 /* Inode flag bits used by UBIFS */
-#define UBIFS_FL_MASK 0x0000001F
+#define UBIFS_FL_MASK 0x0000005F
 
 /*
  * UBIFS compression algorithms.
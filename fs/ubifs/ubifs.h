@@ -152,6 +152,44 @@
 /* Maximum number of data nodes to bulk-read */
 #define UBIFS_MAX_BULK_READ 32
 
+/*
+ * Read-ahead window used when bulk-read is enabled. It is larger than one
+ * bulk-read, so that one read-ahead request is served by several bulk-reads.
+ */
+#define UBIFS_READAHEAD_SZ (4 * UBIFS_MAX_BULK_READ * UBIFS_BLOCK_SIZE)
+
+/*
+ * Maximum number of pages 'ubifs_aio_write()' budgets for in advance, in one
+ * go, instead of budgeting each page separately in 'ubifs_write_begin()'.
+ */
+#define UBIFS_MAX_BUDGET_BATCH 64
+
+/*
+ * Maximum number of data blocks which are written uncompressed after an
+ * incompressible one when the inode is in "auto" compression mode.
+ */
+#define UBIFS_COMPR_MAX_SKIP 64
+
+/* Name of the virtual extended attribute holding the compression policy */
+#define UBIFS_COMPR_XATTR "ubifs.compression"
+
+/*
+ * UBIFS-specific ioctl commands.
+ *
+ * UBIFS_IOC_GETCOMPR: get the compression policy of an inode
+ * UBIFS_IOC_SETCOMPR: set the compression policy of an inode
+ * UBIFS_IOC_COMPR_STATS: get the file-system compression statistics
+ *
+ * The compression policy is a compressor type (%UBIFS_COMPR_NONE, etc),
+ * optionally or-ed with %UBIFS_IOC_COMPR_AUTO.
+ */
+#define UBIFS_IOC_MAGIC 'u'
+#define UBIFS_IOC_GETCOMPR    _IOR(UBIFS_IOC_MAGIC, 1, int)
+#define UBIFS_IOC_SETCOMPR    _IOW(UBIFS_IOC_MAGIC, 2, int)
+#define UBIFS_IOC_COMPR_STATS _IOR(UBIFS_IOC_MAGIC, 3, struct ubifs_compr_stats)
+
+#define UBIFS_IOC_COMPR_AUTO 0x100
+
 /*
  * Lockdep classes for UBIFS inode @ui_mutex.
  */
@@ -342,13 +380,19 @@ struct ubifs_gced_idx_leb {
  * @ui_mutex: serializes inode write-back with the rest of VFS operations,
  *            serializes "clean <-> dirty" state changes, serializes bulk-read,
  *            protects @dirty, @bulk_read, @ui_size, and @xattr_size
- * @ui_lock: protects @synced_i_size
+ * @ui_lock: protects @synced_i_size and @page_rsv
  * @synced_i_size: synchronized size of inode, i.e. the value of inode size
  *                 currently stored on the flash; used only for regular file
  *                 inodes
  * @ui_size: inode size used by UBIFS when writing to flash
+ * @page_rsv: how many new page budgets were acquired in advance by a
+ *            multi-page write and are not used yet
  * @flags: inode flags (@UBIFS_COMPR_FL, etc)
  * @compr_type: default compression type used for this inode
+ * @compr_skip: how many more data blocks to write uncompressed in "auto"
+ *              compression mode
+ * @compr_backoff: how many data blocks were skipped last time a block did not
+ *                 compress
  * @last_page_read: page number of last page read (for bulk read)
  * @read_in_a_row: number of consecutive pages read in a row (for bulk read)
  * @data_len: length of the data attached to the inode
@@ -371,6 +415,10 @@ struct ubifs_gced_idx_leb {
  * So UBIFS has its own inode dirty flag and its own mutex to serialize
  * "clean <-> dirty" transitions.
  *
+ * @compr_skip and @compr_backoff are only hints and are changed without any
+ * locking, which is fine because pages of the same inode are rarely written
+ * back concurrently, and a lost update only affects compression ratio.
+ *
  * The @synced_i_size field is used to make sure we never write pages which are
  * beyond last synchronized inode size. See 'ubifs_writepage()' for more
  * information.
@@ -398,7 +446,10 @@ struct ubifs_inode {
 	spinlock_t ui_lock;
 	loff_t synced_i_size;
 	loff_t ui_size;
+	int page_rsv;
 	int flags;
+	unsigned int compr_skip;
+	unsigned int compr_backoff;
 	pgoff_t last_page_read;
 	pgoff_t read_in_a_row;
 	int data_len;
@@ -822,6 +873,27 @@ struct ubifs_compressor {
 	const char *capi_name;
 };
 
+/**
+ * struct ubifs_compr_stats - data compression statistics.
+ * @in_bytes: bytes of data written to inodes using each compressor
+ * @out_bytes: bytes of data node payload produced for @in_bytes
+ * @failed_bytes: bytes of data which did not compress and were stored
+ *                uncompressed
+ * @skipped_bytes: bytes of data stored uncompressed without trying, because
+ *                 the inode is in "auto" mode and the previous data did not
+ *                 compress
+ *
+ * All the arrays are indexed by the compressor the inode asks for
+ * (%UBIFS_COMPR_NONE, etc), not by the one which ended up being used. This
+ * structure is also returned by the %UBIFS_IOC_COMPR_STATS ioctl.
+ */
+struct ubifs_compr_stats {
+	__u64 in_bytes[UBIFS_COMPR_TYPES_CNT];
+	__u64 out_bytes[UBIFS_COMPR_TYPES_CNT];
+	__u64 failed_bytes[UBIFS_COMPR_TYPES_CNT];
+	__u64 skipped_bytes[UBIFS_COMPR_TYPES_CNT];
+};
+
 /**
  * struct ubifs_budget_req - budget requirements of an operation.
  *
@@ -937,6 +1009,8 @@ struct ubifs_debug_info;
  * @cmt_no: commit number of the last successfully completed commit, protected
  *          by @commit_sem
  * @cnt_lock: protects @highest_inum and @max_sqnum counters
+ * @compr_lock: protects @compr_stats
+ * @compr_stats: data compression statistics
  * @fmt_version: UBIFS on-flash format version
  * @ro_compat_version: R/O compatibility version
  * @uuid: UUID from super block
@@ -1184,6 +1258,8 @@ struct ubifs_info {
 	unsigned long long max_sqnum;
 	unsigned long long cmt_no;
 	spinlock_t cnt_lock;
+	spinlock_t compr_lock;
+	struct ubifs_compr_stats compr_stats;
 	int fmt_version;
 	int ro_compat_version;
 	unsigned char uuid[16];
@@ -1495,6 +1571,8 @@ int ubifs_jnl_change_xattr(struct ubifs_info *c, const struct inode *inode1,
 /* budget.c */
 int ubifs_budget_space(struct ubifs_info *c, struct ubifs_budget_req *req);
 void ubifs_release_budget(struct ubifs_info *c, struct ubifs_budget_req *req);
+int ubifs_budget_pages(struct ubifs_info *c, int cnt);
+void ubifs_release_pages_budget(struct ubifs_info *c, int cnt);
 void ubifs_release_dirty_inode_budget(struct ubifs_info *c,
 				      struct ubifs_inode *ui);
 int ubifs_budget_inode_op(struct ubifs_info *c, struct inode *inode,
@@ -1715,6 +1793,8 @@ void ubifs_destroy_size_tree(struct ubifs_info *c);
 /* ioctl.c */
 long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 void ubifs_set_inode_flags(struct inode *inode);
+int ubifs_get_compr(const struct inode *inode);
+int ubifs_set_compr(struct inode *inode, int policy);
 #ifdef CONFIG_COMPAT
 long ubifs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 #endif
@@ -1724,6 +1804,9 @@ int __init ubifs_compressors_init(void);
 void ubifs_compressors_exit(void);
 void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 		    int *compr_type);
+void ubifs_compress_data(struct ubifs_info *c, struct ubifs_inode *ui,
+			 const void *in_buf, int in_len, void *out_buf,
+			 int *out_len, int *compr_type);
 int ubifs_decompress(const void *buf, int len, void *out, int *out_len,
 		     int compr_type);
 
@@ -294,6 +294,68 @@ static struct inode *iget_xattr(struct ubifs_info *c, ino_t inum)
 	return ERR_PTR(-EINVAL);
 }
 
+/*
+ * The compression policy of an inode is exposed as the virtual
+ * "ubifs.compression" extended attribute, which is not stored on the flash.
+ * Its value is a compressor name ("none", "lzo" or "zlib"), optionally
+ * followed by ",auto" to switch "auto" compression mode on. Just "auto"
+ * means "auto" mode with the default compressor.
+ */
+static int set_compr_xattr(struct inode *host, const void *value, size_t size)
+{
+	struct ubifs_info *c = host->i_sb->s_fs_info;
+	char str[16], *p;
+	int i, policy = 0;
+
+	if (!is_owner_or_cap(host))
+		return -EACCES;
+
+	if (size == 0 || size >= sizeof(str))
+		return -EINVAL;
+	memcpy(str, value, size);
+	str[size] = '\0';
+
+	p = strchr(str, ',');
+	if (p) {
+		if (strcmp(p, ",auto"))
+			return -EINVAL;
+		*p = '\0';
+		policy = UBIFS_IOC_COMPR_AUTO;
+	}
+
+	if (!strcmp(str, "auto")) {
+		if (policy)
+			return -EINVAL;
+		policy = UBIFS_IOC_COMPR_AUTO | c->default_compr;
+	} else {
+		for (i = 0; i < UBIFS_COMPR_TYPES_CNT; i++)
+			if (!strcmp(str, ubifs_compr_name(i)))
+				break;
+		if (i == UBIFS_COMPR_TYPES_CNT)
+			return -EINVAL;
+		policy |= i;
+	}
+
+	return ubifs_set_compr(host, policy);
+}
+
+static ssize_t get_compr_xattr(struct inode *host, void *buf, size_t size)
+{
+	int policy = ubifs_get_compr(host);
+	char str[16];
+	ssize_t len;
+
+	len = scnprintf(str, sizeof(str), "%s%s",
+			ubifs_compr_name(policy & ~UBIFS_IOC_COMPR_AUTO),
+			policy & UBIFS_IOC_COMPR_AUTO ? ",auto" : "");
+	if (buf) {
+		if (len > size)
+			return -ERANGE;
+		memcpy(buf, str, len);
+	}
+	return len;
+}
+
 int ubifs_setxattr(struct dentry *dentry, const char *name,
 		   const void *value, size_t size, int flags)
 {
@@ -311,6 +373,9 @@ int ubifs_setxattr(struct dentry *dentry, const char *name,
 	if (size > UBIFS_MAX_INO_DATA)
 		return -ERANGE;
 
+	if (!strcmp(name, UBIFS_COMPR_XATTR))
+		return set_compr_xattr(host, value, size);
+
 	type = check_namespace(&nm);
 	if (type < 0)
 		return type;
@@ -371,6 +436,9 @@ ssize_t ubifs_getxattr(struct dentry *dentry, const char *name, void *buf,
 	dbg_gen("xattr '%s', ino %lu ('%.*s'), buf size %zd", name,
 		host->i_ino, dentry->d_name.len, dentry->d_name.name, size);
 
+	if (!strcmp(name, UBIFS_COMPR_XATTR))
+		return get_compr_xattr(host, buf, size);
+
 	err = check_namespace(&nm);
 	if (err < 0)
 		return err;
@@ -17,60 +17,98 @@
 #include "yportenv.h"
 
 /*
- * Each entry in yaffs_tnode_list and yaffs_obj_list hold blocks
- * of approx 100 objects that are themn allocated singly.
- * This is basically a simplified slab allocator.
+ * Tnodes and objects are carved out of arenas of a few hundred objects that
+ * are then allocated singly. This is basically a simplified slab allocator.
  *
  * We don't use the Linux slab allocator because slab does not allow
  * us to dump all the objects in one hit when we do a umount and tear
  * down  all the tnodes and objects. slab requires that we first free
  * the individual objects.
  *
+ * An arena starts with the link used to free it and is sized to fill the
+ * kmalloc() size class it falls in, so that no memory is lost to rounding
+ * up. Keeping the tnodes of a file close together in memory also helps
+ * the cache when walking the tnode tree.
+ *
  * Once yaffs has been mainlined I shall try to motivate for a change
  * to slab to provide the extra features we need here.
  */
 
-struct yaffs_tnode_list {
-	struct yaffs_tnode_list *next;
-	struct yaffs_tnode *tnodes;
-};
-
-struct yaffs_obj_list {
-	struct yaffs_obj_list *next;
-	struct yaffs_obj *objects;
+struct yaffs_arena {
+	struct yaffs_arena *next;
+	u64 mem[0];
 };
 
 struct yaffs_allocator {
 	int n_tnodes_created;
 	struct yaffs_tnode *free_tnodes;
 	int n_free_tnodes;
-	struct yaffs_tnode_list *alloc_tnode_list;
+	struct yaffs_arena *tnode_arenas;
+	int n_arena_tnodes;
+	u32 tnode_bytes;
 
 	int n_obj_created;
 	struct list_head free_objs;
 	int n_free_objects;
-
-	struct yaffs_obj_list *allocated_obj_list;
+	struct yaffs_arena *obj_arenas;
+	int n_arena_objs;
+	u32 obj_bytes;
 };
 
+/*
+ * yaffs_arena_items() returns how many items of item_size fit in an arena
+ * holding at least min_items, once it is rounded up to a power of two, which
+ * is what kmalloc() does with it.
+ */
+static int yaffs_arena_items(int item_size, int min_items)
+{
+	unsigned long bytes;
+
+	bytes = sizeof(struct yaffs_arena) + min_items * item_size;
+	bytes = roundup_pow_of_two(bytes);
+	return (bytes - sizeof(struct yaffs_arena)) / item_size;
+}
+
+static struct yaffs_arena *yaffs_new_arena(struct yaffs_arena **list,
+					   u32 *bytes, int n_items,
+					   int item_size)
+{
+	struct yaffs_arena *arena;
+
+	arena = kmalloc(sizeof(struct yaffs_arena) + n_items * item_size,
+			GFP_NOFS);
+	if (!arena)
+		return NULL;
+
+	arena->next = *list;
+	*list = arena;
+	*bytes += ksize(arena);
+	return arena;
+}
+
+static void yaffs_free_arenas(struct yaffs_arena **list, u32 *bytes)
+{
+	struct yaffs_arena *tmp;
+
+	while (*list) {
+		tmp = (*list)->next;
+		kfree(*list);
+		*list = tmp;
+	}
+	*bytes = 0;
+}
+
 static void yaffs_deinit_raw_tnodes(struct yaffs_dev *dev)
 {
 	struct yaffs_allocator *allocator =
 	    (struct yaffs_allocator *)dev->allocator;
-	struct yaffs_tnode_list *tmp;
 
 	if (!allocator) {
 		BUG();
 		return;
 	}
 
-	while (allocator->alloc_tnode_list) {
-		tmp = allocator->alloc_tnode_list->next;
-
-		kfree(allocator->alloc_tnode_list->tnodes);
-		kfree(allocator->alloc_tnode_list);
-		allocator->alloc_tnode_list = tmp;
-	}
+	yaffs_free_arenas(&allocator->tnode_arenas, &allocator->tnode_bytes);
 
 	allocator->free_tnodes = NULL;
 	allocator->n_free_tnodes = 0;
@@ -86,10 +124,13 @@ static void yaffs_init_raw_tnodes(struct yaffs_dev *dev)
 		return;
 	}
 
-	allocator->alloc_tnode_list = NULL;
+	allocator->tnode_arenas = NULL;
+	allocator->tnode_bytes = 0;
 	allocator->free_tnodes = NULL;
 	allocator->n_free_tnodes = 0;
 	allocator->n_tnodes_created = 0;
+	allocator->n_arena_tnodes = yaffs_arena_items(dev->tnode_size,
+						YAFFS_ALLOCATION_NTNODES);
 }
 
 static int yaffs_create_tnodes(struct yaffs_dev *dev, int n_tnodes)
@@ -97,11 +138,10 @@ static int yaffs_create_tnodes(struct yaffs_dev *dev, int n_tnodes)
 	struct yaffs_allocator *allocator =
 	    (struct yaffs_allocator *)dev->allocator;
 	int i;
-	struct yaffs_tnode *new_tnodes;
+	struct yaffs_arena *arena;
 	u8 *mem;
 	struct yaffs_tnode *curr;
 	struct yaffs_tnode *next;
-	struct yaffs_tnode_list *tnl;
 
 	if (!allocator) {
 		BUG();
@@ -112,14 +152,15 @@ static int yaffs_create_tnodes(struct yaffs_dev *dev, int n_tnodes)
 		return YAFFS_OK;
 
 	/* make these things */
-	new_tnodes = kmalloc(n_tnodes * dev->tnode_size, GFP_NOFS);
-	mem = (u8 *) new_tnodes;
-
-	if (!new_tnodes) {
+	arena = yaffs_new_arena(&allocator->tnode_arenas,
+				&allocator->tnode_bytes, n_tnodes,
+				dev->tnode_size);
+	if (!arena) {
 		yaffs_trace(YAFFS_TRACE_ERROR,
 			"yaffs: Could not allocate Tnodes");
 		return YAFFS_FAIL;
 	}
+	mem = (u8 *) arena->mem;
 
 	/* New hookup for wide tnodes */
 	for (i = 0; i < n_tnodes - 1; i++) {
@@ -135,21 +176,6 @@ static int yaffs_create_tnodes(struct yaffs_dev *dev, int n_tnodes)
 	allocator->n_free_tnodes += n_tnodes;
 	allocator->n_tnodes_created += n_tnodes;
 
-	/* Now add this bunch of tnodes to a list for freeing up.
-	 * NB If we can't add this to the management list it isn't fatal
-	 * but it just means we can't free this bunch of tnodes later.
-	 */
-	tnl = kmalloc(sizeof(struct yaffs_tnode_list), GFP_NOFS);
-	if (!tnl) {
-		yaffs_trace(YAFFS_TRACE_ERROR,
-			"Could not add tnodes to management list");
-		return YAFFS_FAIL;
-	} else {
-		tnl->tnodes = new_tnodes;
-		tnl->next = allocator->alloc_tnode_list;
-		allocator->alloc_tnode_list = tnl;
-	}
-
 	yaffs_trace(YAFFS_TRACE_ALLOCATE, "Tnodes added");
 
 	return YAFFS_OK;
@@ -168,7 +194,7 @@ struct yaffs_tnode *yaffs_alloc_raw_tnode(struct yaffs_dev *dev)
 
 	/* If there are none left make more */
 	if (!allocator->free_tnodes)
-		yaffs_create_tnodes(dev, YAFFS_ALLOCATION_NTNODES);
+		yaffs_create_tnodes(dev, allocator->n_arena_tnodes);
 
 	if (allocator->free_tnodes) {
 		tn = allocator->free_tnodes;
@@ -212,27 +238,25 @@ static void yaffs_init_raw_objs(struct yaffs_dev *dev)
 		return;
 	}
 
-	allocator->allocated_obj_list = NULL;
+	allocator->obj_arenas = NULL;
+	allocator->obj_bytes = 0;
 	INIT_LIST_HEAD(&allocator->free_objs);
 	allocator->n_free_objects = 0;
+	allocator->n_obj_created = 0;
+	allocator->n_arena_objs = yaffs_arena_items(sizeof(struct yaffs_obj),
+						YAFFS_ALLOCATION_NOBJECTS);
 }
 
 static void yaffs_deinit_raw_objs(struct yaffs_dev *dev)
 {
 	struct yaffs_allocator *allocator = dev->allocator;
-	struct yaffs_obj_list *tmp;
 
 	if (!allocator) {
 		BUG();
 		return;
 	}
 
-	while (allocator->allocated_obj_list) {
-		tmp = allocator->allocated_obj_list->next;
-		kfree(allocator->allocated_obj_list->objects);
-		kfree(allocator->allocated_obj_list);
-		allocator->allocated_obj_list = tmp;
-	}
+	yaffs_free_arenas(&allocator->obj_arenas, &allocator->obj_bytes);
 
 	INIT_LIST_HEAD(&allocator->free_objs);
 	allocator->n_free_objects = 0;
@@ -243,8 +267,8 @@ static int yaffs_create_free_objs(struct yaffs_dev *dev, int n_obj)
 {
 	struct yaffs_allocator *allocator = dev->allocator;
 	int i;
+	struct yaffs_arena *arena;
 	struct yaffs_obj *new_objs;
-	struct yaffs_obj_list *list;
 
 	if (!allocator) {
 		BUG();
@@ -255,18 +279,14 @@ static int yaffs_create_free_objs(struct yaffs_dev *dev, int n_obj)
 		return YAFFS_OK;
 
 	/* make these things */
-	new_objs = kmalloc(n_obj * sizeof(struct yaffs_obj), GFP_NOFS);
-	list = kmalloc(sizeof(struct yaffs_obj_list), GFP_NOFS);
-
-	if (!new_objs || !list) {
-		kfree(new_objs);
-		new_objs = NULL;
-		kfree(list);
-		list = NULL;
+	arena = yaffs_new_arena(&allocator->obj_arenas, &allocator->obj_bytes,
+				n_obj, sizeof(struct yaffs_obj));
+	if (!arena) {
 		yaffs_trace(YAFFS_TRACE_ALLOCATE,
 			"Could not allocate more objects");
 		return YAFFS_FAIL;
 	}
+	new_objs = (struct yaffs_obj *)arena->mem;
 
 	/* Hook them into the free list */
 	for (i = 0; i < n_obj; i++)
@@ -275,12 +295,6 @@ static int yaffs_create_free_objs(struct yaffs_dev *dev, int n_obj)
 	allocator->n_free_objects += n_obj;
 	allocator->n_obj_created += n_obj;
 
-	/* Now add this bunch of Objects to a list for freeing up. */
-
-	list->objects = new_objs;
-	list->next = allocator->allocated_obj_list;
-	allocator->allocated_obj_list = list;
-
 	return YAFFS_OK;
 }
 
@@ -297,7 +311,7 @@ struct yaffs_obj *yaffs_alloc_raw_obj(struct yaffs_dev *dev)
 
 	/* If there are none left make more */
 	if (list_empty(&allocator->free_objs))
-		yaffs_create_free_objs(dev, YAFFS_ALLOCATION_NOBJECTS);
+		yaffs_create_free_objs(dev, allocator->n_arena_objs);
 
 	if (!list_empty(&allocator->free_objs)) {
 		lh = allocator->free_objs.next;
@@ -355,3 +369,19 @@ void yaffs_init_raw_tnodes_and_objs(struct yaffs_dev *dev)
 	}
 }
 
+void yaffs_get_alloc_usage(struct yaffs_dev *dev,
+			   struct yaffs_alloc_usage *usage)
+{
+	struct yaffs_allocator *allocator = dev->allocator;
+
+	memset(usage, 0, sizeof(struct yaffs_alloc_usage));
+	if (!allocator)
+		return;
+
+	usage->tnodes_created = allocator->n_tnodes_created;
+	usage->tnodes_free = allocator->n_free_tnodes;
+	usage->tnode_bytes = allocator->tnode_bytes;
+	usage->objs_created = allocator->n_obj_created;
+	usage->objs_free = allocator->n_free_objects;
+	usage->obj_bytes = allocator->obj_bytes;
+}
@@ -27,4 +27,17 @@ void yaffs_free_raw_tnode(struct yaffs_dev *dev, struct yaffs_tnode *tn);
 struct yaffs_obj *yaffs_alloc_raw_obj(struct yaffs_dev *dev);
 void yaffs_free_raw_obj(struct yaffs_dev *dev, struct yaffs_obj *obj);
 
+/* Memory held by the tnode and object arenas of a device */
+struct yaffs_alloc_usage {
+	u32 tnodes_created;
+	u32 tnodes_free;
+	u32 tnode_bytes;
+	u32 objs_created;
+	u32 objs_free;
+	u32 obj_bytes;
+};
+
+void yaffs_get_alloc_usage(struct yaffs_dev *dev,
+			   struct yaffs_alloc_usage *usage);
+
 #endif
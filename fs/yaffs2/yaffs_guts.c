@@ -2903,6 +2903,7 @@ int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency)
 
 	yaffs_trace(YAFFS_TRACE_BACKGROUND, "Background gc %u", urgency);
 
+	yaffs_fixup_dirs(dev);
 	yaffs_check_gc(dev, 1);
 	return erased_chunks > dev->n_free_chunks / 2;
 }
@@ -4305,6 +4306,29 @@ static void yaffs_empty_l_n_f(struct yaffs_dev *dev)
 	yaffs_del_dir_contents(dev->lost_n_found);
 }
 
+/*
+ * Checking that every object is rooted, and moving those that are not to
+ * lost+found (and emptying it if asked to), walks the parent chain of every
+ * object. Nothing can tell the difference until lost+found is looked at,
+ * so mount leaves this to the first lookup or listing of lost+found, the
+ * next checkpoint save or the first background gc pass, whichever comes
+ * first.
+ */
+void yaffs_fixup_dirs(struct yaffs_dev *dev)
+{
+	u32 t;
+
+	if (!dev->dir_fixup_pending)
+		return;
+	dev->dir_fixup_pending = 0;
+
+	t = Y_TIME_US();
+	yaffs_fix_hanging_objs(dev);
+	if (dev->param.empty_lost_n_found)
+		yaffs_empty_l_n_f(dev);
+	dev->dir_fixup_time = Y_TIME_US() - t;
+}
+
 
 struct yaffs_obj *yaffs_find_by_name(struct yaffs_obj *directory,
 				     const YCHAR *name)
@@ -4583,6 +4607,8 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	int init_failed = 0;
 	unsigned x;
 	int bits;
+	u32 start_time = Y_TIME_US();
+	u32 t;
 
 	yaffs_trace(YAFFS_TRACE_TRACING, "yaffs: yaffs_guts_initialise()");
 
@@ -4816,16 +4842,24 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		!yaffs_summary_init(dev))
 		init_failed = 1;
 
+	dev->mount_checkpt_time = 0;
+	dev->mount_block_scan_time = 0;
+	dev->mount_scan_time = 0;
+	dev->mount_hdr_reads = 0;
+
 	if (!init_failed) {
 		/* Now scan the flash. */
 		if (dev->param.is_yaffs2) {
+			t = Y_TIME_US();
 			if (yaffs2_checkpt_restore(dev)) {
+				dev->mount_checkpt_time = Y_TIME_US() - t;
 				yaffs_check_obj_details_loaded(dev->root_dir);
 				yaffs_trace(YAFFS_TRACE_CHECKPOINT |
 					YAFFS_TRACE_MOUNT,
 					"yaffs: restored from checkpoint"
 					);
 			} else {
+				dev->mount_checkpt_time = Y_TIME_US() - t;
 
 				/* Clean up the mess caused by an aborted
 				 * checkpoint load then scan backwards.
@@ -4851,17 +4885,23 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 				    && !yaffs_create_initial_dir(dev))
 					init_failed = 1;
 
+				t = Y_TIME_US();
 				if (!init_failed && !yaffs2_scan_backwards(dev))
 					init_failed = 1;
+				dev->mount_scan_time = Y_TIME_US() - t;
 			}
-		} else if (!yaffs1_scan(dev)) {
-			init_failed = 1;
+		} else {
+			t = Y_TIME_US();
+			if (!yaffs1_scan(dev))
+				init_failed = 1;
+			dev->mount_scan_time = Y_TIME_US() - t;
 		}
 
+		t = Y_TIME_US();
 		yaffs_strip_deleted_objs(dev);
-		yaffs_fix_hanging_objs(dev);
-		if (dev->param.empty_lost_n_found)
-			yaffs_empty_l_n_f(dev);
+		dev->dir_fixup_pending = 1;
+		dev->dir_fixup_time = 0;
+		dev->mount_fixup_time = Y_TIME_US() - t;
 	}
 
 	if (init_failed) {
@@ -4873,6 +4913,9 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		return YAFFS_FAIL;
 	}
 
+	dev->mount_page_reads = dev->n_page_reads;
+	dev->mount_total_time = Y_TIME_US() - start_time;
+
 	/* Zero out stats */
 	dev->n_page_reads = 0;
 	dev->n_page_writes = 0;
@@ -410,6 +410,8 @@ struct yaffs_obj {
 				 * Only valid if xattr_known. */
 
 	u8 serial;		/* serial number of chunk in NAND.*/
+	u8 variant_type;	/* enum yaffs_obj_type, kept in a byte to
+				 * fill the hole before sum */
 	u16 sum;		/* sum of the name to speed searching */
 
 	struct yaffs_dev *my_dev;	/* The device I'm on */
@@ -450,8 +452,6 @@ struct yaffs_obj {
 
 	void *my_inode;
 
-	enum yaffs_obj_type variant_type;
-
 	union yaffs_obj_var variant;
 
 };
@@ -757,6 +757,19 @@ struct yaffs_dev {
 	u32 tags_used;
 	u32 summary_used;
 
+	/* Mount statistics, times are in microseconds */
+	u32 mount_checkpt_time;
+	u32 mount_block_scan_time;
+	u32 mount_scan_time;
+	u32 mount_fixup_time;
+	u32 mount_total_time;
+	u32 mount_page_reads;
+	u32 mount_hdr_reads;
+	u32 dir_fixup_time;	/* deferred from mount, see yaffs_fixup_dirs */
+
+	/* Hanging objects have not been moved to lost+found yet */
+	u8 dir_fixup_pending;
+
 };
 
 /* The CheckpointDevice structure holds the device information that changes
@@ -881,6 +894,8 @@ void yaffs_update_dirty_dirs(struct yaffs_dev *dev);
 
 int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency);
 
+void yaffs_fixup_dirs(struct yaffs_dev *dev);
+
 /* Debug dump  */
 int yaffs_dump_obj(struct yaffs_obj *obj);
 
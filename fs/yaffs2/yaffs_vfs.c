@@ -166,6 +166,7 @@ static uint32_t YCALCBLOCKS(uint64_t partition_size, uint32_t block_size)
 #include "yaffs_trace.h"
 #include "yaffs_guts.h"
 #include "yaffs_attribs.h"
+#include "yaffs_allocator.h"
 
 #include "yaffs_linux.h"
 
@@ -791,6 +792,9 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry)
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_lookup for %d:%s",
 		yaffs_inode_to_obj(dir)->obj_id, dentry->d_name.name);
 
+	if (yaffs_inode_to_obj(dir) == dev->lost_n_found)
+		yaffs_fixup_dirs(dev);
+
 	obj = yaffs_find_by_name(yaffs_inode_to_obj(dir), dentry->d_name.name);
 
 	obj = yaffs_get_equivalent_obj(obj);	/* in case it was a hardlink */
@@ -1521,6 +1525,9 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 
 	offset = f->f_pos;
 
+	if (obj == dev->lost_n_found)
+		yaffs_fixup_dirs(dev);
+
 	sc = yaffs_new_search(obj);
 	if (!sc) {
 		ret_val = -ENOMEM;
@@ -3115,6 +3122,10 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 
 static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 {
+	struct yaffs_alloc_usage usage;
+
+	yaffs_get_alloc_usage(dev, &usage);
+
 	buf += sprintf(buf, "data_bytes_per_chunk. %d\n",
 				dev->data_bytes_per_chunk);
 	buf += sprintf(buf, "chunk_grp_bits....... %d\n", dev->chunk_grp_bits);
@@ -3125,6 +3136,16 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	buf += sprintf(buf, "\n");
 	buf += sprintf(buf, "n_tnodes............. %d\n", dev->n_tnodes);
 	buf += sprintf(buf, "n_obj................ %d\n", dev->n_obj);
+	buf += sprintf(buf, "tnode_width.......... %u\n", dev->tnode_width);
+	buf += sprintf(buf, "tnode_size........... %u\n", dev->tnode_size);
+	buf += sprintf(buf, "tnodes_created....... %u\n", usage.tnodes_created);
+	buf += sprintf(buf, "tnodes_free.......... %u\n", usage.tnodes_free);
+	buf += sprintf(buf, "tnode_bytes.......... %u\n", usage.tnode_bytes);
+	buf += sprintf(buf, "obj_size............. %u\n",
+				(u32) sizeof(struct yaffs_obj));
+	buf += sprintf(buf, "objs_created......... %u\n", usage.objs_created);
+	buf += sprintf(buf, "objs_free............ %u\n", usage.objs_free);
+	buf += sprintf(buf, "obj_bytes............ %u\n", usage.obj_bytes);
 	buf += sprintf(buf, "n_free_chunks........ %d\n", dev->n_free_chunks);
 	buf += sprintf(buf, "\n");
 	buf += sprintf(buf, "n_page_writes........ %u\n", dev->n_page_writes);
@@ -3156,6 +3177,24 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	buf += sprintf(buf, "n_bg_deletions....... %u\n", dev->n_bg_deletions);
 	buf += sprintf(buf, "tags_used............ %u\n", dev->tags_used);
 	buf += sprintf(buf, "summary_used......... %u\n", dev->summary_used);
+	buf += sprintf(buf, "\n");
+	buf += sprintf(buf, "mount_checkpt_time... %u us\n",
+				dev->mount_checkpt_time);
+	buf += sprintf(buf, "mount_block_scan_time %u us\n",
+				dev->mount_block_scan_time);
+	buf += sprintf(buf, "mount_scan_time...... %u us\n",
+				dev->mount_scan_time);
+	buf += sprintf(buf, "mount_fixup_time..... %u us\n",
+				dev->mount_fixup_time);
+	buf += sprintf(buf, "mount_total_time..... %u us\n",
+				dev->mount_total_time);
+	buf += sprintf(buf, "mount_page_reads..... %u\n",
+				dev->mount_page_reads);
+	buf += sprintf(buf, "mount_hdr_reads...... %u\n",
+				dev->mount_hdr_reads);
+	buf += sprintf(buf, "dir_fixup_time....... %u us%s\n",
+				dev->dir_fixup_time,
+				dev->dir_fixup_pending ? " (pending)" : "");
 
 	return buf;
 }
@@ -789,6 +789,7 @@ int yaffs_checkpoint_save(struct yaffs_dev *dev)
 		"save entry: is_checkpointed %d",
 		dev->is_checkpointed);
 
+	yaffs_fixup_dirs(dev);
 	yaffs_verify_objects(dev);
 	yaffs_verify_blocks(dev);
 	yaffs_verify_free_chunks(dev);
@@ -958,6 +959,15 @@ static inline int yaffs2_scan_chunk(struct yaffs_dev *dev,
 		tags.seq_number = bi->seq_number;
 	}
 
+	/* Summaries do not hold the extra object header info, but the tags
+	 * in the spare area do. Reading just the tags for an object header
+	 * allows lazy loading, which defers reading the header itself
+	 * (name, attributes) until the object is first looked up.
+	 */
+	if (summary_available && tags.obj_id != 0 && tags.chunk_id == 0 &&
+	    !dev->param.disable_lazy_load && !dev->param.inband_tags)
+		summary_available = 0;
+
 	if (!summary_available || tags.obj_id == 0) {
 		result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL, &tags);
 		dev->tags_used++;
@@ -1118,6 +1128,7 @@ static inline int yaffs2_scan_chunk(struct yaffs_dev *dev,
 						  chunk,
 						  chunk_data,
 						  NULL);
+			dev->mount_hdr_reads++;
 
 			oh = (struct yaffs_obj_hdr *)chunk_data;
 
@@ -1360,6 +1371,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
 	int summary_available;
+	u32 start_time = Y_TIME_US();
 
 	yaffs_trace(YAFFS_TRACE_SCAN,
 		"yaffs2_scan_backwards starts  intstartblk %d intendblk %d...",
@@ -1439,6 +1451,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		bi++;
 	}
 
+	dev->mount_block_scan_time = Y_TIME_US() - start_time;
+
 	yaffs_trace(YAFFS_TRACE_SCAN, "%d blocks to be sorted...", n_to_scan);
 
 	cond_resched();
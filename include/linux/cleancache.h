@@ -0,0 +1,116 @@
+#ifndef __LINUX_CLEANCACHE_H
+#define __LINUX_CLEANCACHE_H
+/*
+ * Compressed cache for clean page cache pages.
+ *
+ * Clean file pages dropped from the page cache are compressed into a
+ * bounded RAM pool, so that a later refault can be satisfied without
+ * going back to the (slow) backing store.  Filesystems opt in per
+ * superblock with cleancache_init_fs().
+ */
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+
+#ifdef CONFIG_CLEANCACHE
+extern int cleancache_enabled;
+
+void __cleancache_init_fs(struct super_block *sb);
+int __cleancache_get_page(struct page *page);
+void __cleancache_put_page(struct page *page);
+void __cleancache_flush_page(struct address_space *mapping, struct page *page);
+void __cleancache_flush_inode(struct address_space *mapping);
+void __cleancache_flush_fs(struct super_block *sb);
+
+static inline int cleancache_fs_enabled(struct address_space *mapping)
+{
+	return cleancache_enabled && mapping->host &&
+		mapping->host->i_sb->cleancache_poolid >= 0;
+}
+
+static inline void cleancache_init_fs(struct super_block *sb)
+{
+	__cleancache_init_fs(sb);
+}
+
+/*
+ * Returns 0 and fills the (locked, !uptodate) page on a hit.  The entry
+ * is removed from the cache: the page cache now owns the only copy.
+ */
+static inline int cleancache_get_page(struct page *page)
+{
+	if (cleancache_fs_enabled(page->mapping))
+		return __cleancache_get_page(page);
+	return -1;
+}
+
+/* Called with mapping->tree_lock held and interrupts disabled. */
+static inline void cleancache_put_page(struct page *page)
+{
+	if (cleancache_fs_enabled(page->mapping))
+		__cleancache_put_page(page);
+}
+
+static inline void cleancache_flush_page(struct address_space *mapping,
+					 struct page *page)
+{
+	if (cleancache_fs_enabled(mapping))
+		__cleancache_flush_page(mapping, page);
+}
+
+static inline void cleancache_flush_inode(struct address_space *mapping)
+{
+	if (cleancache_fs_enabled(mapping))
+		__cleancache_flush_inode(mapping);
+}
+
+static inline void cleancache_flush_fs(struct super_block *sb)
+{
+	if (sb->cleancache_poolid >= 0)
+		__cleancache_flush_fs(sb);
+}
+#else  /* !CONFIG_CLEANCACHE */
+
+static inline void cleancache_init_fs(struct super_block *sb)
+{
+}
+
+static inline int cleancache_get_page(struct page *page)
+{
+	return -1;
+}
+
+static inline void cleancache_put_page(struct page *page)
+{
+}
+
+static inline void cleancache_flush_page(struct address_space *mapping,
+					 struct page *page)
+{
+}
+
+static inline void cleancache_flush_inode(struct address_space *mapping)
+{
+}
+
+static inline void cleancache_flush_fs(struct super_block *sb)
+{
+}
+#endif /* !CONFIG_CLEANCACHE */
+
+/*
+ * Satisfy the read of a locked, !uptodate page cache page from the cache.
+ * Returns 1 with the page uptodate and unlocked on a hit, as if ->readpage()
+ * had completed; 0 if the caller has to read the page itself.
+ */
+static inline int cleancache_readpage(struct page *page)
+{
+	if (cleancache_get_page(page))
+		return 0;
+	SetPageUptodate(page);
+	unlock_page(page);
+	return 1;
+}
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Dynamic queue limits (dql) - Definitions
+ *
+ * A dql bounds the amount of data (usually bytes) outstanding in a queue
+ * whose consumer runs asynchronously, typically a NIC transmit ring.  The
+ * producer reports what it queues, the consumer what it completed, and the
+ * limit is adapted on every completion:
+ *
+ *  - it is raised when the queue ran dry while it was held over the limit
+ *    (the limit was too small to keep the consumer busy),
+ *  - it is lowered by the smallest "slack" seen during slack_hold_time,
+ *    where slack is data that stayed queued although it was not needed to
+ *    prevent starvation.
+ *
+ * The producer stops as soon as dql_avail() goes negative.  Only one
+ * producer and one consumer may update a dql concurrently; the caller
+ * provides any further serialisation and the ordering between stopping
+ * and restarting the producer.
+ */
+
+#ifndef _LINUX_DQL_H
+#define _LINUX_DQL_H
+
+#ifdef __KERNEL__
+
+#include <linux/kernel.h>
+#include <linux/cache.h>
+
+struct dql {
+	/* Fields accessed in the enqueue path (dql_queued) */
+	unsigned int	num_queued;		/* Total ever queued */
+	unsigned int	adj_limit;		/* limit + num_completed */
+	unsigned int	last_obj_cnt;		/* Count at last queuing */
+
+	/* Fields accessed only by the completion path (dql_completed) */
+	unsigned int	limit ____cacheline_aligned_in_smp; /* Current limit */
+	unsigned int	num_completed;		/* Total ever completed */
+
+	unsigned int	prev_ovlimit;		/* Previous over limit */
+	unsigned int	prev_num_queued;	/* Previous queue total */
+	unsigned int	prev_last_obj_cnt;	/* Previous queuing cnt */
+
+	unsigned int	lowest_slack;		/* Lowest slack found */
+	unsigned long	slack_start_time;	/* Time slacks seen */
+
+	/* Configuration */
+	unsigned int	max_limit;		/* Max limit */
+	unsigned int	min_limit;		/* Minimum limit */
+	unsigned int	slack_hold_time;	/* Time to measure slack */
+};
+
+/* Set some static maximums */
+#define DQL_MAX_OBJECT	(UINT_MAX / 16)
+#define DQL_MAX_LIMIT	((UINT_MAX / 2) - DQL_MAX_OBJECT)
+
+/*
+ * Record number of objects queued.  Assumes that the caller has already
+ * checked availability in the queue with dql_avail.
+ */
+static inline void dql_queued(struct dql *dql, unsigned int count)
+{
+	BUG_ON(count > DQL_MAX_OBJECT);
+
+	dql->last_obj_cnt = count;
+	dql->num_queued += count;
+}
+
+/* Returns how many objects can be queued, < 0 indicates over limit. */
+static inline int dql_avail(const struct dql *dql)
+{
+	return ACCESS_ONCE(dql->adj_limit) - ACCESS_ONCE(dql->num_queued);
+}
+
+/* Returns how many objects are outstanding. */
+static inline unsigned int dql_inflight(const struct dql *dql)
+{
+	return ACCESS_ONCE(dql->num_queued) - ACCESS_ONCE(dql->num_completed);
+}
+
+/* Record number of completed objects and recalculate the limit. */
+extern void dql_completed(struct dql *dql, unsigned int count);
+
+/* Reset dql state */
+extern void dql_reset(struct dql *dql);
+
+/* Initialize dql state */
+extern int dql_init(struct dql *dql, unsigned hold_time);
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_DQL_H */
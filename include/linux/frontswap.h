@@ -0,0 +1,40 @@
+#ifndef __LINUX_FRONTSWAP_H
+#define __LINUX_FRONTSWAP_H
+/*
+ * Compressed in-memory cache in front of the swap devices.
+ *
+ * Anonymous pages being swapped out are compressed into a RAM pool keyed
+ * by their swap slot; only pages which do not fit (pool full, page
+ * incompressible) and pages written back from the pool reach the device.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+
+#ifdef CONFIG_FRONTSWAP
+extern int frontswap_store(struct page *page);
+extern int frontswap_load(struct page *page);
+extern void frontswap_invalidate_page(unsigned type, pgoff_t offset);
+extern void frontswap_invalidate_area(unsigned type);
+#else  /* !CONFIG_FRONTSWAP */
+
+static inline int frontswap_store(struct page *page)
+{
+	return -1;
+}
+
+static inline int frontswap_load(struct page *page)
+{
+	return -1;
+}
+
+static inline void frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+}
+
+static inline void frontswap_invalidate_area(unsigned type)
+{
+}
+#endif /* !CONFIG_FRONTSWAP */
+
+#endif
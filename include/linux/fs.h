@@ -1387,6 +1387,12 @@ struct super_block {
 	 * generic_show_options()
 	 */
 	char *s_options;
+
+	/*
+	 * Pool id in the compressed clean page cache, -1 if the
+	 * filesystem does not participate (see linux/cleancache.h)
+	 */
+	int cleancache_poolid;
 };
 
 extern struct timespec current_fs_time(struct super_block *sb);
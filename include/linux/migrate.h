@@ -13,6 +13,7 @@ extern int putback_lru_pages(struct list_head *l);
 extern int migrate_page(struct address_space *,
 			struct page *, struct page *);
 extern int migrate_pages(struct list_head *l, new_page_t x, unsigned long);
+extern int migrate_pfn_range(unsigned long start_pfn, unsigned long end_pfn);
 
 extern int fail_migrate_page(struct address_space *,
 			struct page *, struct page *);
@@ -27,6 +28,8 @@ extern int migrate_vmas(struct mm_struct *mm,
 static inline int putback_lru_pages(struct list_head *l) { return 0; }
 static inline int migrate_pages(struct list_head *l, new_page_t x,
 		unsigned long private) { return -ENOSYS; }
+static inline int migrate_pfn_range(unsigned long start_pfn,
+		unsigned long end_pfn) { return -ENOSYS; }
 
 static inline int migrate_pages_to(struct list_head *pagelist,
 			struct vm_area_struct *vma, int dest) { return 0; }
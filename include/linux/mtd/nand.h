@@ -88,6 +88,9 @@ extern void nand_wait_ready(struct mtd_info *mtd);
 #define NAND_CMD_READSTART	0x30
 #define NAND_CMD_RNDOUTSTART	0xE0
 #define NAND_CMD_CACHEDPROG	0x15
+#define NAND_CMD_READCACHESEQ	0x31
+#define NAND_CMD_READCACHEEND	0x3f
+#define NAND_CMD_MULTI_ERASE2	0xd1
 
 /* Extended commands for AG-AND device */
 /*
@@ -221,6 +224,12 @@ typedef enum {
 /* This option is defined if the board driver allocates its own buffers
    (e.g. because it needs them DMA-coherent */
 #define NAND_OWN_BUFFERS	0x00040000
+/* The board driver passes the cache program and cache read commands to the
+ * chip, so they may be used if the chip supports them */
+#define NAND_USE_CACHE_OPS	0x00100000
+/* The board driver passes the multi-plane erase command to the chip, so it
+ * may be used if the chip supports it */
+#define NAND_USE_MULTIPLANE	0x00200000
 /* Options set by nand scan */
 /* Nand scan has allocated controller struct */
 #define NAND_CONTROLLER_ALLOC	0x80000000
@@ -73,6 +73,10 @@ enum ip_conntrack_status {
 	/* Connection has fixed timeout. */
 	IPS_FIXED_TIMEOUT_BIT = 10,
 	IPS_FIXED_TIMEOUT = (1 << IPS_FIXED_TIMEOUT_BIT),
+
+	/* Connection is handled by the flow offload fast path. */
+	IPS_OFFLOAD_BIT = 11,
+	IPS_OFFLOAD = (1 << IPS_OFFLOAD_BIT),
 };
 
 #ifdef __KERNEL__
@@ -14,11 +14,12 @@ extern int
 start_isolate_page_range(unsigned long start_pfn, unsigned long end_pfn);
 
 /*
- * Changes MIGRATE_ISOLATE to MIGRATE_MOVABLE.
+ * Changes MIGRATE_ISOLATE to migratetype (normally MIGRATE_MOVABLE).
  * target range is [start_pfn, end_pfn)
  */
 extern int
-undo_isolate_page_range(unsigned long start_pfn, unsigned long end_pfn);
+undo_isolate_page_range(unsigned long start_pfn, unsigned long end_pfn,
+			int migratetype);
 
 /*
  * test all pages in [start_pfn, end_pfn)are isolated or not.
@@ -31,7 +32,20 @@ test_pages_isolated(unsigned long start_pfn, unsigned long end_pfn);
  * Please use make_pagetype_isolated()/make_pagetype_movable().
  */
 extern int set_migratetype_isolate(struct page *page);
-extern void unset_migratetype_isolate(struct page *page);
+extern void unset_migratetype_isolate(struct page *page, int migratetype);
+
+/*
+ * Removes the free pages of an isolated range from the page allocator.
+ * Fails with -EBUSY if the range is not entirely free.
+ */
+extern int
+claim_isolated_page_range(unsigned long start_pfn, unsigned long end_pfn);
+
+/*
+ * Frees a range of claimed pages into the free lists of migratetype.
+ */
+extern void lend_page_range(unsigned long start_pfn, unsigned long end_pfn,
+			    int migratetype);
 
 
 #endif
@@ -518,4 +518,55 @@ struct tc_drr_stats
 	__u32	deficit;
 };
 
+/* FQ_CODEL */
+
+enum
+{
+	TCA_FQ_CODEL_UNSPEC,
+	TCA_FQ_CODEL_TARGET,	/* us */
+	TCA_FQ_CODEL_LIMIT,	/* packets */
+	TCA_FQ_CODEL_INTERVAL,	/* us */
+	TCA_FQ_CODEL_ECN,
+	TCA_FQ_CODEL_FLOWS,
+	TCA_FQ_CODEL_QUANTUM,	/* bytes */
+	__TCA_FQ_CODEL_MAX
+};
+
+#define TCA_FQ_CODEL_MAX	(__TCA_FQ_CODEL_MAX - 1)
+
+enum
+{
+	TCA_FQ_CODEL_XSTATS_QDISC,
+	TCA_FQ_CODEL_XSTATS_CLASS,
+};
+
+struct tc_fq_codel_qd_stats
+{
+	__u32	maxpacket;	/* largest packet seen so far */
+	__u32	drop_overlimit;	/* drops because the packet limit was hit */
+	__u32	ecn_mark;	/* packets ECN marked instead of dropped */
+	__u32	new_flow_count;	/* times a packet created a new flow */
+	__u32	new_flows_len;	/* flows on the new list */
+	__u32	old_flows_len;	/* flows on the old list */
+};
+
+struct tc_fq_codel_cl_stats
+{
+	__s32	deficit;
+	__u32	ldelay;		/* sojourn time of the last dequeued packet (us) */
+	__u32	count;
+	__u32	lastcount;
+	__u32	dropping;
+	__s32	drop_next;	/* us until the next drop, if dropping */
+};
+
+struct tc_fq_codel_xstats
+{
+	__u32	type;
+	union {
+		struct tc_fq_codel_qd_stats qdisc_stats;
+		struct tc_fq_codel_cl_stats class_stats;
+	};
+};
+
 #endif
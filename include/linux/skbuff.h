@@ -45,6 +45,9 @@
 #define SKB_MAX_HEAD(X)		(SKB_MAX_ORDER((X), 0))
 #define SKB_MAX_ALLOC		(SKB_MAX_ORDER(0, 2))
 
+/* Data size of the buffers kept in the per cpu receive buffer pool */
+#define SKB_RECYCLE_SIZE	(SKB_WITH_OVERHEAD(2048))
+
 /* A. Checksumming of received packets by device.
  *
  *	NONE: device failed to checksum this packet.
@@ -296,6 +299,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@end: End pointer
  *	@destructor: Destruct function
  *	@mark: Generic packet mark
+ *	@rxhash: the packet hash computed on receive
  *	@nfct: Associated connection, if any
  *	@ipvs_property: skbuff is owned by ipvs
  *	@peeked: this packet has been seen already, so stats have been
@@ -309,6 +313,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@tc_index: Traffic control index
  *	@tc_verd: traffic control verdict
  *	@ndisc_nodetype: router type (from link layer)
+ *	@recycle: buffer goes back to the receive buffer pool when freed
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
  *	@secmark: security marking
@@ -384,6 +389,7 @@ struct sk_buff {
 #ifdef CONFIG_IPV6_NDISC_NODETYPE
 	__u8			ndisc_nodetype:2;
 #endif
+	__u8			recycle:1;
 	kmemcheck_bitfield_end(flags2);
 
 	/* 0/14 bit hole */
@@ -397,6 +403,8 @@ struct sk_buff {
 
 	__u32			mark;
 
+	__u32			rxhash;
+
 	__u16			vlan_tci;
 
 	sk_buff_data_t		transport_header;
@@ -460,6 +468,7 @@ static inline struct sk_buff *alloc_skb_fclone(unsigned int size,
 }
 
 extern int skb_recycle_check(struct sk_buff *skb, int skb_size);
+extern int sysctl_skb_recycle_max;
 
 extern struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src);
 extern struct sk_buff *skb_clone(struct sk_buff *skb,
@@ -2076,6 +2085,15 @@ static inline bool skb_rx_queue_recorded(const struct sk_buff *skb)
 extern u16 skb_tx_hash(const struct net_device *dev,
 		       const struct sk_buff *skb);
 
+extern __u32 __skb_get_rxhash(struct sk_buff *skb);
+static inline __u32 skb_get_rxhash(struct sk_buff *skb)
+{
+	if (!skb->rxhash)
+		skb->rxhash = __skb_get_rxhash(skb);
+
+	return skb->rxhash;
+}
+
 #ifdef CONFIG_XFRM
 static inline struct sec_path *skb_sec_path(struct sk_buff *skb)
 {
@@ -276,6 +276,8 @@ extern void swap_unplug_io_fn(struct backing_dev_info *, struct page *);
 extern int swap_readpage(struct page *);
 extern int swap_writepage(struct page *page, struct writeback_control *wbc);
 extern void end_swap_bio_read(struct bio *bio, int err);
+extern int swap_writepage_raw(struct page *page, swp_entry_t entry,
+			      void (*end_io)(struct bio *, int));
 
 /* linux/mm/swap_state.c */
 extern struct address_space swapper_space;
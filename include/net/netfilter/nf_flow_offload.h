@@ -0,0 +1,67 @@
+#ifndef _NF_FLOW_OFFLOAD_H
+#define _NF_FLOW_OFFLOAD_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <net/dst.h>
+#include <net/netfilter/nf_conntrack.h>
+
+/*
+ * Flow offload fast path: established connections are forwarded straight
+ * from the PRE_ROUTING hook, with the NAT mangling and the route cached
+ * when the connection was offloaded, instead of through the netfilter
+ * tables, the routing lookup and ip_forward().
+ */
+
+struct flow_offload_tuple {
+	__be32				src_v4;
+	__be32				dst_v4;
+	__be16				src_port;
+	__be16				dst_port;
+	u_int8_t			l4proto;
+	u_int8_t			dir;
+};
+
+/* Per direction state, hashed on the tuple of the packets received */
+struct flow_offload_tuple_rhash {
+	struct hlist_node		node;
+	struct flow_offload_tuple	tuple;
+
+	/* Cached forwarding decision, NULL until a packet of this
+	 * direction went through the slow path once offloaded */
+	struct dst_entry		*dst;
+	int				iifidx;
+
+	/* Header of the packets sent, after NAT */
+	__be32				nat_src_v4;
+	__be32				nat_dst_v4;
+	__be16				nat_src_port;
+	__be16				nat_dst_port;
+};
+
+enum flow_offload_flags {
+	FLOW_OFFLOAD_TEARDOWN_BIT,	/* hand the flow back to conntrack */
+};
+
+struct flow_offload {
+	struct flow_offload_tuple_rhash	tuplehash[IP_CT_DIR_MAX];
+	struct nf_conn			*ct;
+	unsigned long			flags;
+	unsigned long			last_seen;	/* jiffies */
+	unsigned long			ct_timeout;	/* conntrack timeout */
+	struct list_head		list;
+	struct rcu_head			rcu;
+};
+
+static inline struct flow_offload *
+flow_offload_from_tuplehash(struct flow_offload_tuple_rhash *th)
+{
+	return container_of(th, struct flow_offload, tuplehash[th->tuple.dir]);
+}
+
+/* Offload the direction of ct the packet belongs to */
+extern int nf_flow_offload_add(struct nf_conn *ct, enum ip_conntrack_dir dir,
+			       const struct sk_buff *skb);
+
+#endif /* _NF_FLOW_OFFLOAD_H */
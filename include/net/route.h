@@ -103,6 +103,9 @@ struct rt_cache_stat
         unsigned int gc_dst_overflow;
         unsigned int in_hlist_search;
         unsigned int out_hlist_search;
+        unsigned int in_pcpu_hit;
+        unsigned int out_pcpu_hit;
+        unsigned int gc_batched;
 };
 
 extern struct ip_rt_acct *ip_rt_acct;
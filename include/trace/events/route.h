@@ -0,0 +1,84 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM route
+
+#if !defined(_TRACE_ROUTE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_ROUTE_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+#ifndef _TRACE_ROUTE_LOOKUP_DEF
+#define _TRACE_ROUTE_LOOKUP_DEF
+/* Where an IPv4 route lookup was answered from */
+enum {
+	RT_LOOKUP_CACHE,	/* route cache hash table */
+	RT_LOOKUP_PCPU,		/* per-cpu cache, route cache bypassed */
+	RT_LOOKUP_FIB,		/* slow path, FIB lookup */
+};
+#endif
+
+/*
+ * Tracepoint for IPv4 route lookups, input and output:
+ */
+TRACE_EVENT(rt_lookup,
+
+	TP_PROTO(__be32 daddr, __be32 saddr, int ifindex, int input,
+		 int source),
+
+	TP_ARGS(daddr, saddr, ifindex, input, source),
+
+	TP_STRUCT__entry(
+		__field(	__be32,		daddr		)
+		__field(	__be32,		saddr		)
+		__field(	int,		ifindex		)
+		__field(	int,		input		)
+		__field(	int,		source		)
+	),
+
+	TP_fast_assign(
+		__entry->daddr = daddr;
+		__entry->saddr = saddr;
+		__entry->ifindex = ifindex;
+		__entry->input = input;
+		__entry->source = source;
+	),
+
+	TP_printk("%s daddr=%pI4 saddr=%pI4 ifindex=%d source=%s",
+		__entry->input ? "input" : "output",
+		&__entry->daddr, &__entry->saddr, __entry->ifindex,
+		__print_symbolic(__entry->source,
+				 { RT_LOOKUP_CACHE,	"cache" },
+				 { RT_LOOKUP_PCPU,	"pcpu" },
+				 { RT_LOOKUP_FIB,	"fib" }))
+);
+
+/*
+ * Tracepoint for a synchronous route cache garbage collection pass:
+ */
+TRACE_EVENT(rt_garbage_collect,
+
+	TP_PROTO(int entries, int goal, u64 elapsed),
+
+	TP_ARGS(entries, goal, elapsed),
+
+	TP_STRUCT__entry(
+		__field(	int,		entries		)
+		__field(	int,		goal		)
+		__field(	u64,		elapsed		)
+	),
+
+	TP_fast_assign(
+		__entry->entries = entries;
+		__entry->goal = goal;
+		__entry->elapsed = elapsed;
+	),
+
+	TP_printk("entries=%d goal=%d elapsed=%lluns",
+		__entry->entries, __entry->goal,
+		(unsigned long long)__entry->elapsed)
+);
+
+#endif /* _TRACE_ROUTE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -15,6 +15,11 @@
  *      Added name aliases to "bpa2parts=" syntax.
  *      Added allocation tracing features.
  *
+ * Movable partitions:
+ *      Unused memory of partitions flagged BPA2_MOVABLE is lent to the
+ *      page allocator (for movable pages only) in MAX_ORDER sized chunks,
+ *      and migrated away again when a driver allocates from the chunk.
+ *
  * This is a set of routines which allow you to reserve a large (?)
  * amount of physical memory at boot-time, which can be allocated/deallocated
  * by drivers. This memory is intended to be used for devices such as
@@ -33,7 +38,7 @@
  * 	<size> := standard linux memory size (e.g. 4M or 0x400000)
  * 	<base physical address> := physical address the partition should
  * 	                            start from (e.g. 32M or 0x02000000)
- *      <flags> := currently unused
+ *      <flags> := "movable" (see CONFIG_BPA2_MOVABLE)
  *
  * Examples:
  *
@@ -43,6 +48,8 @@
  * 			LMI_SYS|audio:0x05000000:\
  * 			bigphyarea:5M
  *
+ * 	bpa2parts=video:32M::movable
+ *
  *   This program is free software; you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
  *   the Free Software Foundation; either version 2 of the License, or
@@ -73,6 +80,14 @@
 #include <linux/slab.h>
 #include <linux/pfn.h>
 #include <linux/bpa2.h>
+#include <linux/bitmap.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/swap.h>
+#include <linux/migrate.h>
+#include <linux/page-isolation.h>
+#include <linux/math64.h>
 
 
 
@@ -80,6 +95,11 @@
 #define BPA2_RES_PREFIX "bpa2:"
 #define BPA2_RES_PREFIX_LEN 5
 
+/* Movable partitions: how hard to try to empty a lent chunk */
+#define BPA2_CLAIM_RETRIES 5
+/* ...and how long to wait after a free before lending memory again */
+#define BPA2_LEND_DELAY HZ
+
 
 
 struct bpa2_range {
@@ -100,6 +120,17 @@ struct bpa2_part {
 	int flags;
 	int low_mem;
 	struct list_head list;
+#if defined(CONFIG_BPA2_MOVABLE)
+	unsigned long lend_pfn; /* first MAX_ORDER aligned page frame */
+	int nr_chunks;
+	unsigned long *lent; /* chunks given to the page allocator */
+	struct mutex lend_mutex;
+	struct delayed_work lend_work;
+	unsigned long claims;
+	unsigned long claim_failures;
+	u64 claim_ns_total;
+	u64 claim_ns_max;
+#endif
 	int names_cnt;
 	/* Do not separate two following fields! */
 	char res_name_prefix[BPA2_RES_PREFIX_LEN]; /* resource name prefix */
@@ -146,10 +177,228 @@ static int bpa2_check_name(struct bpa2_part *part, const char *name)
 	return -1;
 }
 
+#if defined(CONFIG_BPA2_MOVABLE)
+
+/* Does any allocation overlap [base, base + size)? Call with bpa2_lock. */
+static int bpa2_range_used(struct bpa2_part *part, unsigned long base,
+		unsigned long size)
+{
+	struct bpa2_range *range;
+
+	for (range = part->used_list; range != NULL; range = range->next)
+		if (range->base < base + size &&
+				base < range->base + range->size)
+			return 1;
+
+	return 0;
+}
+
+static unsigned long bpa2_chunk_pfn(struct bpa2_part *part, int n)
+{
+	return part->lend_pfn + n * MAX_ORDER_NR_PAGES;
+}
+
+/*
+ * Give all chunks not touched by any allocation to the page allocator.
+ * An allocation carved out of a chunk after the check below will wait
+ * for lend_mutex and claim the chunk back.
+ */
+static void bpa2_lend_chunks(struct bpa2_part *part)
+{
+	int n;
+
+	mutex_lock(&part->lend_mutex);
+	for (n = 0; n < part->nr_chunks; n++) {
+		unsigned long pfn = bpa2_chunk_pfn(part, n);
+		int used;
+
+		if (test_bit(n, part->lent))
+			continue;
+
+		spin_lock(&bpa2_lock);
+		used = bpa2_range_used(part, PFN_PHYS(pfn),
+				MAX_ORDER_NR_PAGES << PAGE_SHIFT);
+		spin_unlock(&bpa2_lock);
+		if (used)
+			continue;
+
+		lend_page_range(pfn, pfn + MAX_ORDER_NR_PAGES, MIGRATE_BPA2);
+		totalram_pages += MAX_ORDER_NR_PAGES;
+		set_bit(n, part->lent);
+	}
+	mutex_unlock(&part->lend_mutex);
+}
+
+static void bpa2_lend_work(struct work_struct *work)
+{
+	struct bpa2_part *part = container_of(work, struct bpa2_part,
+			lend_work.work);
+
+	bpa2_lend_chunks(part);
+}
+
+/*
+ * Take a lent chunk back: isolate it, so that nothing new is allocated
+ * from it, migrate the pages in use elsewhere and pull the (now free)
+ * pages out of the buddy lists. Pages pinned for longer than a couple
+ * of attempts (e.g. by get_user_pages()) make the claim fail.
+ * Call with lend_mutex held.
+ */
+static int bpa2_claim_chunk(struct bpa2_part *part, int n)
+{
+	unsigned long start_pfn = bpa2_chunk_pfn(part, n);
+	unsigned long end_pfn = start_pfn + MAX_ORDER_NR_PAGES;
+	unsigned long pfn;
+	ktime_t start = ktime_get();
+	int retries;
+	int err = 0;
+	u64 ns;
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn += pageblock_nr_pages) {
+		err = set_migratetype_isolate(pfn_to_page(pfn));
+		if (err)
+			goto undo;
+	}
+
+	for (retries = 0; retries < BPA2_CLAIM_RETRIES; retries++) {
+		migrate_pfn_range(start_pfn, end_pfn);
+		lru_add_drain_all();
+		drain_all_pages();
+		err = claim_isolated_page_range(start_pfn, end_pfn);
+		if (!err)
+			break;
+		cond_resched();
+	}
+	if (!err) {
+		clear_bit(n, part->lent);
+		totalram_pages -= MAX_ORDER_NR_PAGES;
+		goto out;
+	}
+
+undo:
+	while (pfn > start_pfn) {
+		pfn -= pageblock_nr_pages;
+		unset_migratetype_isolate(pfn_to_page(pfn), MIGRATE_BPA2);
+	}
+	part->claim_failures++;
+out:
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	part->claims++;
+	part->claim_ns_total += ns;
+	if (ns > part->claim_ns_max)
+		part->claim_ns_max = ns;
+
+	return err;
+}
+
+/* Make sure no page of a fresh allocation is lent to the kernel */
+static int bpa2_claim_range(struct bpa2_part *part, unsigned long base,
+		int count, int priority)
+{
+	unsigned long start_pfn = PFN_DOWN(base);
+	unsigned long end_pfn = start_pfn + count;
+	unsigned long lend_end_pfn = bpa2_chunk_pfn(part, part->nr_chunks);
+	int first, last, n;
+	int err = 0;
+
+	if (!part->lent || end_pfn <= part->lend_pfn ||
+			start_pfn >= lend_end_pfn)
+		return 0;
+
+	start_pfn = max(start_pfn, part->lend_pfn);
+	end_pfn = min(end_pfn, lend_end_pfn);
+	first = (start_pfn - part->lend_pfn) / MAX_ORDER_NR_PAGES;
+	last = (end_pfn - 1 - part->lend_pfn) / MAX_ORDER_NR_PAGES;
+
+	/* Migration sleeps, atomic allocations only get unlent memory */
+	if (priority & __GFP_WAIT)
+		mutex_lock(&part->lend_mutex);
+	else if (!mutex_trylock(&part->lend_mutex))
+		return -EBUSY;
+
+	for (n = first; n <= last && !err; n++) {
+		if (!test_bit(n, part->lent))
+			continue;
+		if (priority & __GFP_WAIT)
+			err = bpa2_claim_chunk(part, n);
+		else
+			err = -EBUSY;
+	}
+
+	mutex_unlock(&part->lend_mutex);
+
+	return err;
+}
+
+static int __init bpa2_lend_init(void)
+{
+	struct bpa2_part *part;
+
+	list_for_each_entry(part, &bpa2_parts, list) {
+		unsigned long start_pfn, end_pfn;
+
+		if (!(part->flags & BPA2_MOVABLE))
+			continue;
+
+		if (!part->low_mem) {
+			printk(KERN_WARNING "bpa2: '%s' partition not in "
+					"logical memory, can't be movable\n",
+					bpa2_get_name(part, 0));
+			continue;
+		}
+
+		start_pfn = ALIGN(PFN_DOWN(part->res.start),
+				MAX_ORDER_NR_PAGES);
+		end_pfn = PFN_DOWN(part->res.end + 1) &
+				~(MAX_ORDER_NR_PAGES - 1);
+		if (end_pfn <= start_pfn) {
+			printk(KERN_WARNING "bpa2: '%s' partition too small "
+					"or misaligned to be movable\n",
+					bpa2_get_name(part, 0));
+			continue;
+		}
+
+		part->lend_pfn = start_pfn;
+		part->nr_chunks = (end_pfn - start_pfn) / MAX_ORDER_NR_PAGES;
+		part->lent = kzalloc(BITS_TO_LONGS(part->nr_chunks) *
+				sizeof(unsigned long), GFP_KERNEL);
+		if (!part->lent)
+			continue;
+
+		bpa2_lend_chunks(part);
+		printk(KERN_INFO "bpa2: partition '%s' lent %d kB to the "
+				"kernel\n", bpa2_get_name(part, 0),
+				bitmap_weight(part->lent, part->nr_chunks) *
+				(int)(MAX_ORDER_NR_PAGES << PAGE_SHIFT) / 1024);
+	}
+
+	return 0;
+}
+core_initcall(bpa2_lend_init);
+
+#else
+
+static inline int bpa2_claim_range(struct bpa2_part *part, unsigned long base,
+		int count, int priority)
+{
+	return 0;
+}
+
+#endif /* CONFIG_BPA2_MOVABLE */
+
 static int __init bpa2_alloc_low(struct bpa2_part *part, unsigned long size,
 		unsigned long *start)
 {
-	void *addr = alloc_bootmem_low_pages(size);
+	void *addr;
+
+#if defined(CONFIG_BPA2_MOVABLE)
+	/* Movable partitions can only be lent in MAX_ORDER chunks */
+	if (part->flags & BPA2_MOVABLE)
+		addr = __alloc_bootmem_low(size,
+				MAX_ORDER_NR_PAGES << PAGE_SHIFT, 0);
+	else
+#endif
+		addr = alloc_bootmem_low_pages(size);
 
 	if (addr == NULL) {
 		printk(KERN_ERR "bpa2: could not allocate low memory\n");
@@ -262,6 +511,10 @@ static int __init bpa2_add_part(const char **names, int names_cnt,
 	part->initial_free_list.size = size;
 	part->free_list = &part->initial_free_list;
 	part->used_list = NULL;
+#if defined(CONFIG_BPA2_MOVABLE)
+	mutex_init(&part->lend_mutex);
+	INIT_DELAYED_WORK(&part->lend_work, bpa2_lend_work);
+#endif
 
 	/* And finally... */
 	list_add_tail(&part->list, &bpa2_parts);
@@ -365,6 +618,7 @@ static int __init bpa2_parts_setup(char *str)
 	while ((desc = strsep(&str, ",")) != NULL) {
 		unsigned long start = 0;
 		unsigned long size = 0;
+		unsigned long flags;
 		int names_cnt = 1;
 		const char **names;
 		char *token;
@@ -416,11 +670,20 @@ static int __init bpa2_parts_setup(char *str)
 			}
 		}
 
-		/* Get partition flags (not implemented yet) */
+		/* Get partition flags */
+		flags = BPA2_NORMAL;
+		token = strsep(&desc, ":");
+		if (token && *token) {
+			if (strcmp(token, "movable") == 0)
+				flags |= BPA2_MOVABLE;
+			else
+				printk(KERN_WARNING "bpa2: unknown flags '%s'"
+						" ignored\n", token);
+		}
 
 		/* Finally add it to the list... */
 		if (bpa2_add_part(names, names_cnt, start, size,
-					BPA2_NORMAL) != 0)
+					flags) != 0)
 			printk(KERN_ERR "bpa2: '%s' partition skipped\n",
 					*names);
 
@@ -571,6 +834,12 @@ fail:
 	if (align_range)
 		kfree(align_range);
 
+	/* Get the memory back from the page allocator, if it is lent */
+	if (result && bpa2_claim_range(part, result, count, priority) != 0) {
+		bpa2_free_pages(part, result);
+		result = 0;
+	}
+
 	return result;
 }
 EXPORT_SYMBOL(__bpa2_alloc_pages);
@@ -643,6 +912,11 @@ void bpa2_free_pages(struct bpa2_part *part, unsigned long base)
 		kfree(next);
 	if (range && (range != &part->initial_free_list))
 		kfree(range);
+
+#if defined(CONFIG_BPA2_MOVABLE)
+	if (part->lent)
+		schedule_delayed_work(&part->lend_work, BPA2_LEND_DELAY);
+#endif
 }
 EXPORT_SYMBOL(bpa2_free_pages);
 
@@ -739,6 +1013,20 @@ static int bpa2_seq_show(struct seq_file *s, void *v)
 			free_max / 1024, used_max / 1024);
 	seq_printf(s, "- total:                 %8d kB    %8d kB\n",
 			free_total / 1024, used_total / 1024);
+#if defined(CONFIG_BPA2_MOVABLE)
+	if (part->lent) {
+		unsigned long claims = part->claims;
+
+		seq_printf(s, "Lent to the kernel: %d kB\n",
+				bitmap_weight(part->lent, part->nr_chunks) *
+				(int)(MAX_ORDER_NR_PAGES << PAGE_SHIFT) / 1024);
+		seq_printf(s, "Reclaims: %lu (%lu failed), latency avg %llu us,"
+				" max %llu us\n", claims, part->claim_failures,
+				claims ? div64_u64(part->claim_ns_total,
+					(u64)claims * NSEC_PER_USEC) : 0ULL,
+				div64_u64(part->claim_ns_max, NSEC_PER_USEC));
+	}
+#endif
 
 	if (used_count) {
 		seq_printf(s, "Allocations:\n");
@@ -0,0 +1,535 @@
+/*
+ * Compressed cache for clean page cache pages.
+ *
+ * When reclaim drops a clean, uptodate page of a participating filesystem
+ * from the page cache, the page is LZO-compressed into a bounded pool of
+ * kmalloc'ed entries.  A later read of the same (filesystem, inode, index)
+ * is satisfied by decompressing the entry instead of going to the device,
+ * which on NAND (and squashfs on NAND in particular) saves both a flash read
+ * and a decompression of a much larger block.
+ *
+ * Entries are exclusive: a successful get removes the entry, since the page
+ * cache then holds the data again and will put it back on the next eviction.
+ * Any removal of a page which is not clean (or any truncate/invalidate of an
+ * inode) flushes the corresponding entries, so nothing stale is ever served.
+ *
+ * The pool is bounded by max_pool_kbytes; when full, the least recently
+ * stored entries are evicted.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/rbtree.h>
+#include <linux/radix-tree.h>
+#include <linux/percpu.h>
+#include <linux/lzo.h>
+#include <linux/cleancache.h>
+
+#define CLEANCACHE_MAX_POOLS	32
+
+/*
+ * Pages which do not compress below this size are not worth keeping:
+ * the pool would hold nearly as much as the page cache itself.
+ */
+#define CLEANCACHE_MAX_CSIZE	(PAGE_SIZE * 3 / 4)
+
+struct cleancache_pool {
+	struct rb_root objs;
+	int in_use;
+};
+
+/* One per cached inode: holds the compressed pages of that inode */
+struct cleancache_obj {
+	struct rb_node node;
+	ino_t ino;
+	struct cleancache_pool *pool;
+	struct radix_tree_root pages;
+	unsigned long nr_pages;
+};
+
+struct cleancache_entry {
+	struct list_head lru;
+	struct cleancache_obj *obj;
+	pgoff_t index;
+	unsigned int len;
+	unsigned char data[0];
+};
+
+/* Set once the compression buffers are allocated */
+int cleancache_enabled;
+EXPORT_SYMBOL(cleancache_enabled);
+
+static DEFINE_SPINLOCK(cleancache_lock);
+static struct cleancache_pool cleancache_pools[CLEANCACHE_MAX_POOLS];
+static LIST_HEAD(cleancache_lru);
+static struct kmem_cache *cleancache_obj_cache;
+
+static DEFINE_PER_CPU(unsigned char *, cleancache_wrkmem);
+static DEFINE_PER_CPU(unsigned char *, cleancache_dstmem);
+
+/* Pool size limit and usage, in bytes of compressed data plus overhead */
+static unsigned long cleancache_max_bytes;
+static unsigned long cleancache_pool_bytes;
+static unsigned long cleancache_stored_pages;
+
+/* Statistics, updated under cleancache_lock */
+static unsigned long cleancache_succ_gets;
+static unsigned long cleancache_failed_gets;
+static unsigned long cleancache_puts;
+static unsigned long cleancache_rejected_puts;
+static unsigned long cleancache_evictions;
+static unsigned long cleancache_flushes;
+
+static inline unsigned long entry_bytes(struct cleancache_entry *entry)
+{
+	return ksize(entry);
+}
+
+static struct cleancache_obj *obj_find(struct cleancache_pool *pool, ino_t ino)
+{
+	struct rb_node *node = pool->objs.rb_node;
+
+	while (node) {
+		struct cleancache_obj *obj;
+
+		obj = rb_entry(node, struct cleancache_obj, node);
+		if (ino < obj->ino)
+			node = node->rb_left;
+		else if (ino > obj->ino)
+			node = node->rb_right;
+		else
+			return obj;
+	}
+	return NULL;
+}
+
+static struct cleancache_obj *obj_find_or_create(struct cleancache_pool *pool,
+						 ino_t ino)
+{
+	struct rb_node **new = &pool->objs.rb_node, *parent = NULL;
+	struct cleancache_obj *obj;
+
+	while (*new) {
+		parent = *new;
+		obj = rb_entry(parent, struct cleancache_obj, node);
+		if (ino < obj->ino)
+			new = &parent->rb_left;
+		else if (ino > obj->ino)
+			new = &parent->rb_right;
+		else
+			return obj;
+	}
+
+	obj = kmem_cache_alloc(cleancache_obj_cache, GFP_ATOMIC);
+	if (!obj)
+		return NULL;
+	obj->ino = ino;
+	obj->pool = pool;
+	obj->nr_pages = 0;
+	INIT_RADIX_TREE(&obj->pages, GFP_ATOMIC);
+	rb_link_node(&obj->node, parent, new);
+	rb_insert_color(&obj->node, &pool->objs);
+	return obj;
+}
+
+static void obj_free(struct cleancache_obj *obj)
+{
+	rb_erase(&obj->node, &obj->pool->objs);
+	kmem_cache_free(cleancache_obj_cache, obj);
+}
+
+/*
+ * Unlink an entry from all indices and free it.  The owning object goes
+ * away with its last entry.
+ */
+static void entry_free(struct cleancache_entry *entry)
+{
+	struct cleancache_obj *obj = entry->obj;
+
+	radix_tree_delete(&obj->pages, entry->index);
+	list_del(&entry->lru);
+	cleancache_pool_bytes -= entry_bytes(entry);
+	cleancache_stored_pages--;
+	kfree(entry);
+
+	if (--obj->nr_pages == 0)
+		obj_free(obj);
+}
+
+static void obj_flush(struct cleancache_obj *obj)
+{
+	struct cleancache_entry *entries[16];
+	unsigned int nr, i;
+	int last;
+
+	/* entry_free() frees obj together with its last entry */
+	do {
+		nr = radix_tree_gang_lookup(&obj->pages, (void **)entries, 0,
+					    ARRAY_SIZE(entries));
+		last = (nr == obj->nr_pages);
+		for (i = 0; i < nr; i++) {
+			entry_free(entries[i]);
+			cleancache_flushes++;
+		}
+	} while (!last);
+}
+
+static void cleancache_shrink(unsigned long target)
+{
+	while (cleancache_pool_bytes > target && !list_empty(&cleancache_lru)) {
+		entry_free(list_entry(cleancache_lru.prev,
+				      struct cleancache_entry, lru));
+		cleancache_evictions++;
+	}
+}
+
+static void cleancache_flush_all(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	while (!list_empty(&cleancache_lru)) {
+		entry_free(list_entry(cleancache_lru.prev,
+				      struct cleancache_entry, lru));
+		cleancache_flushes++;
+	}
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+}
+
+static struct cleancache_pool *mapping_pool(struct address_space *mapping)
+{
+	return &cleancache_pools[mapping->host->i_sb->cleancache_poolid];
+}
+
+void __cleancache_init_fs(struct super_block *sb)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	for (i = 0; i < CLEANCACHE_MAX_POOLS; i++) {
+		if (!cleancache_pools[i].in_use) {
+			cleancache_pools[i].in_use = 1;
+			cleancache_pools[i].objs = RB_ROOT;
+			sb->cleancache_poolid = i;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+}
+EXPORT_SYMBOL(__cleancache_init_fs);
+
+int __cleancache_get_page(struct page *page)
+{
+	struct address_space *mapping = page->mapping;
+	struct cleancache_obj *obj;
+	struct cleancache_entry *entry = NULL;
+	unsigned long flags;
+	size_t dlen = PAGE_SIZE;
+	unsigned char *dst;
+	int ret;
+
+	VM_BUG_ON(!PageLocked(page));
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	obj = obj_find(mapping_pool(mapping), mapping->host->i_ino);
+	if (obj)
+		entry = radix_tree_lookup(&obj->pages, page->index);
+	if (!entry) {
+		cleancache_failed_gets++;
+		spin_unlock_irqrestore(&cleancache_lock, flags);
+		return -1;
+	}
+	/* Exclusive get: take the entry out before decompressing */
+	radix_tree_delete(&obj->pages, entry->index);
+	list_del(&entry->lru);
+	cleancache_pool_bytes -= entry_bytes(entry);
+	cleancache_stored_pages--;
+	if (--obj->nr_pages == 0)
+		obj_free(obj);
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->len, dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+	kfree(entry);
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	if (ret == LZO_E_OK && dlen == PAGE_SIZE) {
+		cleancache_succ_gets++;
+		ret = 0;
+	} else {
+		cleancache_failed_gets++;
+		ret = -1;
+	}
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(__cleancache_get_page);
+
+void __cleancache_put_page(struct page *page)
+{
+	struct address_space *mapping = page->mapping;
+	struct cleancache_obj *obj;
+	struct cleancache_entry *entry, *old;
+	unsigned char *src, *dst;
+	unsigned long flags;
+	size_t clen;
+	int ret;
+
+	local_irq_save(flags);
+
+	dst = __get_cpu_var(cleancache_dstmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &clen,
+			       __get_cpu_var(cleancache_wrkmem));
+	kunmap_atomic(src, KM_USER0);
+
+	spin_lock(&cleancache_lock);
+
+	obj = obj_find(mapping_pool(mapping), mapping->host->i_ino);
+	if (obj) {
+		/* Never leave an older copy behind, whatever happens below */
+		old = radix_tree_lookup(&obj->pages, page->index);
+		if (old) {
+			cleancache_flushes++;
+			if (obj->nr_pages == 1)
+				obj = NULL;
+			entry_free(old);
+		}
+	}
+
+	if (ret != LZO_E_OK || clen > CLEANCACHE_MAX_CSIZE ||
+	    !cleancache_max_bytes)
+		goto reject;
+
+	entry = kmalloc(sizeof(*entry) + clen, GFP_ATOMIC | __GFP_NOWARN);
+	if (!entry)
+		goto reject;
+
+	if (!obj)
+		obj = obj_find_or_create(mapping_pool(mapping),
+					 mapping->host->i_ino);
+	if (!obj)
+		goto reject_free;
+
+	entry->obj = obj;
+	entry->index = page->index;
+	entry->len = clen;
+	memcpy(entry->data, dst, clen);
+
+	if (radix_tree_insert(&obj->pages, page->index, entry)) {
+		if (!obj->nr_pages)
+			obj_free(obj);
+		goto reject_free;
+	}
+	obj->nr_pages++;
+	list_add(&entry->lru, &cleancache_lru);
+	cleancache_pool_bytes += entry_bytes(entry);
+	cleancache_stored_pages++;
+	cleancache_puts++;
+
+	cleancache_shrink(cleancache_max_bytes);
+
+	spin_unlock(&cleancache_lock);
+	local_irq_restore(flags);
+	return;
+
+reject_free:
+	kfree(entry);
+reject:
+	cleancache_rejected_puts++;
+	spin_unlock(&cleancache_lock);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(__cleancache_put_page);
+
+void __cleancache_flush_page(struct address_space *mapping, struct page *page)
+{
+	struct cleancache_obj *obj;
+	struct cleancache_entry *entry;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	obj = obj_find(mapping_pool(mapping), mapping->host->i_ino);
+	if (obj) {
+		entry = radix_tree_lookup(&obj->pages, page->index);
+		if (entry) {
+			entry_free(entry);
+			cleancache_flushes++;
+		}
+	}
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+}
+EXPORT_SYMBOL(__cleancache_flush_page);
+
+void __cleancache_flush_inode(struct address_space *mapping)
+{
+	struct cleancache_obj *obj;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	obj = obj_find(mapping_pool(mapping), mapping->host->i_ino);
+	if (obj)
+		obj_flush(obj);
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+}
+EXPORT_SYMBOL(__cleancache_flush_inode);
+
+void __cleancache_flush_fs(struct super_block *sb)
+{
+	struct cleancache_pool *pool;
+	struct rb_node *node;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	pool = &cleancache_pools[sb->cleancache_poolid];
+	while ((node = rb_first(&pool->objs)) != NULL)
+		obj_flush(rb_entry(node, struct cleancache_obj, node));
+	pool->in_use = 0;
+	sb->cleancache_poolid = -1;
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+}
+EXPORT_SYMBOL(__cleancache_flush_fs);
+
+#ifdef CONFIG_SYSFS
+
+#define CLEANCACHE_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define CLEANCACHE_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+#define CLEANCACHE_STAT(_name)						\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%lu\n", cleancache_##_name);		\
+}									\
+CLEANCACHE_ATTR_RO(_name)
+
+CLEANCACHE_STAT(succ_gets);
+CLEANCACHE_STAT(failed_gets);
+CLEANCACHE_STAT(puts);
+CLEANCACHE_STAT(rejected_puts);
+CLEANCACHE_STAT(evictions);
+CLEANCACHE_STAT(flushes);
+CLEANCACHE_STAT(stored_pages);
+CLEANCACHE_STAT(pool_bytes);
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", cleancache_enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	err = strict_strtoul(buf, 10, &val);
+	if (err || val > 1)
+		return -EINVAL;
+
+	/*
+	 * While disabled the flush hooks are not called, so anything left
+	 * in the pool could go stale: drop it all.
+	 */
+	cleancache_enabled = val;
+	if (!val)
+		cleancache_flush_all();
+
+	return count;
+}
+CLEANCACHE_ATTR(enabled);
+
+static ssize_t max_pool_kbytes_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", cleancache_max_bytes >> 10);
+}
+
+static ssize_t max_pool_kbytes_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned long kbytes, flags;
+	int err;
+
+	err = strict_strtoul(buf, 10, &kbytes);
+	if (err || kbytes > (ULONG_MAX >> 10))
+		return -EINVAL;
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	cleancache_max_bytes = kbytes << 10;
+	cleancache_shrink(cleancache_max_bytes);
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+
+	return count;
+}
+CLEANCACHE_ATTR(max_pool_kbytes);
+
+static struct attribute *cleancache_attrs[] = {
+	&enabled_attr.attr,
+	&max_pool_kbytes_attr.attr,
+	&succ_gets_attr.attr,
+	&failed_gets_attr.attr,
+	&puts_attr.attr,
+	&rejected_puts_attr.attr,
+	&evictions_attr.attr,
+	&flushes_attr.attr,
+	&stored_pages_attr.attr,
+	&pool_bytes_attr.attr,
+	NULL,
+};
+
+static struct attribute_group cleancache_attr_group = {
+	.attrs = cleancache_attrs,
+	.name = "cleancache",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init cleancache_init(void)
+{
+	int cpu;
+
+	cleancache_obj_cache = KMEM_CACHE(cleancache_obj, 0);
+	if (!cleancache_obj_cache)
+		goto nomem;
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(cleancache_wrkmem, cpu) =
+			kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+		per_cpu(cleancache_dstmem, cpu) =
+			kmalloc(lzo1x_worst_compress(PAGE_SIZE), GFP_KERNEL);
+		if (!per_cpu(cleancache_wrkmem, cpu) ||
+		    !per_cpu(cleancache_dstmem, cpu))
+			goto nomem;
+	}
+
+	cleancache_max_bytes = (totalram_pages / 10) << PAGE_SHIFT;
+	cleancache_enabled = 1;
+
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &cleancache_attr_group))
+		printk(KERN_ERR "cleancache: register sysfs failed\n");
+#endif
+	return 0;
+
+nomem:
+	/* The hooks stay in place but never store anything */
+	printk(KERN_ERR "cleancache: out of memory, disabled\n");
+	return -ENOMEM;
+}
+module_init(cleancache_init)
@@ -0,0 +1,475 @@
+/*
+ * Compressed in-memory cache in front of the swap devices.
+ *
+ * swap_writepage() first offers each page to frontswap_store(), which
+ * LZO-compresses it into a kmalloc'ed entry indexed by its swap slot.  The
+ * page then never reaches the swap device.  swap_readpage() asks
+ * frontswap_load() before issuing any I/O.  Entries live as long as their
+ * swap slot: they are dropped when the slot is freed or the area swapped off.
+ *
+ * Pages which do not compress well, or which find the pool full, are written
+ * to the device as usual.  Once the pool runs close to its limit a worker
+ * writes back the oldest entries to their (already allocated) swap slots,
+ * keeping room for new, hotter pages.  While an entry is under writeback it
+ * stays in the index, so that loads are still served from RAM and nothing
+ * else can write the same slot until the I/O has completed.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/radix-tree.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/bio.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/lzo.h>
+#include <linux/debugfs.h>
+#include <linux/frontswap.h>
+
+/* Pages compressing worse than this go straight to the device */
+#define FRONTSWAP_MAX_CSIZE	(PAGE_SIZE * 3 / 4)
+
+#define FRONTSWAP_WRITEBACK	0x1	/* I/O to the swap slot in flight */
+#define FRONTSWAP_DEAD		0x2	/* slot freed during writeback */
+
+struct frontswap_entry {
+	struct list_head lru;		/* empty while under writeback */
+	pgoff_t offset;
+	unsigned short type;
+	unsigned short flags;
+	unsigned int len;
+	unsigned char data[0];
+};
+
+static DEFINE_SPINLOCK(frontswap_lock);
+static struct radix_tree_root frontswap_trees[MAX_SWAPFILES];
+static LIST_HEAD(frontswap_lru);
+static DECLARE_WAIT_QUEUE_HEAD(frontswap_wb_wait);
+
+static DEFINE_PER_CPU(unsigned char *, frontswap_wrkmem);
+static DEFINE_PER_CPU(unsigned char *, frontswap_dstmem);
+
+static int frontswap_ready;
+
+/* Tunable: pool size limit; 0 sends everything to the device */
+static u32 frontswap_max_pool_kbytes;
+
+/* Pool usage and statistics, updated under frontswap_lock */
+static size_t frontswap_pool_bytes;
+static size_t frontswap_wb_bytes;
+static u64 frontswap_stored_pages;
+static u64 frontswap_succ_stores;
+static u64 frontswap_reject_compress;
+static u64 frontswap_reject_full;
+static u64 frontswap_reject_nomem;
+static u64 frontswap_loads;
+static u64 frontswap_failed_loads;
+static u64 frontswap_invalidates;
+static u64 frontswap_written_back;
+static u64 frontswap_writeback_errors;
+
+static void frontswap_writeback_fn(struct work_struct *work);
+static DECLARE_WORK(frontswap_writeback_work, frontswap_writeback_fn);
+
+static inline unsigned long frontswap_max_bytes(void)
+{
+	return (unsigned long)frontswap_max_pool_kbytes << 10;
+}
+
+static inline size_t entry_bytes(struct frontswap_entry *entry)
+{
+	return ksize(entry);
+}
+
+static void entry_free(struct frontswap_entry *entry)
+{
+	radix_tree_delete(&frontswap_trees[entry->type], entry->offset);
+	if (!list_empty(&entry->lru))
+		list_del(&entry->lru);
+	frontswap_pool_bytes -= entry_bytes(entry);
+	frontswap_stored_pages--;
+	kfree(entry);
+}
+
+static int frontswap_busy(unsigned type, pgoff_t offset)
+{
+	struct frontswap_entry *entry;
+	unsigned long flags;
+	int busy;
+
+	spin_lock_irqsave(&frontswap_lock, flags);
+	entry = radix_tree_lookup(&frontswap_trees[type], offset);
+	busy = entry && (entry->flags & FRONTSWAP_WRITEBACK);
+	spin_unlock_irqrestore(&frontswap_lock, flags);
+
+	return busy;
+}
+
+/*
+ * Drop the entry of a slot which is about to be rewritten.  Two writes of
+ * the same slot must never be in flight together, so a writeback of the
+ * previous contents has to complete first.  Called with frontswap_lock held
+ * and interrupts disabled; returns with the lock held but may drop it.
+ */
+static void frontswap_drop_locked(unsigned type, pgoff_t offset,
+				  unsigned long *flags)
+{
+	struct frontswap_entry *entry;
+
+	for (;;) {
+		entry = radix_tree_lookup(&frontswap_trees[type], offset);
+		if (!entry)
+			return;
+		if (!(entry->flags & FRONTSWAP_WRITEBACK)) {
+			entry_free(entry);
+			return;
+		}
+		spin_unlock_irqrestore(&frontswap_lock, *flags);
+		wait_event(frontswap_wb_wait, !frontswap_busy(type, offset));
+		spin_lock_irqsave(&frontswap_lock, *flags);
+	}
+}
+
+int frontswap_store(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page), };
+	unsigned type = swp_type(swp);
+	pgoff_t offset = swp_offset(swp);
+	struct frontswap_entry *entry = NULL;
+	unsigned char *src, *dst;
+	unsigned long flags;
+	size_t clen = 0;
+	int ret = LZO_E_ERROR;
+
+	if (!frontswap_ready)
+		return -1;
+
+	if (frontswap_max_pool_kbytes) {
+		dst = get_cpu_var(frontswap_dstmem);
+		src = kmap_atomic(page, KM_USER0);
+		ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &clen,
+				       __get_cpu_var(frontswap_wrkmem));
+		kunmap_atomic(src, KM_USER0);
+		if (ret == LZO_E_OK && clen <= FRONTSWAP_MAX_CSIZE) {
+			entry = kmalloc(sizeof(*entry) + clen,
+					GFP_NOWAIT | __GFP_NOWARN);
+			if (entry)
+				memcpy(entry->data, dst, clen);
+		}
+		put_cpu_var(frontswap_dstmem);
+	}
+
+	spin_lock_irqsave(&frontswap_lock, flags);
+	frontswap_drop_locked(type, offset, &flags);
+
+	if (!entry) {
+		/* The page goes to the device, with no stale copy left here */
+		if (frontswap_max_pool_kbytes) {
+			if (ret != LZO_E_OK || clen > FRONTSWAP_MAX_CSIZE)
+				frontswap_reject_compress++;
+			else
+				frontswap_reject_nomem++;
+		}
+		spin_unlock_irqrestore(&frontswap_lock, flags);
+		return -1;
+	}
+
+	entry->offset = offset;
+	entry->type = type;
+	entry->flags = 0;
+	entry->len = clen;
+
+	if (frontswap_pool_bytes + entry_bytes(entry) > frontswap_max_bytes()) {
+		frontswap_reject_full++;
+		goto reject;
+	}
+	if (radix_tree_insert(&frontswap_trees[type], offset, entry)) {
+		frontswap_reject_nomem++;
+		goto reject;
+	}
+	list_add(&entry->lru, &frontswap_lru);
+	frontswap_pool_bytes += entry_bytes(entry);
+	frontswap_stored_pages++;
+	frontswap_succ_stores++;
+
+	/* Keep some headroom so that new stores rarely find the pool full */
+	if (frontswap_pool_bytes > frontswap_max_bytes() / 16 * 15)
+		schedule_work(&frontswap_writeback_work);
+
+	spin_unlock_irqrestore(&frontswap_lock, flags);
+	return 0;
+
+reject:
+	spin_unlock_irqrestore(&frontswap_lock, flags);
+	kfree(entry);
+	schedule_work(&frontswap_writeback_work);
+	return -1;
+}
+
+int frontswap_load(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page), };
+	struct frontswap_entry *entry;
+	unsigned long flags;
+	size_t dlen = PAGE_SIZE;
+	unsigned char *dst;
+	int ret = -1;
+
+	if (!frontswap_ready)
+		return -1;
+
+	spin_lock_irqsave(&frontswap_lock, flags);
+	entry = radix_tree_lookup(&frontswap_trees[swp_type(swp)],
+				  swp_offset(swp));
+	if (entry && !(entry->flags & FRONTSWAP_DEAD)) {
+		dst = kmap_atomic(page, KM_USER0);
+		ret = lzo1x_decompress_safe(entry->data, entry->len,
+					    dst, &dlen);
+		kunmap_atomic(dst, KM_USER0);
+		/* A corrupted entry is a bug: the device copy is stale */
+		BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+		frontswap_loads++;
+		ret = 0;
+	} else {
+		frontswap_failed_loads++;
+	}
+	spin_unlock_irqrestore(&frontswap_lock, flags);
+
+	return ret;
+}
+
+/* Called with swap_lock held when the slot's last reference goes away */
+void frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct frontswap_entry *entry;
+	unsigned long flags;
+
+	if (!frontswap_ready)
+		return;
+
+	spin_lock_irqsave(&frontswap_lock, flags);
+	entry = radix_tree_lookup(&frontswap_trees[type], offset);
+	if (entry) {
+		if (entry->flags & FRONTSWAP_WRITEBACK)
+			entry->flags |= FRONTSWAP_DEAD;
+		else
+			entry_free(entry);
+		frontswap_invalidates++;
+	}
+	spin_unlock_irqrestore(&frontswap_lock, flags);
+}
+
+static int frontswap_area_empty(unsigned type)
+{
+	struct frontswap_entry *entry;
+	unsigned long flags;
+	int empty;
+
+	spin_lock_irqsave(&frontswap_lock, flags);
+	empty = !radix_tree_gang_lookup(&frontswap_trees[type],
+					(void **)&entry, 0, 1);
+	spin_unlock_irqrestore(&frontswap_lock, flags);
+
+	return empty;
+}
+
+/*
+ * Called by swapoff once every slot has been brought back in, before the
+ * swap extents go away: wait for writebacks still targeting the area.
+ */
+void frontswap_invalidate_area(unsigned type)
+{
+	struct frontswap_entry *entries[16];
+	unsigned long flags;
+	unsigned int nr, i;
+	pgoff_t index = 0;
+
+	if (!frontswap_ready)
+		return;
+
+	spin_lock_irqsave(&frontswap_lock, flags);
+	while ((nr = radix_tree_gang_lookup(&frontswap_trees[type],
+					    (void **)entries, index,
+					    ARRAY_SIZE(entries)))) {
+		for (i = 0; i < nr; i++) {
+			index = entries[i]->offset + 1;
+			if (entries[i]->flags & FRONTSWAP_WRITEBACK)
+				entries[i]->flags |= FRONTSWAP_DEAD;
+			else
+				entry_free(entries[i]);
+		}
+	}
+	spin_unlock_irqrestore(&frontswap_lock, flags);
+
+	wait_event(frontswap_wb_wait, frontswap_area_empty(type));
+}
+
+static void frontswap_end_writeback(struct bio *bio, int err)
+{
+	const int uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
+	struct page *page = bio->bi_io_vec[0].bv_page;
+	struct frontswap_entry *entry;
+	unsigned long flags;
+
+	entry = (struct frontswap_entry *)page_private(page);
+
+	spin_lock_irqsave(&frontswap_lock, flags);
+	frontswap_wb_bytes -= entry_bytes(entry);
+	entry->flags &= ~FRONTSWAP_WRITEBACK;
+	if (entry->flags & FRONTSWAP_DEAD) {
+		entry_free(entry);
+	} else if (uptodate) {
+		entry_free(entry);
+		frontswap_written_back++;
+	} else {
+		/* Keep the only good copy, and retry it later */
+		list_add_tail(&entry->lru, &frontswap_lru);
+		frontswap_writeback_errors++;
+	}
+	spin_unlock_irqrestore(&frontswap_lock, flags);
+
+	wake_up(&frontswap_wb_wait);
+	set_page_private(page, 0);
+	__free_page(page);
+	bio_put(bio);
+}
+
+/*
+ * Write back the oldest entries to their swap slots until the pool (not
+ * counting what is already on its way out) is down to 7/8 of its limit.
+ */
+static void frontswap_writeback_fn(struct work_struct *work)
+{
+	struct frontswap_entry *entry;
+	unsigned long flags;
+	struct page *page;
+	unsigned char *dst;
+	size_t dlen;
+	int ret;
+
+	for (;;) {
+		page = alloc_page(GFP_NOIO | __GFP_NOWARN);
+		if (!page)
+			return;
+
+		spin_lock_irqsave(&frontswap_lock, flags);
+		if (list_empty(&frontswap_lru) ||
+		    frontswap_pool_bytes - frontswap_wb_bytes <=
+		    frontswap_max_bytes() / 8 * 7) {
+			spin_unlock_irqrestore(&frontswap_lock, flags);
+			__free_page(page);
+			return;
+		}
+		entry = list_entry(frontswap_lru.prev,
+				   struct frontswap_entry, lru);
+		list_del_init(&entry->lru);
+		entry->flags |= FRONTSWAP_WRITEBACK;
+		frontswap_wb_bytes += entry_bytes(entry);
+		spin_unlock_irqrestore(&frontswap_lock, flags);
+
+		/*
+		 * Under writeback the entry can only be marked dead, never
+		 * freed or replaced, so its data is stable here.
+		 */
+		dlen = PAGE_SIZE;
+		dst = kmap_atomic(page, KM_USER0);
+		ret = lzo1x_decompress_safe(entry->data, entry->len,
+					    dst, &dlen);
+		kunmap_atomic(dst, KM_USER0);
+		BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+
+		set_page_private(page, (unsigned long)entry);
+		if (swap_writepage_raw(page, swp_entry(entry->type,
+						       entry->offset),
+				       frontswap_end_writeback)) {
+			spin_lock_irqsave(&frontswap_lock, flags);
+			frontswap_wb_bytes -= entry_bytes(entry);
+			entry->flags &= ~FRONTSWAP_WRITEBACK;
+			if (entry->flags & FRONTSWAP_DEAD)
+				entry_free(entry);
+			else
+				list_add_tail(&entry->lru, &frontswap_lru);
+			spin_unlock_irqrestore(&frontswap_lock, flags);
+			wake_up(&frontswap_wb_wait);
+			set_page_private(page, 0);
+			__free_page(page);
+			return;
+		}
+	}
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int __init frontswap_debugfs_init(void)
+{
+	struct dentry *root;
+
+	root = debugfs_create_dir("frontswap", NULL);
+	if (!root)
+		return -ENXIO;
+
+	debugfs_create_u32("max_pool_kbytes", S_IRUGO | S_IWUSR, root,
+			   &frontswap_max_pool_kbytes);
+	debugfs_create_size_t("pool_bytes", S_IRUGO, root,
+			      &frontswap_pool_bytes);
+	debugfs_create_size_t("writeback_bytes", S_IRUGO, root,
+			      &frontswap_wb_bytes);
+	debugfs_create_u64("stored_pages", S_IRUGO, root,
+			   &frontswap_stored_pages);
+	debugfs_create_u64("succ_stores", S_IRUGO, root,
+			   &frontswap_succ_stores);
+	debugfs_create_u64("reject_compress", S_IRUGO, root,
+			   &frontswap_reject_compress);
+	debugfs_create_u64("reject_full", S_IRUGO, root,
+			   &frontswap_reject_full);
+	debugfs_create_u64("reject_nomem", S_IRUGO, root,
+			   &frontswap_reject_nomem);
+	debugfs_create_u64("loads", S_IRUGO, root, &frontswap_loads);
+	debugfs_create_u64("failed_loads", S_IRUGO, root,
+			   &frontswap_failed_loads);
+	debugfs_create_u64("invalidates", S_IRUGO, root,
+			   &frontswap_invalidates);
+	debugfs_create_u64("written_back", S_IRUGO, root,
+			   &frontswap_written_back);
+	debugfs_create_u64("writeback_errors", S_IRUGO, root,
+			   &frontswap_writeback_errors);
+	return 0;
+}
+#else
+static inline int frontswap_debugfs_init(void)
+{
+	return 0;
+}
+#endif /* CONFIG_DEBUG_FS */
+
+static int __init frontswap_init(void)
+{
+	int i, cpu;
+
+	for (i = 0; i < MAX_SWAPFILES; i++)
+		INIT_RADIX_TREE(&frontswap_trees[i], GFP_ATOMIC);
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(frontswap_wrkmem, cpu) =
+			kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+		per_cpu(frontswap_dstmem, cpu) =
+			kmalloc(lzo1x_worst_compress(PAGE_SIZE), GFP_KERNEL);
+		if (!per_cpu(frontswap_wrkmem, cpu) ||
+		    !per_cpu(frontswap_dstmem, cpu)) {
+			printk(KERN_ERR "frontswap: out of memory, disabled\n");
+			return -ENOMEM;
+		}
+	}
+
+	frontswap_max_pool_kbytes = (totalram_pages / 5) << (PAGE_SHIFT - 10);
+	frontswap_debugfs_init();
+	frontswap_ready = 1;
+	return 0;
+}
+module_init(frontswap_init)
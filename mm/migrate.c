@@ -794,6 +794,43 @@ out:
 	return nr_failed + retry;
 }
 
+static struct page *new_page_any(struct page *page, unsigned long private,
+				 int **result)
+{
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+/*
+ * Move all pages on the LRU in [start_pfn, end_pfn) elsewhere, so that
+ * the range can be taken out of the page allocator once it has been
+ * isolated. Free pages and pages not on the LRU are skipped.
+ *
+ * Return: Number of pages not migrated or error code.
+ */
+int migrate_pfn_range(unsigned long start_pfn, unsigned long end_pfn)
+{
+	LIST_HEAD(source);
+	unsigned long pfn;
+	struct page *page;
+
+	migrate_prep();
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
+		if (!pfn_valid(pfn))
+			continue;
+		page = pfn_to_page(pfn);
+		if (!page_count(page) || !PageLRU(page))
+			continue;
+		if (isolate_lru_page(page) == 0)
+			list_add_tail(&page->lru, &source);
+	}
+
+	if (list_empty(&source))
+		return 0;
+
+	return migrate_pages(&source, new_page_any, 0);
+}
+
 #ifdef CONFIG_NUMA
 /*
  * Move a list of individual pages
@@ -916,6 +916,16 @@ static struct page *__rmqueue(struct zone *zone, unsigned int order,
 retry_reserve:
 	page = __rmqueue_smallest(zone, order, migratetype);
 
+#ifdef CONFIG_BPA2_MOVABLE
+	/*
+	 * Movable allocations borrow from lent BPA2 partitions before
+	 * falling back to the other types, so that unmovable and movable
+	 * pages stay apart for as long as possible.
+	 */
+	if (unlikely(!page) && migratetype == MIGRATE_MOVABLE)
+		page = __rmqueue_smallest(zone, order, MIGRATE_BPA2);
+#endif
+
 	if (unlikely(!page) && migratetype != MIGRATE_RESERVE) {
 		page = __rmqueue_fallback(zone, order, migratetype);
 
@@ -964,7 +974,11 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			list_add(&page->lru, list);
 		else
 			list_add_tail(&page->lru, list);
-		set_page_private(page, migratetype);
+		/* Lent BPA2 pages must go back to their own free list */
+		if (is_migrate_bpa2(get_pageblock_migratetype(page)))
+			set_page_private(page, get_pageblock_migratetype(page));
+		else
+			set_page_private(page, migratetype);
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
@@ -5034,6 +5048,7 @@ int set_migratetype_isolate(struct page *page)
 	 * In future, more migrate types will be able to be isolation target.
 	 */
 	if (get_pageblock_migratetype(page) != MIGRATE_MOVABLE &&
+	    !is_migrate_bpa2(get_pageblock_migratetype(page)) &&
 	    zone_idx != ZONE_MOVABLE)
 		goto out;
 	set_pageblock_migratetype(page, MIGRATE_ISOLATE);
@@ -5046,7 +5061,7 @@ out:
 	return ret;
 }
 
-void unset_migratetype_isolate(struct page *page)
+void unset_migratetype_isolate(struct page *page, int migratetype)
 {
 	struct zone *zone;
 	unsigned long flags;
@@ -5054,12 +5069,77 @@ void unset_migratetype_isolate(struct page *page)
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) != MIGRATE_ISOLATE)
 		goto out;
-	set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-	move_freepages_block(zone, page, MIGRATE_MOVABLE);
+	set_pageblock_migratetype(page, migratetype);
+	move_freepages_block(zone, page, migratetype);
 out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 
+#ifdef CONFIG_BPA2_MOVABLE
+/*
+ * Take all pages of an isolated range out of the free lists and mark them
+ * Reserved, or return -EBUSY without touching anything if some page in it
+ * is not free. start_pfn and end_pfn must be MAX_ORDER aligned, so that
+ * no free page straddles the boundaries.
+ */
+int claim_isolated_page_range(unsigned long start_pfn, unsigned long end_pfn)
+{
+	struct zone *zone = page_zone(pfn_to_page(start_pfn));
+	struct page *page;
+	unsigned long pfn;
+	unsigned long flags;
+	int order, i;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	for (pfn = start_pfn; pfn < end_pfn; pfn += 1 << page_order(page)) {
+		page = pfn_to_page(pfn);
+		if (!PageBuddy(page)) {
+			spin_unlock_irqrestore(&zone->lock, flags);
+			return -EBUSY;
+		}
+	}
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn += 1 << order) {
+		page = pfn_to_page(pfn);
+		order = page_order(page);
+		list_del(&page->lru);
+		rmv_page_order(page);
+		zone->free_area[order].nr_free--;
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+		for (i = 0; i < (1 << order); i++)
+			SetPageReserved(page + i);
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+	return 0;
+}
+
+/*
+ * Hand a range of Reserved (or claimed) pages over to the page allocator
+ * as free pages of the given migratetype. The range must be MAX_ORDER
+ * aligned.
+ */
+void lend_page_range(unsigned long start_pfn, unsigned long end_pfn,
+		     int migratetype)
+{
+	struct page *page;
+	unsigned long pfn;
+	int i;
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn += pageblock_nr_pages)
+		set_pageblock_migratetype(pfn_to_page(pfn), migratetype);
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn += MAX_ORDER_NR_PAGES) {
+		page = pfn_to_page(pfn);
+		for (i = 0; i < MAX_ORDER_NR_PAGES; i++) {
+			ClearPageReserved(page + i);
+			set_page_count(page + i, 0);
+		}
+		set_page_refcounted(page);
+		__free_pages(page, MAX_ORDER - 1);
+	}
+}
+#endif
+
 #ifdef CONFIG_MEMORY_HOTREMOVE
 /*
  * All pages in the range must be isolated before calling this.
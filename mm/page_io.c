@@ -17,6 +17,7 @@
 #include <linux/bio.h>
 #include <linux/swapops.h>
 #include <linux/writeback.h>
+#include <linux/frontswap.h>
 #include <asm/pgtable.h>
 
 static struct bio *get_swap_bio(gfp_t gfp_flags, pgoff_t index,
@@ -102,6 +103,12 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 		unlock_page(page);
 		goto out;
 	}
+	if (frontswap_store(page) == 0) {
+		set_page_writeback(page);
+		unlock_page(page);
+		end_page_writeback(page);
+		goto out;
+	}
 	bio = get_swap_bio(GFP_NOIO, page_private(page), page,
 				end_swap_bio_write);
 	if (bio == NULL) {
@@ -120,6 +127,24 @@ out:
 	return ret;
 }
 
+/*
+ * Write a page which is not in the swap cache to an allocated swap slot,
+ * e.g. when frontswap writes back a compressed page.  @end_io owns the page
+ * and the bio once this returns 0.
+ */
+int swap_writepage_raw(struct page *page, swp_entry_t entry,
+		       void (*end_io)(struct bio *, int))
+{
+	struct bio *bio;
+
+	bio = get_swap_bio(GFP_NOIO, entry.val, page, end_io);
+	if (bio == NULL)
+		return -ENOMEM;
+	count_vm_event(PSWPOUT);
+	submit_bio(WRITE, bio);
+	return 0;
+}
+
 int swap_readpage(struct page *page)
 {
 	struct bio *bio;
@@ -127,6 +152,11 @@ int swap_readpage(struct page *page)
 
 	VM_BUG_ON(!PageLocked(page));
 	VM_BUG_ON(PageUptodate(page));
+	if (frontswap_load(page) == 0) {
+		SetPageUptodate(page);
+		unlock_page(page);
+		goto out;
+	}
 	bio = get_swap_bio(GFP_KERNEL, page_private(page), page,
 				end_swap_bio_read);
 	if (bio == NULL) {
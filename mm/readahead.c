@@ -16,6 +16,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/cleancache.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -122,7 +123,8 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		struct page *page = list_to_page(pages);
 		list_del(&page->lru);
 		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
+					page->index, GFP_KERNEL) &&
+		    !cleancache_readpage(page)) {
 			mapping->a_ops->readpage(filp, page);
 		}
 		page_cache_release(page);
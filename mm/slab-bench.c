@@ -0,0 +1,178 @@
+/*
+ * mm/slab-bench.c
+ *
+ * Slab allocator microbenchmark.
+ *
+ * Measures kmalloc()/kfree() throughput for each kmalloc cache size
+ * from 8 to 4096 bytes in three patterns:
+ *
+ *  - batch:  allocate nr_objects objects, then free them all. Mostly
+ *            exercises the slow paths and the (cpu) partial lists.
+ *  - pair:   allocate and immediately free one object, nr_objects times.
+ *            This is the allocation fast path.
+ *  - mixed:  allocate nr_objects objects, punch holes into the older
+ *            slabs, refill them and free everything oldest first, so that
+ *            most frees hit a slab which is not the cpu slab.
+ *
+ * Results are printed to the kernel log in nanoseconds per operation.
+ * The module fails to load on purpose once the run is over, so that it
+ * can simply be loaded again for another run:
+ *
+ *	modprobe slab-bench nr_objects=20000 runs=5
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+
+static unsigned int nr_objects = 10000;
+module_param(nr_objects, uint, 0444);
+MODULE_PARM_DESC(nr_objects, "Objects allocated per size and pattern");
+
+static unsigned int runs = 3;
+module_param(runs, uint, 0444);
+MODULE_PARM_DESC(runs, "Number of times each measurement is repeated");
+
+static void **objs;
+
+static u64 bench_ns(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int bench_batch(size_t size, u64 *alloc_ns, u64 *free_ns)
+{
+	ktime_t start;
+	unsigned int i;
+
+	start = ktime_get();
+	for (i = 0; i < nr_objects; i++) {
+		objs[i] = kmalloc(size, GFP_KERNEL);
+		if (!objs[i])
+			break;
+	}
+	*alloc_ns += bench_ns(start);
+
+	if (i < nr_objects) {
+		while (i--)
+			kfree(objs[i]);
+		return -ENOMEM;
+	}
+
+	start = ktime_get();
+	for (i = 0; i < nr_objects; i++)
+		kfree(objs[i]);
+	*free_ns += bench_ns(start);
+	return 0;
+}
+
+static int bench_pair(size_t size, u64 *ns)
+{
+	ktime_t start;
+	unsigned int i;
+	void *p;
+
+	start = ktime_get();
+	for (i = 0; i < nr_objects; i++) {
+		p = kmalloc(size, GFP_KERNEL);
+		if (!p)
+			return -ENOMEM;
+		kfree(p);
+	}
+	*ns += bench_ns(start);
+	return 0;
+}
+
+static int bench_mixed(size_t size, u64 *ns)
+{
+	unsigned int i, half = nr_objects / 2;
+	ktime_t start;
+
+	for (i = 0; i < nr_objects; i++) {
+		objs[i] = kmalloc(size, GFP_KERNEL);
+		if (!objs[i]) {
+			while (i--)
+				kfree(objs[i]);
+			return -ENOMEM;
+		}
+	}
+
+	/*
+	 * Free every other object of the first half, allocate the same
+	 * number again (refilling from the slabs just made partial), then
+	 * free everything oldest first.
+	 */
+	start = ktime_get();
+	for (i = 0; i < half; i += 2)
+		kfree(objs[i]);
+	/* A failed allocation leaves NULL, which kfree() ignores */
+	for (i = 0; i < half; i += 2)
+		objs[i] = kmalloc(size, GFP_KERNEL);
+	for (i = 0; i < nr_objects; i++)
+		kfree(objs[i]);
+	*ns += bench_ns(start);
+	return 0;
+}
+
+static int __init slab_bench_init(void)
+{
+	size_t size;
+	int err = 0;
+
+	if (!nr_objects || !runs)
+		return -EINVAL;
+
+	objs = vmalloc(nr_objects * sizeof(void *));
+	if (!objs)
+		return -ENOMEM;
+
+	printk(KERN_INFO "slab-bench: %u objects, %u runs, ns/op\n",
+	       nr_objects, runs);
+	printk(KERN_INFO "slab-bench:  size   alloc    free    pair   mixed\n");
+
+	for (size = 8; size <= 4096 && !err; size <<= 1) {
+		u64 alloc_ns = 0, free_ns = 0, pair_ns = 0, mixed_ns = 0;
+		u64 ops = (u64)nr_objects * runs;
+		unsigned int r;
+
+		for (r = 0; r < runs && !err; r++) {
+			err = bench_batch(size, &alloc_ns, &free_ns);
+			if (!err)
+				err = bench_pair(size, &pair_ns);
+			if (!err)
+				err = bench_mixed(size, &mixed_ns);
+			cond_resched();
+		}
+		if (err) {
+			printk(KERN_ERR "slab-bench: out of memory at size %zu\n",
+			       size);
+			break;
+		}
+
+		printk(KERN_INFO "slab-bench: %5zu %7llu %7llu %7llu %7llu\n",
+		       size,
+		       (unsigned long long)div64_u64(alloc_ns, ops),
+		       (unsigned long long)div64_u64(free_ns, ops),
+		       (unsigned long long)div64_u64(pair_ns, ops),
+		       (unsigned long long)div64_u64(mixed_ns, ops));
+	}
+
+	vfree(objs);
+
+	/* Do not stay loaded, so that the next modprobe runs it again */
+	return err ? err : -EAGAIN;
+}
+module_init(slab_bench_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Slab allocator alloc/free microbenchmark");
@@ -66,10 +66,24 @@
  *   a partial slab. A new slab has noone operating on it and thus there is
  *   no danger of cacheline contention.
  *
- *   Interrupts are disabled during allocation and deallocation in order to
- *   make the slab allocator safe to use in the context of an irq. In addition
- *   interrupts are disabled to ensure that the processor does not change
- *   while handling per_cpu slabs, due to kernel preemption.
+ *   Interrupts are disabled during the slow paths of allocation and
+ *   deallocation in order to make the slab allocator safe to use in the
+ *   context of an irq.
+ *
+ *   The fast paths only disable preemption. There is no double word
+ *   cmpxchg on many architectures (sh among them), so instead of updating
+ *   the cpu freelist atomically the fast path sets c->in_fastpath while it
+ *   touches c->freelist and c->page. An interrupt that finds the flag set
+ *   leaves both alone: it allocates from the cpu partial slabs (or the
+ *   node) and frees through __slab_free with interrupts disabled. Since
+ *   interrupts nest, the interrupted fast path always resumes after the
+ *   nested operation has completed.
+ *
+ *   Each processor keeps a short list of frozen partial slabs
+ *   (c->partial) that it refills the cpu slab from, and that slabs which
+ *   become partial on free are added to, so that the list_lock is only
+ *   taken when that list runs empty or overflows. The cpu partial list
+ *   is only touched with interrupts disabled and never by the fast paths.
  *
  * SLUB assigns one slab for allocation to each processor.
  * Allocations only occur from these slabs called cpu slabs.
@@ -1322,10 +1336,15 @@ static inline int lock_and_freeze_slab(struct kmem_cache_node *n,
 
 /*
  * Try to allocate a partial slab from a specific node.
+ *
+ * While the list_lock is held, up to half of s->cpu_partial further
+ * slabs are frozen and moved to the cpu partial list so that the next
+ * refills do not have to come back to the node.
  */
-static struct page *get_partial_node(struct kmem_cache_node *n)
+static struct page *get_partial_node(struct kmem_cache *s,
+		struct kmem_cache_node *n, struct kmem_cache_cpu *c)
 {
-	struct page *page;
+	struct page *page, *page2, *object_page = NULL;
 
 	/*
 	 * Racy check. If we mistakenly see no partial slabs then we
@@ -1337,19 +1356,33 @@ static struct page *get_partial_node(struct kmem_cache_node *n)
 		return NULL;
 
 	spin_lock(&n->list_lock);
-	list_for_each_entry(page, &n->partial, lru)
-		if (lock_and_freeze_slab(n, page))
-			goto out;
-	page = NULL;
-out:
+	list_for_each_entry_safe(page, page2, &n->partial, lru) {
+		if (object_page) {
+			if (c->nr_partial >= s->cpu_partial / 2)
+				break;
+			if (SLABDEBUG && PageSlubDebug(page))
+				continue;
+		}
+		if (!lock_and_freeze_slab(n, page))
+			continue;
+		if (!object_page) {
+			object_page = page;
+			continue;
+		}
+		slab_unlock(page);
+		list_add_tail(&page->lru, &c->partial);
+		c->nr_partial++;
+		stat(c, CPU_PARTIAL_NODE);
+	}
 	spin_unlock(&n->list_lock);
-	return page;
+	return object_page;
 }
 
 /*
  * Get a page from somewhere. Search in increasing NUMA distances.
  */
-static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
+static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags,
+					struct kmem_cache_cpu *c)
 {
 #ifdef CONFIG_NUMA
 	struct zonelist *zonelist;
@@ -1388,7 +1421,7 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 
 		if (n && cpuset_zone_allowed_hardwall(zone, flags) &&
 				n->nr_partial > s->min_partial) {
-			page = get_partial_node(n);
+			page = get_partial_node(s, n, c);
 			if (page)
 				return page;
 		}
@@ -1400,16 +1433,17 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 /*
  * Get a partial page, lock it and return it.
  */
-static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node)
+static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node,
+				struct kmem_cache_cpu *c)
 {
 	struct page *page;
 	int searchnode = (node == -1) ? numa_node_id() : node;
 
-	page = get_partial_node(get_node(s, searchnode));
+	page = get_partial_node(s, get_node(s, searchnode), c);
 	if (page || (flags & __GFP_THISNODE))
 		return page;
 
-	return get_any_partial(s, flags);
+	return get_any_partial(s, flags, c);
 }
 
 /*
@@ -1500,17 +1534,57 @@ static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	deactivate_slab(s, c);
 }
 
+/*
+ * Return all slabs on the cpu partial list to their nodes.
+ *
+ * Interrupts must be disabled.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct page *page, *page2;
+
+	list_for_each_entry_safe(page, page2, &c->partial, lru) {
+		list_del(&page->lru);
+		stat(c, CPU_PARTIAL_DRAIN);
+		slab_lock(page);
+		unfreeze_slab(s, page, 1);
+	}
+	c->nr_partial = 0;
+}
+
+/*
+ * Add a frozen, unlocked slab to the cpu partial list, draining the list
+ * first if it is full.
+ *
+ * Interrupts must be disabled.
+ */
+static void put_cpu_partial(struct kmem_cache *s, struct kmem_cache_cpu *c,
+							struct page *page)
+{
+	if (c->nr_partial >= s->cpu_partial)
+		unfreeze_partials(s, c);
+	list_add(&page->lru, &c->partial);
+	c->nr_partial++;
+}
+
 /*
  * Flush cpu slab.
  *
- * Called from IPI handler with interrupts disabled.
+ * Called from IPI handler with interrupts disabled. If the IPI interrupted
+ * a fast path on this processor then the cpu slab is in use and is left
+ * alone; the next flush will get it.
  */
 static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = get_cpu_slab(s, cpu);
 
-	if (likely(c && c->page))
+	if (unlikely(!c))
+		return;
+
+	if (c->page && likely(!c->in_fastpath))
 		flush_slab(s, c);
+	if (c->nr_partial)
+		unfreeze_partials(s, c);
 }
 
 static void flush_cpu_slab(void *d)
@@ -1657,7 +1731,19 @@ another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
-	new = get_partial(s, gfpflags, node);
+	if (!list_empty(&c->partial)) {
+		new = list_first_entry(&c->partial, struct page, lru);
+		if (node == -1 || page_to_nid(new) == node) {
+			list_del(&new->lru);
+			c->nr_partial--;
+			slab_lock(new);
+			c->page = new;
+			stat(c, CPU_PARTIAL_ALLOC);
+			goto load_freelist;
+		}
+	}
+
+	new = get_partial(s, gfpflags, node, c);
 	if (new) {
 		c->page = new;
 		stat(c, ALLOC_FROM_PARTIAL);
@@ -1695,6 +1781,72 @@ debug:
 	goto unlock_out;
 }
 
+/*
+ * Allocation from an interrupt that arrived while this processor was in
+ * the allocation or free fastpath. c->freelist and c->page belong to the
+ * interrupted code, so take an object straight from the regular freelist
+ * of a slab on the cpu partial list, refilling that list from the node
+ * partial lists or the page allocator as needed.
+ *
+ * Interrupts are disabled.
+ */
+static void *__slab_alloc_nested(struct kmem_cache *s, gfp_t gfpflags,
+		int node, unsigned long addr, struct kmem_cache_cpu *c)
+{
+	void **object;
+	struct page *page;
+
+	/* We handle __GFP_ZERO in the caller and must not sleep */
+	gfpflags &= ~(__GFP_ZERO | __GFP_WAIT);
+	stat(c, ALLOC_NESTED);
+
+	list_for_each_entry(page, &c->partial, lru) {
+		if (node != -1 && page_to_nid(page) != node)
+			continue;
+		slab_lock(page);
+		object = page->freelist;
+		if (object) {
+			page->freelist = get_freepointer(s, object);
+			page->inuse++;
+			slab_unlock(page);
+			return object;
+		}
+		slab_unlock(page);
+	}
+
+again:
+	page = get_partial(s, gfpflags, node, c);
+	if (!page) {
+		page = new_slab(s, gfpflags, node);
+		if (!page) {
+			if (!(gfpflags & __GFP_NOWARN) && printk_ratelimit())
+				slab_out_of_memory(s, gfpflags, node);
+			return NULL;
+		}
+		stat(c, ALLOC_SLAB);
+		slab_lock(page);
+		__SetPageSlubFrozen(page);
+	}
+
+	object = page->freelist;
+	if (unlikely(SLABDEBUG && PageSlubDebug(page))) {
+		if (!alloc_debug_processing(s, page, object, addr)) {
+			unfreeze_slab(s, page, 0);
+			goto again;
+		}
+		page->inuse++;
+		page->freelist = get_freepointer(s, object);
+		unfreeze_slab(s, page, 0);
+		return object;
+	}
+
+	page->inuse++;
+	page->freelist = get_freepointer(s, object);
+	slab_unlock(page);
+	put_cpu_partial(s, c, page);
+	return object;
+}
+
 /*
  * Inlined fastpath so that allocation functions (kmalloc, kmem_cache_alloc)
  * have the fastpath folded into their functions. So no function call
@@ -1704,6 +1856,8 @@ debug:
  * If not then __slab_alloc is called for slow processing.
  *
  * Otherwise we can simply pick the next object from the lockless free list.
+ * Only preemption is disabled for that; see the comment at the top of the
+ * file for how interrupts arriving in the middle of it are dealt with.
  */
 static __always_inline void *slab_alloc(struct kmem_cache *s,
 		gfp_t gfpflags, int node, unsigned long addr)
@@ -1721,20 +1875,35 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	if (should_failslab(s->objsize, gfpflags))
 		return NULL;
 
-	local_irq_save(flags);
+	preempt_disable();
 	c = get_cpu_slab(s, smp_processor_id());
 	objsize = c->objsize;
-	if (unlikely(!c->freelist || !node_match(c, node)))
+	if (likely(!c->in_fastpath)) {
+		c->in_fastpath = 1;
+		barrier();
+		object = c->freelist;
+		if (likely(object && node_match(c, node))) {
+			c->freelist = object[c->offset];
+			stat(c, ALLOC_FASTPATH);
+			barrier();
+			c->in_fastpath = 0;
+			preempt_enable();
+			goto out;
+		}
+		barrier();
+		c->in_fastpath = 0;
 
+		local_irq_save(flags);
+		/* __slab_alloc() may enable interrupts and sleep */
+		preempt_enable();
 		object = __slab_alloc(s, gfpflags, node, addr, c);
-
-	else {
-		object = c->freelist;
-		c->freelist = object[c->offset];
-		stat(c, ALLOC_FASTPATH);
+	} else {
+		local_irq_save(flags);
+		object = __slab_alloc_nested(s, gfpflags, node, addr, c);
+		preempt_enable();
 	}
 	local_irq_restore(flags);
-
+out:
 	if (unlikely((gfpflags & __GFP_ZERO) && object))
 		memset(object, 0, objsize);
 
@@ -1825,6 +1994,14 @@ checks_ok:
 	 * then add it.
 	 */
 	if (unlikely(!prior)) {
+		if (s->cpu_partial && !(SLABDEBUG && PageSlubDebug(page))) {
+			/* Keep it on this processor rather than the node */
+			__SetPageSlubFrozen(page);
+			slab_unlock(page);
+			put_cpu_partial(s, c, page);
+			stat(c, CPU_PARTIAL_FREE);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(c, FREE_ADD_PARTIAL);
 	}
@@ -1861,7 +2038,8 @@ debug:
  * the item before.
  *
  * If fastpath is not possible then fall back to __slab_free where we deal
- * with all sorts of special processing.
+ * with all sorts of special processing. This is also where frees from an
+ * interrupt that arrived in the middle of a fastpath end up.
  */
 static __always_inline void slab_free(struct kmem_cache *s,
 			struct page *page, void *x, unsigned long addr)
@@ -1871,20 +2049,33 @@ static __always_inline void slab_free(struct kmem_cache *s,
 	unsigned long flags;
 
 	kmemleak_free_recursive(x, s->flags);
-	local_irq_save(flags);
+	preempt_disable();
 	c = get_cpu_slab(s, smp_processor_id());
 	kmemcheck_slab_free(s, object, c->objsize);
 	debug_check_no_locks_freed(object, c->objsize);
 	if (!(s->flags & SLAB_DEBUG_OBJECTS))
 		debug_check_no_obj_freed(object, c->objsize);
-	if (likely(page == c->page && c->node >= 0)) {
-		object[c->offset] = c->freelist;
-		c->freelist = object;
-		stat(c, FREE_FASTPATH);
+	if (likely(!c->in_fastpath)) {
+		c->in_fastpath = 1;
+		barrier();
+		if (likely(page == c->page && c->node >= 0)) {
+			object[c->offset] = c->freelist;
+			c->freelist = object;
+			stat(c, FREE_FASTPATH);
+			barrier();
+			c->in_fastpath = 0;
+			preempt_enable();
+			return;
+		}
+		barrier();
+		c->in_fastpath = 0;
 	} else
-		__slab_free(s, page, x, addr, c->offset);
+		stat(c, FREE_NESTED);
 
+	local_irq_save(flags);
+	__slab_free(s, page, x, addr, c->offset);
 	local_irq_restore(flags);
+	preempt_enable();
 }
 
 void kmem_cache_free(struct kmem_cache *s, void *x)
@@ -2077,6 +2268,9 @@ static void init_kmem_cache_cpu(struct kmem_cache *s,
 	c->node = 0;
 	c->offset = s->offset / sizeof(void *);
 	c->objsize = s->objsize;
+	c->in_fastpath = 0;
+	c->nr_partial = 0;
+	INIT_LIST_HEAD(&c->partial);
 #ifdef CONFIG_SLUB_STATS
 	memset(c->stat, 0, NR_SLUB_STAT_ITEMS * sizeof(unsigned));
 #endif
@@ -2493,6 +2687,23 @@ static int kmem_cache_open(struct kmem_cache *s, gfp_t gfpflags,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+
+	/*
+	 * Slabs of large objects fill up after a few allocations, so a couple
+	 * of them per processor is enough. Debug slabs always go through the
+	 * node lists where the full slab tracking can see them.
+	 */
+	if (s->flags & (SLAB_DEBUG_FREE | SLAB_RED_ZONE | SLAB_POISON |
+					SLAB_STORE_USER | SLAB_TRACE))
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 4;
+	else if (s->size >= 256)
+		s->cpu_partial = 6;
+	else
+		s->cpu_partial = 8;
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -4088,6 +4299,44 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long slabs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &slabs);
+	if (err)
+		return err;
+	if (slabs > USHORT_MAX / 2)
+		return -EINVAL;
+
+	s->cpu_partial = slabs;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	unsigned long pages = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct kmem_cache_cpu *c = get_cpu_slab(s, cpu);
+
+		if (c)
+			pages += c->nr_partial;
+	}
+	return sprintf(buf, "%lu\n", pages);
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (s->ctor) {
@@ -4396,6 +4645,12 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(ALLOC_NESTED, alloc_nested);
+STAT_ATTR(FREE_NESTED, free_nested);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4404,6 +4659,8 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&total_objects_attr.attr,
@@ -4450,6 +4707,12 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_node_attr.attr,
+	&cpu_partial_drain_attr.attr,
+	&alloc_nested_attr.attr,
+	&free_nested_attr.attr,
 #endif
 	NULL
 };
@@ -3457,7 +3457,7 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 	__netif_tx_lock_bh(txq);
 	atomic_inc(&(pkt_dev->skb->users));
 
-	if (unlikely(netif_tx_queue_stopped(txq) || netif_tx_queue_frozen(txq)))
+	if (unlikely(netif_xmit_frozen_or_stopped(txq)))
 		ret = NETDEV_TX_BUSY;
 	else
 		ret = (*xmit)(pkt_dev->skb, odev);
@@ -57,12 +57,16 @@
 #include <linux/init.h>
 #include <linux/scatterlist.h>
 #include <linux/errqueue.h>
+#include <linux/cpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <net/protocol.h>
 #include <net/dst.h>
 #include <net/sock.h>
 #include <net/checksum.h>
 #include <net/xfrm.h>
+#include <net/net_namespace.h>
 
 #include <asm/uaccess.h>
 #include <asm/system.h>
@@ -73,6 +77,23 @@
 static struct kmem_cache *skbuff_head_cache __read_mostly;
 static struct kmem_cache *skbuff_fclone_cache __read_mostly;
 
+/*
+ * Per cpu pool of receive buffers. Devices flagged IFF_SKB_RECYCLE get
+ * their __netdev_alloc_skb() buffers from here, and those buffers come
+ * back when they are freed, wherever in the stack that happens.
+ */
+struct skb_recycle_pool {
+	struct sk_buff_head	list;
+	unsigned long		hits;		/* allocations served */
+	unsigned long		misses;		/* pool empty on allocation */
+	unsigned long		recycled;	/* buffers returned on free */
+	unsigned long		overflows;	/* pool full on free */
+};
+
+static DEFINE_PER_CPU(struct skb_recycle_pool, skb_recycle_pool);
+
+int sysctl_skb_recycle_max __read_mostly = 64;
+
 static void sock_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
@@ -235,6 +256,43 @@ nodata:
 }
 EXPORT_SYMBOL(__alloc_skb);
 
+/*
+ * Reset a buffer which is about to be reused to the state __alloc_skb()
+ * leaves it in, with headroom bytes reserved.
+ */
+static void skb_reset_for_reuse(struct sk_buff *skb, unsigned int headroom)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+
+	memset(shinfo, 0, offsetof(struct skb_shared_info, dataref));
+	atomic_set(&shinfo->dataref, 1);
+
+	memset(skb, 0, offsetof(struct sk_buff, tail));
+	skb->data = skb->head + headroom;
+	skb_reset_tail_pointer(skb);
+#ifdef NET_SKBUFF_DATA_USES_OFFSET
+	skb->mac_header = ~0U;
+#endif
+}
+
+static struct sk_buff *skb_recycle_pool_get(void)
+{
+	struct skb_recycle_pool *pool;
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	pool = &__get_cpu_var(skb_recycle_pool);
+	skb = __skb_dequeue(&pool->list);
+	if (skb)
+		pool->hits++;
+	else
+		pool->misses++;
+	local_irq_restore(flags);
+
+	return skb;
+}
+
 /**
  *	__netdev_alloc_skb - allocate an skbuff for rx on a specific device
  *	@dev: network device to receive on
@@ -246,6 +304,10 @@ EXPORT_SYMBOL(__alloc_skb);
  *	the headroom they think they need without accounting for the
  *	built in space. The built in space is used for optimisations.
  *
+ *	Devices with %IFF_SKB_RECYCLE set in priv_flags get buffers of up to
+ *	%SKB_RECYCLE_SIZE bytes from a per cpu pool, which the buffers are
+ *	returned to when they are freed.
+ *
  *	%NULL is returned if there is no free memory.
  */
 struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
@@ -254,7 +316,15 @@ struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 	int node = dev->dev.parent ? dev_to_node(dev->dev.parent) : -1;
 	struct sk_buff *skb;
 
-	skb = __alloc_skb(length + NET_SKB_PAD, gfp_mask, 0, node);
+	if ((dev->priv_flags & IFF_SKB_RECYCLE) &&
+	    length + NET_SKB_PAD <= SKB_RECYCLE_SIZE) {
+		skb = skb_recycle_pool_get();
+		if (!skb)
+			skb = __alloc_skb(SKB_RECYCLE_SIZE, gfp_mask, 0, node);
+		if (likely(skb))
+			skb->recycle = 1;
+	} else
+		skb = __alloc_skb(length + NET_SKB_PAD, gfp_mask, 0, node);
 	if (likely(skb)) {
 		skb_reserve(skb, NET_SKB_PAD);
 		skb->dev = dev;
@@ -416,6 +486,56 @@ static void skb_release_all(struct sk_buff *skb)
 	skb_release_data(skb);
 }
 
+/*
+ * Called on the last reference of a buffer allocated from the pool.
+ * Returns 1 if the buffer went back to the pool of this cpu.
+ */
+static int skb_recycle_pool_put(struct sk_buff *skb)
+{
+	struct skb_recycle_pool *pool;
+	unsigned long flags;
+
+	if (skb->cloned || skb_is_nonlinear(skb) ||
+	    skb->fclone != SKB_FCLONE_UNAVAILABLE ||
+	    skb_end_pointer(skb) - skb->head != SKB_RECYCLE_SIZE)
+		return 0;
+
+	pool = &get_cpu_var(skb_recycle_pool);
+	if (skb_queue_len(&pool->list) >= sysctl_skb_recycle_max) {
+		pool->overflows++;
+		put_cpu_var(skb_recycle_pool);
+		return 0;
+	}
+	put_cpu_var(skb_recycle_pool);
+
+	skb_release_head_state(skb);
+	skb_reset_for_reuse(skb, 0);
+	skb->truesize = SKB_RECYCLE_SIZE + sizeof(struct sk_buff);
+	atomic_set(&skb->users, 1);
+
+	local_irq_save(flags);
+	pool = &__get_cpu_var(skb_recycle_pool);
+	__skb_queue_head(&pool->list, skb);
+	pool->recycled++;
+	local_irq_restore(flags);
+
+	return 1;
+}
+
+static void skb_recycle_pool_drain(int cpu)
+{
+	struct skb_recycle_pool *pool = &per_cpu(skb_recycle_pool, cpu);
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	while ((skb = __skb_dequeue(&pool->list)) != NULL) {
+		skb->recycle = 0;
+		__kfree_skb(skb);
+	}
+	local_irq_restore(flags);
+}
+
 /**
  *	__kfree_skb - private function
  *	@skb: buffer
@@ -427,6 +547,8 @@ static void skb_release_all(struct sk_buff *skb)
 
 void __kfree_skb(struct sk_buff *skb)
 {
+	if (skb->recycle && skb_recycle_pool_put(skb))
+		return;
 	skb_release_all(skb);
 	kfree_skbmem(skb);
 }
@@ -486,8 +608,6 @@ EXPORT_SYMBOL(consume_skb);
  */
 int skb_recycle_check(struct sk_buff *skb, int skb_size)
 {
-	struct skb_shared_info *shinfo;
-
 	if (skb_is_nonlinear(skb) || skb->fclone != SKB_FCLONE_UNAVAILABLE)
 		return 0;
 
@@ -499,14 +619,7 @@ int skb_recycle_check(struct sk_buff *skb, int skb_size)
 		return 0;
 
 	skb_release_head_state(skb);
-
-	shinfo = skb_shinfo(skb);
-	memset(shinfo, 0, offsetof(struct skb_shared_info, dataref));
-	atomic_set(&shinfo->dataref, 1);
-
-	memset(skb, 0, offsetof(struct sk_buff, tail));
-	skb->data = skb->head + NET_SKB_PAD;
-	skb_reset_tail_pointer(skb);
+	skb_reset_for_reuse(skb, NET_SKB_PAD);
 
 	return 1;
 }
@@ -535,6 +648,7 @@ static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 #endif
 	new->protocol		= old->protocol;
 	new->mark		= old->mark;
+	new->rxhash		= old->rxhash;
 	new->iif		= old->iif;
 	__nf_copy(new, old);
 #if defined(CONFIG_NETFILTER_XT_TARGET_TRACE) || \
@@ -2761,8 +2875,51 @@ done:
 }
 EXPORT_SYMBOL_GPL(skb_gro_receive);
 
+#ifdef CONFIG_PROC_FS
+static int skb_recycle_seq_show(struct seq_file *seq, void *v)
+{
+	int cpu;
+
+	seq_printf(seq, "buffer size %u, max %d per cpu\n",
+		   (unsigned int)SKB_RECYCLE_SIZE, sysctl_skb_recycle_max);
+	seq_puts(seq, "cpu       pooled         hits       misses"
+		      "     recycled    overflows\n");
+	for_each_online_cpu(cpu) {
+		struct skb_recycle_pool *pool = &per_cpu(skb_recycle_pool, cpu);
+
+		seq_printf(seq, "%3d %12u %12lu %12lu %12lu %12lu\n", cpu,
+			   skb_queue_len(&pool->list), pool->hits,
+			   pool->misses, pool->recycled, pool->overflows);
+	}
+	return 0;
+}
+
+static int skb_recycle_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, skb_recycle_seq_show, NULL);
+}
+
+static const struct file_operations skb_recycle_seq_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = skb_recycle_seq_open,
+	.read	 = seq_read,
+	.llseek	 = seq_lseek,
+	.release = single_release,
+};
+#endif
+
+static int __cpuinit skb_recycle_cpu_callback(struct notifier_block *nfb,
+					      unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		skb_recycle_pool_drain((unsigned long)hcpu);
+	return NOTIFY_OK;
+}
+
 void __init skb_init(void)
 {
+	int cpu;
+
 	skbuff_head_cache = kmem_cache_create("skbuff_head_cache",
 					      sizeof(struct sk_buff),
 					      0,
@@ -2774,6 +2931,12 @@ void __init skb_init(void)
 						0,
 						SLAB_HWCACHE_ALIGN|SLAB_PANIC,
 						NULL);
+
+	for_each_possible_cpu(cpu)
+		skb_queue_head_init(&per_cpu(skb_recycle_pool, cpu).list);
+	hotcpu_notifier(skb_recycle_cpu_callback, 0);
+	proc_net_fops_create(&init_net, "skb_recycle", S_IRUGO,
+			     &skb_recycle_seq_fops);
 }
 
 /**
@@ -0,0 +1,98 @@
+/*
+ * FLOWOFFLOAD target: hand established connections over to the IPv4
+ * flow offload fast path.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Used in the FORWARD chain.  Each direction of a connection is offloaded
+ * by the first of its packets hitting the rule once the connection is
+ * established; the packet itself still goes the slow path, the following
+ * ones are forwarded from the PRE_ROUTING hook of nf_flow_offload_ipv4.
+ */
+
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <linux/ip.h>
+#include <net/dst.h>
+
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_flow_offload.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Xtables: IPv4 flow offload target");
+
+static bool flowoffload_suitable(const struct nf_conn *ct,
+				 const struct sk_buff *skb)
+{
+	const struct nf_conn_help *help;
+
+	if (!test_bit(IPS_SEEN_REPLY_BIT, &ct->status) ||
+	    test_bit(IPS_SEQ_ADJUST_BIT, &ct->status) ||
+	    test_bit(IPS_FIXED_TIMEOUT_BIT, &ct->status))
+		return false;
+
+	switch (nf_ct_protonum(ct)) {
+	case IPPROTO_TCP:
+		if (ct->proto.tcp.state != TCP_CONNTRACK_ESTABLISHED)
+			return false;
+		break;
+	case IPPROTO_UDP:
+		break;
+	default:
+		return false;
+	}
+
+	/* Helpers need to see every packet */
+	help = nfct_help(ct);
+	if (help && help->helper)
+		return false;
+
+#ifdef CONFIG_XFRM
+	if (skb_dst(skb)->xfrm)
+		return false;
+#endif
+	return true;
+}
+
+static unsigned int
+flowoffload_tg(struct sk_buff *skb, const struct xt_target_param *par)
+{
+	enum ip_conntrack_info ctinfo;
+	struct nf_conn *ct;
+
+	ct = nf_ct_get(skb, &ctinfo);
+	if (ct == NULL || !skb_dst(skb) || !flowoffload_suitable(ct, skb))
+		return XT_CONTINUE;
+
+	/* A failure only means the connection stays on the slow path */
+	nf_flow_offload_add(ct, CTINFO2DIR(ctinfo), skb);
+	return XT_CONTINUE;
+}
+
+static struct xt_target flowoffload_tg_reg __read_mostly = {
+	.name		= "FLOWOFFLOAD",
+	.family		= NFPROTO_IPV4,
+	.target		= flowoffload_tg,
+	.targetsize	= 0,
+	.table		= "filter",
+	.hooks		= 1 << NF_INET_FORWARD,
+	.me		= THIS_MODULE,
+};
+
+static int __init flowoffload_tg_init(void)
+{
+	return xt_register_target(&flowoffload_tg_reg);
+}
+
+static void __exit flowoffload_tg_exit(void)
+{
+	xt_unregister_target(&flowoffload_tg_reg);
+}
+
+module_init(flowoffload_tg_init);
+module_exit(flowoffload_tg_exit);
@@ -0,0 +1,647 @@
+/*
+ * IPv4 flow offload fast path.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Connections handed over by the FLOWOFFLOAD target get one flow entry,
+ * hashed on the 5-tuple of each direction.  A PRE_ROUTING hook, which
+ * runs right after defragmentation, looks the packets up and forwards
+ * those of known flows itself: NAT mangling from the conntrack tuples,
+ * TTL decrement and transmission through the neighbour of the cached
+ * route.  Conntrack, the iptables rules, the routing lookup and
+ * ip_forward() are bypassed; anything unusual (IP options, TTL expiry,
+ * packets over the MTU, TCP FIN/RST, stale routes) goes the slow path.
+ *
+ * The conntrack entry stays referenced while offloaded.  Its packet and
+ * byte counters are updated by the fast path and the garbage collector
+ * keeps its timer at last_seen + the timeout it had when offloaded, so
+ * the connection expires as if conntrack had seen every packet.  Idle
+ * flows and flows whose conntrack is dying are handed back to conntrack.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/netdevice.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+#include <net/ip.h>
+#include <net/route.h>
+#include <net/neighbour.h>
+#include <net/checksum.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_acct.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_flow_offload.h>
+
+static unsigned int hashsize __read_mostly = 1024;
+module_param(hashsize, uint, 0400);
+MODULE_PARM_DESC(hashsize, "number of flow hash buckets");
+
+static unsigned int timeout __read_mostly = 30;
+module_param(timeout, uint, 0600);
+MODULE_PARM_DESC(timeout, "seconds before an idle flow is handed back "
+		 "to conntrack");
+
+struct flow_offload_stat {
+	unsigned int	found;		/* forwarded by the fast path */
+	unsigned int	slowpath;	/* flow found, packet left to the stack */
+	unsigned int	add;		/* directions offloaded */
+	unsigned int	teardown;	/* flows handed back to conntrack */
+};
+
+static DEFINE_PER_CPU(struct flow_offload_stat, flow_offload_stat);
+#define FLOW_STAT_INC(count)	(__get_cpu_var(flow_offload_stat).count++)
+
+static struct hlist_head *flow_hash __read_mostly;
+static unsigned int flow_hash_rnd __read_mostly;
+static unsigned int flow_count;
+
+/* Protects flow_hash and flow_list updates, lookups use RCU */
+static DEFINE_SPINLOCK(flow_lock);
+static LIST_HEAD(flow_list);
+
+static void flow_offload_gc(struct work_struct *work);
+static DECLARE_DELAYED_WORK(flow_gc_work, flow_offload_gc);
+
+static inline u32 flow_offload_hash(const struct flow_offload_tuple *t)
+{
+	return jhash_3words((__force u32)t->src_v4, (__force u32)t->dst_v4,
+			    ((__force u32)t->src_port << 16 |
+			     (__force u32)t->dst_port) ^ t->l4proto,
+			    flow_hash_rnd) % hashsize;
+}
+
+static inline bool flow_offload_tuple_equal(const struct flow_offload_tuple *a,
+					    const struct flow_offload_tuple *b)
+{
+	return a->src_v4 == b->src_v4 && a->dst_v4 == b->dst_v4 &&
+	       a->src_port == b->src_port && a->dst_port == b->dst_port &&
+	       a->l4proto == b->l4proto;
+}
+
+/* Called with rcu_read_lock() or flow_lock held */
+static struct flow_offload_tuple_rhash *
+flow_offload_lookup(const struct flow_offload_tuple *tuple)
+{
+	struct flow_offload_tuple_rhash *th;
+	struct hlist_node *n;
+
+	hlist_for_each_entry_rcu(th, n, &flow_hash[flow_offload_hash(tuple)],
+				 node)
+		if (flow_offload_tuple_equal(&th->tuple, tuple))
+			return th;
+	return NULL;
+}
+
+static void flow_offload_tuple_fill(struct flow_offload_tuple *tuple,
+				    const struct nf_conn *ct,
+				    enum ip_conntrack_dir dir)
+{
+	const struct nf_conntrack_tuple *t = &ct->tuplehash[dir].tuple;
+
+	tuple->src_v4 = t->src.u3.ip;
+	tuple->dst_v4 = t->dst.u3.ip;
+	tuple->src_port = t->src.u.all;
+	tuple->dst_port = t->dst.u.all;
+	tuple->l4proto = t->dst.protonum;
+	tuple->dir = dir;
+}
+
+static void flow_offload_rhash_fill(struct flow_offload_tuple_rhash *th,
+				    const struct nf_conn *ct,
+				    enum ip_conntrack_dir dir)
+{
+	const struct nf_conntrack_tuple *rt = &ct->tuplehash[!dir].tuple;
+
+	flow_offload_tuple_fill(&th->tuple, ct, dir);
+
+	/* The packets leave as the inverse of the other direction */
+	th->nat_src_v4 = rt->dst.u3.ip;
+	th->nat_dst_v4 = rt->src.u3.ip;
+	th->nat_src_port = rt->dst.u.all;
+	th->nat_dst_port = rt->src.u.all;
+}
+
+static struct flow_offload *flow_offload_alloc(struct nf_conn *ct)
+{
+	struct flow_offload *flow;
+	long remaining;
+
+	flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+	if (!flow)
+		return NULL;
+
+	nf_conntrack_get(&ct->ct_general);
+	flow->ct = ct;
+	flow_offload_rhash_fill(&flow->tuplehash[IP_CT_DIR_ORIGINAL], ct,
+				IP_CT_DIR_ORIGINAL);
+	flow_offload_rhash_fill(&flow->tuplehash[IP_CT_DIR_REPLY], ct,
+				IP_CT_DIR_REPLY);
+	flow->last_seen = jiffies;
+
+	/* The packet was just accounted for by conntrack, what is left of
+	 * the timer is the timeout of the connection in its current state */
+	remaining = (long)(ct->timeout.expires - jiffies);
+	flow->ct_timeout = remaining > 0 ? remaining : 0;
+
+	/* Conntrack does not see the sequence numbers anymore */
+	if (nf_ct_protonum(ct) == IPPROTO_TCP) {
+		spin_lock_bh(&ct->lock);
+		ct->proto.tcp.seen[0].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		ct->proto.tcp.seen[1].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		spin_unlock_bh(&ct->lock);
+	}
+	return flow;
+}
+
+static void flow_offload_free_rcu(struct rcu_head *head)
+{
+	struct flow_offload *flow = container_of(head, struct flow_offload,
+						 rcu);
+	int dir;
+
+	for (dir = 0; dir < IP_CT_DIR_MAX; dir++)
+		if (flow->tuplehash[dir].dst)
+			dst_release(flow->tuplehash[dir].dst);
+	nf_ct_put(flow->ct);
+	kfree(flow);
+}
+
+/* Called with flow_lock held */
+static void flow_offload_del(struct flow_offload *flow)
+{
+	int dir;
+
+	for (dir = 0; dir < IP_CT_DIR_MAX; dir++)
+		if (flow->tuplehash[dir].dst)
+			hlist_del_rcu(&flow->tuplehash[dir].node);
+	list_del(&flow->list);
+	flow_count--;
+	clear_bit(IPS_OFFLOAD_BIT, &flow->ct->status);
+	FLOW_STAT_INC(teardown);
+	call_rcu(&flow->rcu, flow_offload_free_rcu);
+}
+
+int nf_flow_offload_add(struct nf_conn *ct, enum ip_conntrack_dir dir,
+			const struct sk_buff *skb)
+{
+	struct flow_offload_tuple_rhash *th;
+	struct flow_offload *flow = NULL;
+	struct flow_offload_tuple tuple;
+	int ret = 0;
+
+	if (nf_ct_l3num(ct) != AF_INET || nf_ct_is_dying(ct))
+		return -EINVAL;
+
+	spin_lock_bh(&flow_lock);
+	if (test_bit(IPS_OFFLOAD_BIT, &ct->status)) {
+		/* Only the directions seen since are hashed */
+		flow_offload_tuple_fill(&tuple, ct, dir);
+		th = flow_offload_lookup(&tuple);
+		if (!th) {
+			flow_offload_tuple_fill(&tuple, ct, !dir);
+			th = flow_offload_lookup(&tuple);
+		}
+		if (th)
+			flow = flow_offload_from_tuplehash(th);
+	}
+	if (!flow) {
+		flow = flow_offload_alloc(ct);
+		if (!flow) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		list_add_tail(&flow->list, &flow_list);
+		flow_count++;
+		set_bit(IPS_OFFLOAD_BIT, &ct->status);
+	}
+
+	th = &flow->tuplehash[dir];
+	if (th->dst)
+		goto out;
+
+	th->dst = dst_clone(skb_dst(skb));
+	th->iifidx = skb->iif;
+	hlist_add_head_rcu(&th->node, &flow_hash[flow_offload_hash(&th->tuple)]);
+	FLOW_STAT_INC(add);
+out:
+	spin_unlock_bh(&flow_lock);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nf_flow_offload_add);
+
+static void flow_offload_nat_port(struct sk_buff *skb, unsigned int thoff,
+				  u8 l4proto, __be16 *port, __be16 new_port)
+{
+	__sum16 *check;
+
+	if (*port == new_port)
+		return;
+
+	if (l4proto == IPPROTO_TCP) {
+		check = &((struct tcphdr *)(skb->data + thoff))->check;
+		inet_proto_csum_replace2(check, skb, *port, new_port, 0);
+	} else {
+		check = &((struct udphdr *)(skb->data + thoff))->check;
+		if (*check || skb->ip_summed == CHECKSUM_PARTIAL) {
+			inet_proto_csum_replace2(check, skb, *port, new_port, 0);
+			if (!*check)
+				*check = CSUM_MANGLED_0;
+		}
+	}
+	*port = new_port;
+}
+
+static void flow_offload_nat_ip(struct sk_buff *skb, unsigned int thoff,
+				u8 l4proto, __be32 *addr, __be32 new_addr)
+{
+	struct iphdr *iph = ip_hdr(skb);
+	__sum16 *check;
+
+	if (*addr == new_addr)
+		return;
+
+	if (l4proto == IPPROTO_TCP) {
+		check = &((struct tcphdr *)(skb->data + thoff))->check;
+		inet_proto_csum_replace4(check, skb, *addr, new_addr, 1);
+	} else {
+		check = &((struct udphdr *)(skb->data + thoff))->check;
+		if (*check || skb->ip_summed == CHECKSUM_PARTIAL) {
+			inet_proto_csum_replace4(check, skb, *addr, new_addr, 1);
+			if (!*check)
+				*check = CSUM_MANGLED_0;
+		}
+	}
+	csum_replace4(&iph->check, *addr, new_addr);
+	*addr = new_addr;
+}
+
+static void flow_offload_acct(struct nf_conn *ct, enum ip_conntrack_dir dir,
+			      unsigned int len)
+{
+	struct nf_conn_counter *acct;
+
+	acct = nf_conn_acct_find(ct);
+	if (acct) {
+		spin_lock(&ct->lock);
+		acct[dir].packets++;
+		acct[dir].bytes += len;
+		spin_unlock(&ct->lock);
+	}
+}
+
+static unsigned int
+nf_flow_offload_ip_hook(unsigned int hooknum, struct sk_buff *skb,
+			const struct net_device *in,
+			const struct net_device *out,
+			int (*okfn)(struct sk_buff *))
+{
+	struct flow_offload_tuple_rhash *th;
+	struct flow_offload_tuple tuple;
+	struct flow_offload *flow;
+	struct net_device *outdev;
+	struct dst_entry *dst;
+	const __be16 *ports;
+	__be16 _ports[2], *l4ports;
+	struct iphdr *iph;
+	unsigned int thoff;
+
+	if (skb->pkt_type != PACKET_HOST)
+		return NF_ACCEPT;
+
+	iph = ip_hdr(skb);
+	if (iph->ihl != 5 || (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+		return NF_ACCEPT;
+	if (iph->protocol != IPPROTO_TCP && iph->protocol != IPPROTO_UDP)
+		return NF_ACCEPT;
+
+	thoff = iph->ihl * 4;
+	ports = skb_header_pointer(skb, thoff, sizeof(_ports), _ports);
+	if (!ports)
+		return NF_ACCEPT;
+
+	tuple.src_v4 = iph->saddr;
+	tuple.dst_v4 = iph->daddr;
+	tuple.src_port = ports[0];
+	tuple.dst_port = ports[1];
+	tuple.l4proto = iph->protocol;
+
+	th = flow_offload_lookup(&tuple);
+	if (!th)
+		return NF_ACCEPT;
+
+	flow = flow_offload_from_tuplehash(th);
+	dst = th->dst;
+	outdev = dst->dev;
+
+	if (unlikely(th->iifidx != in->ifindex ||
+		     !net_eq(dev_net(in), nf_ct_net(flow->ct)) ||
+		     test_bit(FLOW_OFFLOAD_TEARDOWN_BIT, &flow->flags) ||
+		     nf_ct_is_dying(flow->ct)))
+		goto slowpath;
+
+	/* Let the stack send ICMP errors and fragment */
+	if (unlikely(iph->ttl <= 1 ||
+		     (skb->len > dst_mtu(dst) && !skb_is_gso(skb))))
+		goto slowpath;
+
+	/* Route changed, the flow gets a fresh dst when it is offloaded
+	 * again */
+	if (unlikely(dst->obsolete))
+		goto teardown;
+
+	if (iph->protocol == IPPROTO_TCP) {
+		const struct tcphdr *tcph;
+		struct tcphdr _tcph;
+
+		tcph = skb_header_pointer(skb, thoff, sizeof(_tcph), &_tcph);
+		if (!tcph)
+			goto slowpath;
+		/* Conntrack has to see the connection close */
+		if (unlikely(tcph->fin || tcph->rst))
+			goto teardown;
+	}
+
+	if (!skb_make_writable(skb, thoff + (iph->protocol == IPPROTO_TCP ?
+					     sizeof(struct tcphdr) :
+					     sizeof(struct udphdr))))
+		goto slowpath;
+	if (skb_cow_head(skb, LL_RESERVED_SPACE(outdev)))
+		goto slowpath;
+
+	iph = ip_hdr(skb);
+	l4ports = (__be16 *)(skb->data + thoff);
+	flow_offload_nat_port(skb, thoff, iph->protocol, &l4ports[0],
+			      th->nat_src_port);
+	flow_offload_nat_port(skb, thoff, iph->protocol, &l4ports[1],
+			      th->nat_dst_port);
+	flow_offload_nat_ip(skb, thoff, iph->protocol, &iph->saddr,
+			    th->nat_src_v4);
+	flow_offload_nat_ip(skb, thoff, iph->protocol, &iph->daddr,
+			    th->nat_dst_v4);
+	ip_decrease_ttl(iph);
+
+	if (flow->last_seen != jiffies)
+		flow->last_seen = jiffies;
+	flow_offload_acct(flow->ct, th->tuple.dir, skb->len);
+	FLOW_STAT_INC(found);
+
+	/* What ip_forward() and ip_finish_output2() do */
+	skb_forward_csum(skb);
+	skb->priority = rt_tos2priority(iph->tos);
+	skb_dst_drop(skb);
+	skb_dst_set(skb, dst_clone(dst));
+	skb->dev = outdev;
+	skb->protocol = htons(ETH_P_IP);
+	IP_INC_STATS_BH(dev_net(outdev), IPSTATS_MIB_OUTFORWDATAGRAMS);
+
+	if (dst->hh)
+		neigh_hh_output(dst->hh, skb);
+	else if (dst->neighbour)
+		dst->neighbour->output(skb);
+	else
+		kfree_skb(skb);
+	return NF_STOLEN;
+
+teardown:
+	set_bit(FLOW_OFFLOAD_TEARDOWN_BIT, &flow->flags);
+slowpath:
+	FLOW_STAT_INC(slowpath);
+	return NF_ACCEPT;
+}
+
+static struct nf_hook_ops nf_flow_offload_ops __read_mostly = {
+	.hook		= nf_flow_offload_ip_hook,
+	.owner		= THIS_MODULE,
+	.pf		= NFPROTO_IPV4,
+	.hooknum	= NF_INET_PRE_ROUTING,
+	/* After defragmentation, before conntrack and the raw table */
+	.priority	= NF_IP_PRI_CONNTRACK_DEFRAG + 1,
+};
+
+/* Refresh the conntrack timers and hand back the finished flows */
+static void flow_offload_gc(struct work_struct *work)
+{
+	struct flow_offload *flow, *next;
+	unsigned long idle = timeout * HZ;
+	int dir;
+
+	spin_lock_bh(&flow_lock);
+	list_for_each_entry_safe(flow, next, &flow_list, list) {
+		for (dir = 0; dir < IP_CT_DIR_MAX; dir++)
+			if (flow->tuplehash[dir].dst &&
+			    flow->tuplehash[dir].dst->obsolete)
+				set_bit(FLOW_OFFLOAD_TEARDOWN_BIT,
+					&flow->flags);
+
+		if (test_bit(FLOW_OFFLOAD_TEARDOWN_BIT, &flow->flags) ||
+		    nf_ct_is_dying(flow->ct) ||
+		    time_after(jiffies, flow->last_seen + idle)) {
+			flow_offload_del(flow);
+			continue;
+		}
+
+		if (!test_bit(IPS_FIXED_TIMEOUT_BIT, &flow->ct->status))
+			mod_timer_pending(&flow->ct->timeout,
+					  flow->last_seen + flow->ct_timeout);
+	}
+	spin_unlock_bh(&flow_lock);
+
+	schedule_delayed_work(&flow_gc_work, HZ);
+}
+
+/* Hand back the flows going through a device that goes away */
+static int flow_offload_netdev_event(struct notifier_block *this,
+				     unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+	struct flow_offload *flow, *next;
+	int dir;
+
+	if (event != NETDEV_DOWN && event != NETDEV_UNREGISTER)
+		return NOTIFY_DONE;
+
+	spin_lock_bh(&flow_lock);
+	list_for_each_entry_safe(flow, next, &flow_list, list) {
+		for (dir = 0; dir < IP_CT_DIR_MAX; dir++) {
+			struct flow_offload_tuple_rhash *th;
+
+			th = &flow->tuplehash[dir];
+			if (th->dst && (th->dst->dev == dev ||
+					th->iifidx == dev->ifindex)) {
+				flow_offload_del(flow);
+				break;
+			}
+		}
+	}
+	spin_unlock_bh(&flow_lock);
+
+	/* The flows hold references on the device through their dst */
+	if (event == NETDEV_UNREGISTER)
+		rcu_barrier();
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block flow_offload_netdev_notifier = {
+	.notifier_call	= flow_offload_netdev_event,
+};
+
+#ifdef CONFIG_PROC_FS
+static void *flow_cpu_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	int cpu;
+
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+
+	for (cpu = *pos-1; cpu < nr_cpu_ids; ++cpu) {
+		if (!cpu_possible(cpu))
+			continue;
+		*pos = cpu + 1;
+		return &per_cpu(flow_offload_stat, cpu);
+	}
+
+	return NULL;
+}
+
+static void *flow_cpu_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	int cpu;
+
+	for (cpu = *pos; cpu < nr_cpu_ids; ++cpu) {
+		if (!cpu_possible(cpu))
+			continue;
+		*pos = cpu + 1;
+		return &per_cpu(flow_offload_stat, cpu);
+	}
+
+	return NULL;
+}
+
+static void flow_cpu_seq_stop(struct seq_file *seq, void *v)
+{
+}
+
+static int flow_cpu_seq_show(struct seq_file *seq, void *v)
+{
+	const struct flow_offload_stat *st = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(seq, "entries  found slowpath add teardown\n");
+		return 0;
+	}
+
+	seq_printf(seq, "%08x  %08x %08x %08x %08x\n",
+		   flow_count, st->found, st->slowpath, st->add,
+		   st->teardown);
+	return 0;
+}
+
+static const struct seq_operations flow_cpu_seq_ops = {
+	.start	= flow_cpu_seq_start,
+	.next	= flow_cpu_seq_next,
+	.stop	= flow_cpu_seq_stop,
+	.show	= flow_cpu_seq_show,
+};
+
+static int flow_cpu_seq_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &flow_cpu_seq_ops);
+}
+
+static const struct file_operations flow_cpu_seq_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = flow_cpu_seq_open,
+	.read	 = seq_read,
+	.llseek	 = seq_lseek,
+	.release = seq_release,
+};
+#endif /* CONFIG_PROC_FS */
+
+static void flow_offload_flush(void)
+{
+	struct flow_offload *flow, *next;
+
+	spin_lock_bh(&flow_lock);
+	list_for_each_entry_safe(flow, next, &flow_list, list)
+		flow_offload_del(flow);
+	spin_unlock_bh(&flow_lock);
+}
+
+static int __init nf_flow_offload_init(void)
+{
+	unsigned int i;
+	int ret;
+
+	if (!hashsize)
+		return -EINVAL;
+
+	flow_hash = kcalloc(hashsize, sizeof(struct hlist_head), GFP_KERNEL);
+	if (!flow_hash)
+		return -ENOMEM;
+	for (i = 0; i < hashsize; i++)
+		INIT_HLIST_HEAD(&flow_hash[i]);
+	get_random_bytes(&flow_hash_rnd, sizeof(flow_hash_rnd));
+
+#ifdef CONFIG_PROC_FS
+	if (!proc_create("nf_flow_offload", S_IRUGO, init_net.proc_net_stat,
+			 &flow_cpu_seq_fops)) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+#endif
+
+	ret = register_netdevice_notifier(&flow_offload_netdev_notifier);
+	if (ret < 0)
+		goto err_proc;
+
+	ret = nf_register_hook(&nf_flow_offload_ops);
+	if (ret < 0)
+		goto err_notifier;
+
+	schedule_delayed_work(&flow_gc_work, HZ);
+	return 0;
+
+err_notifier:
+	unregister_netdevice_notifier(&flow_offload_netdev_notifier);
+err_proc:
+#ifdef CONFIG_PROC_FS
+	remove_proc_entry("nf_flow_offload", init_net.proc_net_stat);
+err_free:
+#endif
+	kfree(flow_hash);
+	return ret;
+}
+
+static void __exit nf_flow_offload_fini(void)
+{
+	nf_unregister_hook(&nf_flow_offload_ops);
+	cancel_delayed_work_sync(&flow_gc_work);
+	unregister_netdevice_notifier(&flow_offload_netdev_notifier);
+	flow_offload_flush();
+	rcu_barrier();
+#ifdef CONFIG_PROC_FS
+	remove_proc_entry("nf_flow_offload", init_net.proc_net_stat);
+#endif
+	kfree(flow_hash);
+}
+
+module_init(nf_flow_offload_init);
+module_exit(nf_flow_offload_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("IPv4 flow offload fast path");
@@ -109,6 +109,9 @@
 #endif
 #include <net/secure_seq.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/route.h>
+
 #define RT_FL_TOS(oldflp) \
     ((u32)(oldflp->fl4_tos & (IPTOS_RT_MASK | RTO_ONLINK)))
 
@@ -131,6 +134,8 @@ static int ip_rt_min_pmtu __read_mostly		= 512 + 20 + 20;
 static int ip_rt_min_advmss __read_mostly	= 256;
 static int ip_rt_secret_interval __read_mostly	= 10 * 60 * HZ;
 static int rt_chain_length_max __read_mostly	= 20;
+static int ip_rt_cache_bypass __read_mostly;
+static int ip_rt_gc_batch __read_mostly;
 
 static struct delayed_work expires_work;
 static unsigned long expires_ljiffies;
@@ -463,12 +468,13 @@ static int rt_cpu_seq_show(struct seq_file *seq, void *v)
 	struct rt_cache_stat *st = v;
 
 	if (v == SEQ_START_TOKEN) {
-		seq_printf(seq, "entries  in_hit in_slow_tot in_slow_mc in_no_route in_brd in_martian_dst in_martian_src  out_hit out_slow_tot out_slow_mc  gc_total gc_ignored gc_goal_miss gc_dst_overflow in_hlist_search out_hlist_search\n");
+		seq_printf(seq, "entries  in_hit in_slow_tot in_slow_mc in_no_route in_brd in_martian_dst in_martian_src  out_hit out_slow_tot out_slow_mc  gc_total gc_ignored gc_goal_miss gc_dst_overflow in_hlist_search out_hlist_search  in_pcpu_hit out_pcpu_hit gc_batched\n");
 		return 0;
 	}
 
 	seq_printf(seq,"%08x  %08x %08x %08x %08x %08x %08x %08x "
-		   " %08x %08x %08x %08x %08x %08x %08x %08x %08x \n",
+		   " %08x %08x %08x %08x %08x %08x %08x %08x %08x "
+		   " %08x %08x %08x \n",
 		   atomic_read(&ipv4_dst_ops.entries),
 		   st->in_hit,
 		   st->in_slow_tot,
@@ -487,7 +493,11 @@ static int rt_cpu_seq_show(struct seq_file *seq, void *v)
 		   st->gc_goal_miss,
 		   st->gc_dst_overflow,
 		   st->in_hlist_search,
-		   st->out_hlist_search
+		   st->out_hlist_search,
+
+		   st->in_pcpu_hit,
+		   st->out_pcpu_hit,
+		   st->gc_batched
 		);
 	return 0;
 }
@@ -679,7 +689,8 @@ static inline u32 rt_score(struct rtable *rt)
 
 static inline bool rt_caching(const struct net *net)
 {
-	return net->ipv4.current_rt_cache_rebuild_count <=
+	return !ip_rt_cache_bypass &&
+		net->ipv4.current_rt_cache_rebuild_count <=
 		net->ipv4.sysctl_rt_cache_rebuild_count;
 }
 
@@ -712,6 +723,102 @@ static inline int rt_is_expired(struct rtable *rth)
 	return rth->rt_genid != rt_genid(dev_net(rth->u.dst.dev));
 }
 
+/*
+ * When the route cache is not used (route/cache_bypass set, or too long
+ * hash chains), every lookup would go to the FIB and allocate a new
+ * dst.  A small direct mapped cache per cpu keeps the last routes
+ * resolved, indexed like the hash table.  The cache owns the routes
+ * stored in it: they stay live dsts until they are evicted from their
+ * slot or flushed, and only then are they released and freed.  Entries
+ * are only valid for the rt_genid they were created with, so any flush
+ * of the route cache invalidates them; rt_cache_flush() also frees them
+ * so that devices can go away.
+ */
+#define RT_PCPU_CACHE_SIZE	128
+
+struct rt_pcpu_cache {
+	spinlock_t	lock;
+	struct rtable	*slot[RT_PCPU_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct rt_pcpu_cache, rt_pcpu_cache);
+
+static inline bool rt_pcpu_match(struct rtable *rth, const struct flowi *fl,
+				 struct net *net)
+{
+	return rth->fl.fl4_dst == fl->fl4_dst &&
+	       rth->fl.fl4_src == fl->fl4_src &&
+	       rth->fl.iif == fl->iif &&
+	       rth->fl.oif == fl->oif &&
+	       rth->fl.mark == fl->mark &&
+	       !((rth->fl.fl4_tos ^ fl->fl4_tos) &
+		 (IPTOS_RT_MASK | RTO_ONLINK)) &&
+	       net_eq(dev_net(rth->u.dst.dev), net) &&
+	       !rt_is_expired(rth);
+}
+
+/* Returns a held route matching fl, or NULL */
+static struct rtable *rt_pcpu_cache_lookup(unsigned hash,
+					   const struct flowi *fl,
+					   struct net *net)
+{
+	struct rt_pcpu_cache *pc;
+	struct rtable *rth;
+
+	local_bh_disable();
+	pc = &__get_cpu_var(rt_pcpu_cache);
+	spin_lock(&pc->lock);
+	rth = pc->slot[hash & (RT_PCPU_CACHE_SIZE - 1)];
+	if (rth && rt_pcpu_match(rth, fl, net))
+		dst_use(&rth->u.dst, jiffies);
+	else
+		rth = NULL;
+	spin_unlock(&pc->lock);
+	local_bh_enable();
+
+	return rth;
+}
+
+static void rt_pcpu_cache_store(unsigned hash, struct rtable *rt)
+{
+	struct rt_pcpu_cache *pc;
+	struct rtable **slot, *old;
+
+	dst_hold(&rt->u.dst);
+
+	local_bh_disable();
+	pc = &__get_cpu_var(rt_pcpu_cache);
+	spin_lock(&pc->lock);
+	slot = &pc->slot[hash & (RT_PCPU_CACHE_SIZE - 1)];
+	old = *slot;
+	*slot = rt;
+	spin_unlock(&pc->lock);
+	local_bh_enable();
+
+	if (old)
+		rt_drop(old);
+}
+
+static void rt_pcpu_cache_flush(void)
+{
+	struct rt_pcpu_cache *pc;
+	struct rtable *rth;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		pc = &per_cpu(rt_pcpu_cache, cpu);
+		spin_lock_bh(&pc->lock);
+		for (i = 0; i < RT_PCPU_CACHE_SIZE; i++) {
+			rth = pc->slot[i];
+			if (rth) {
+				pc->slot[i] = NULL;
+				rt_drop(rth);
+			}
+		}
+		spin_unlock_bh(&pc->lock);
+	}
+}
+
 /*
  * Perform a full scan of hash table and free all entries.
  * Can be called by a softirq or a process.
@@ -899,6 +1006,7 @@ static void rt_cache_invalidate(struct net *net)
 void rt_cache_flush(struct net *net, int delay)
 {
 	rt_cache_invalidate(net);
+	rt_pcpu_cache_flush();
 	if (delay >= 0)
 		rt_do_flush(!in_softirq());
 }
@@ -944,8 +1052,19 @@ static void rt_emergency_hash_rebuild(struct net *net)
    We try to adjust it dynamically, so that if networking
    is idle expires is large enough to keep enough of warm entries,
    and when load increases it reduces to limit cache size.
+
+   From softirq context the scan can be limited to route/gc_batch
+   buckets per call, as long as the cache is below max_size: the
+   next calls go on from where it stopped, instead of one packet
+   paying for a scan of the whole table.
  */
 
+static void rt_gc_trace(int goal, ktime_t start)
+{
+	trace_rt_garbage_collect(atomic_read(&ipv4_dst_ops.entries), goal,
+				 ktime_to_ns(ktime_sub(ktime_get(), start)));
+}
+
 static int rt_garbage_collect(struct dst_ops *ops)
 {
 	static unsigned long expire = RT_GC_TIMEOUT;
@@ -954,6 +1073,7 @@ static int rt_garbage_collect(struct dst_ops *ops)
 	static int equilibrium;
 	struct rtable *rth, **rthp;
 	unsigned long now = jiffies;
+	ktime_t start;
 	int goal;
 
 	/*
@@ -969,6 +1089,8 @@ static int rt_garbage_collect(struct dst_ops *ops)
 		goto out;
 	}
 
+	start = ktime_get();
+
 	/* Calculate number of entries, which we want to expire now. */
 	goal = atomic_read(&ipv4_dst_ops.entries) -
 		(ip_rt_gc_elasticity << rt_hash_log);
@@ -997,7 +1119,7 @@ static int rt_garbage_collect(struct dst_ops *ops)
 	}
 
 	do {
-		int i, k;
+		int i, k, scanned = 0;
 
 		for (i = rt_hash_mask, k = rover; i >= 0; i--) {
 			unsigned long tmo = expire;
@@ -1019,12 +1141,22 @@ static int rt_garbage_collect(struct dst_ops *ops)
 			spin_unlock_bh(rt_hash_lock_addr(k));
 			if (goal <= 0)
 				break;
+			if (ip_rt_gc_batch && ++scanned >= ip_rt_gc_batch &&
+			    in_softirq() &&
+			    atomic_read(&ipv4_dst_ops.entries) < ip_rt_max_size)
+				break;
 		}
 		rover = k;
 
 		if (goal <= 0)
 			goto work_done;
 
+		if (i >= 0) {
+			/* Stopped by gc_batch, carry on next time */
+			RT_CACHE_STAT_INC(gc_batched);
+			goto gc_out;
+		}
+
 		/* Goal is not achieved. We stop process if:
 
 		   - if expire reduced to zero. Otherwise, expire is halfed.
@@ -1046,14 +1178,15 @@ static int rt_garbage_collect(struct dst_ops *ops)
 #endif
 
 		if (atomic_read(&ipv4_dst_ops.entries) < ip_rt_max_size)
-			goto out;
+			goto gc_out;
 	} while (!in_softirq() && time_before_eq(jiffies, now));
 
 	if (atomic_read(&ipv4_dst_ops.entries) < ip_rt_max_size)
-		goto out;
+		goto gc_out;
 	if (net_ratelimit())
 		printk(KERN_WARNING "dst cache overflow\n");
 	RT_CACHE_STAT_INC(gc_dst_overflow);
+	rt_gc_trace(goal, start);
 	return 1;
 
 work_done:
@@ -1065,6 +1198,8 @@ work_done:
 	printk(KERN_DEBUG "expire++ %u %d %d %d\n", expire,
 			atomic_read(&ipv4_dst_ops.entries), goal, rover);
 #endif
+gc_out:
+	rt_gc_trace(goal, start);
 out:	return 0;
 }
 
@@ -1113,7 +1248,11 @@ restart:
 			}
 		}
 
-		rt_free(rt);
+		/* The per-cpu cache frees the route once it is evicted */
+		if (!(rt->rt_flags & RTCF_MULTICAST))
+			rt_pcpu_cache_store(hash, rt);
+		else
+			rt_free(rt);
 		goto skip_hashing;
 	}
 
@@ -2272,12 +2411,29 @@ int ip_route_input(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 
 	net = dev_net(dev);
 
-	if (!rt_caching(net))
-		goto skip_cache;
-
 	tos &= IPTOS_RT_MASK;
 	hash = rt_hash(daddr, saddr, iif, rt_genid(net));
 
+	if (!rt_caching(net)) {
+		struct flowi fl = { .nl_u = { .ip4_u =
+					      { .daddr = daddr,
+						.saddr = saddr,
+						.tos = tos } },
+				    .mark = skb->mark,
+				    .iif = iif };
+
+		if (ipv4_is_multicast(daddr))
+			goto skip_cache;
+		rth = rt_pcpu_cache_lookup(hash, &fl, net);
+		if (rth) {
+			RT_CACHE_STAT_INC(in_pcpu_hit);
+			trace_rt_lookup(daddr, saddr, iif, 1, RT_LOOKUP_PCPU);
+			skb_dst_set(skb, &rth->u.dst);
+			return 0;
+		}
+		goto skip_cache;
+	}
+
 	rcu_read_lock();
 	for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
 	     rth = rcu_dereference(rth->u.dst.rt_next)) {
@@ -2292,6 +2448,7 @@ int ip_route_input(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 			dst_use(&rth->u.dst, jiffies);
 			RT_CACHE_STAT_INC(in_hit);
 			rcu_read_unlock();
+			trace_rt_lookup(daddr, saddr, iif, 1, RT_LOOKUP_CACHE);
 			skb_dst_set(skb, &rth->u.dst);
 			return 0;
 		}
@@ -2332,6 +2489,7 @@ skip_cache:
 		rcu_read_unlock();
 		return -EINVAL;
 	}
+	trace_rt_lookup(daddr, saddr, iif, 1, RT_LOOKUP_FIB);
 	return ip_route_input_slow(skb, daddr, saddr, tos, dev);
 }
 
@@ -2686,11 +2844,20 @@ int __ip_route_output_key(struct net *net, struct rtable **rp,
 	unsigned hash;
 	struct rtable *rth;
 
-	if (!rt_caching(net))
-		goto slow_output;
-
 	hash = rt_hash(flp->fl4_dst, flp->fl4_src, flp->oif, rt_genid(net));
 
+	if (!rt_caching(net)) {
+		rth = rt_pcpu_cache_lookup(hash, flp, net);
+		if (rth) {
+			RT_CACHE_STAT_INC(out_pcpu_hit);
+			trace_rt_lookup(flp->fl4_dst, flp->fl4_src, flp->oif, 0,
+					RT_LOOKUP_PCPU);
+			*rp = rth;
+			return 0;
+		}
+		goto slow_output;
+	}
+
 	rcu_read_lock_bh();
 	for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
 		rth = rcu_dereference(rth->u.dst.rt_next)) {
@@ -2706,6 +2873,8 @@ int __ip_route_output_key(struct net *net, struct rtable **rp,
 			dst_use(&rth->u.dst, jiffies);
 			RT_CACHE_STAT_INC(out_hit);
 			rcu_read_unlock_bh();
+			trace_rt_lookup(flp->fl4_dst, flp->fl4_src, flp->oif, 0,
+					RT_LOOKUP_CACHE);
 			*rp = rth;
 			return 0;
 		}
@@ -2714,6 +2883,7 @@ int __ip_route_output_key(struct net *net, struct rtable **rp,
 	rcu_read_unlock_bh();
 
 slow_output:
+	trace_rt_lookup(flp->fl4_dst, flp->fl4_src, flp->oif, 0, RT_LOOKUP_FIB);
 	return ip_route_output_slow(net, rp, flp);
 }
 
@@ -3144,6 +3314,20 @@ static int ipv4_sysctl_rt_secret_interval_strategy(ctl_table *table,
 	return ret;
 }
 
+static int ipv4_sysctl_rt_cache_bypass(ctl_table *ctl, int write,
+				       void __user *buffer,
+				       size_t *lenp, loff_t *ppos)
+{
+	int old = ip_rt_cache_bypass;
+	int ret = proc_dointvec(ctl, write, buffer, lenp, ppos);
+
+	/* The per-cpu caches are only looked up while bypassing */
+	if (write && old && !ip_rt_cache_bypass)
+		rt_pcpu_cache_flush();
+
+	return ret;
+}
+
 static ctl_table ipv4_route_table[] = {
 	{
 		.ctl_name	= NET_IPV4_ROUTE_GC_THRESH,
@@ -3281,6 +3465,22 @@ static ctl_table ipv4_route_table[] = {
 		.proc_handler	= ipv4_sysctl_rt_secret_interval,
 		.strategy	= ipv4_sysctl_rt_secret_interval_strategy,
 	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "cache_bypass",
+		.data		= &ip_rt_cache_bypass,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= ipv4_sysctl_rt_cache_bypass,
+	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "gc_batch",
+		.data		= &ip_rt_gc_batch,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec,
+	},
 	{ .ctl_name = 0 }
 };
 
@@ -3409,6 +3609,7 @@ __setup("rhash_entries=", set_rhash_entries);
 int __init ip_rt_init(void)
 {
 	int rc = 0;
+	int cpu;
 
 #ifdef CONFIG_NET_CLS_ROUTE
 	ip_rt_acct = __alloc_percpu(256 * sizeof(struct ip_rt_acct), __alignof__(struct ip_rt_acct));
@@ -3435,6 +3636,9 @@ int __init ip_rt_init(void)
 	memset(rt_hash_table, 0, (rt_hash_mask + 1) * sizeof(struct rt_hash_bucket));
 	rt_hash_lock_init();
 
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu(rt_pcpu_cache, cpu).lock);
+
 	ipv4_dst_ops.gc_thresh = (rt_hash_mask + 1);
 	ip_rt_max_size = (rt_hash_mask + 1) * 16;
 
@@ -1375,6 +1375,8 @@ int tcp_recvmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	lock_sock(sk);
 
+	sock_rps_record_flow(sk);
+
 	TCP_CHECK_TIMER(sk);
 
 	err = -ENOTCONN;
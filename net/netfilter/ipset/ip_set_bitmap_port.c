@@ -0,0 +1,281 @@
+/*
+ * bitmap:port set type: a bitmap of the TCP/UDP ports of a range.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/bitops.h>
+#include <net/netlink.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/ip_set.h>
+
+/* Type structure */
+struct bitmap_port {
+	unsigned long *members;	/* the set members */
+	u16 first_port;		/* host byte order, included in range */
+	u16 last_port;		/* host byte order, included in range */
+	u32 elements;		/* number of members */
+	size_t memsize;		/* members size */
+};
+
+static inline int
+bitmap_port_adt(struct bitmap_port *map, enum ipset_adt adt, u16 port)
+{
+	u16 id = port - map->first_port;
+
+	switch (adt) {
+	case IPSET_TEST:
+		return !!test_bit(id, map->members);
+	case IPSET_ADD:
+		if (__test_and_set_bit(id, map->members))
+			return -IPSET_ERR_EXIST;
+		map->elements++;
+		return 0;
+	case IPSET_DEL:
+		if (!__test_and_clear_bit(id, map->members))
+			return -IPSET_ERR_EXIST;
+		map->elements--;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int
+bitmap_port_kadt(struct ip_set *set, const struct sk_buff *skb,
+		 enum ipset_adt adt, u8 pf, u8 dim, u8 flags)
+{
+	struct bitmap_port *map = set->data;
+	__be16 __port;
+	u16 port;
+
+	if (pf != NFPROTO_IPV4 ||
+	    !ip_set_get_ip4_port(skb, flags & IPSET_DIM_ONE_SRC, &__port))
+		return -EINVAL;
+
+	port = ntohs(__port);
+	if (port < map->first_port || port > map->last_port)
+		return -IPSET_ERR_BITMAP_RANGE;
+
+	return bitmap_port_adt(map, adt, port);
+}
+
+static int
+bitmap_port_uadt(struct ip_set *set, struct nlattr *tb[],
+		 enum ipset_adt adt, u32 flags)
+{
+	struct bitmap_port *map = set->data;
+	u32 port, port_to;
+	int ret;
+
+	if (unlikely(!tb[IPSET_ATTR_PORT]))
+		return -IPSET_ERR_PROTOCOL;
+	if (unlikely(tb[IPSET_ATTR_TIMEOUT]))
+		return -IPSET_ERR_TIMEOUT;
+
+	port = ip_set_get_h16(tb[IPSET_ATTR_PORT]);
+	if (port < map->first_port || port > map->last_port)
+		return -IPSET_ERR_BITMAP_RANGE;
+
+	if (adt == IPSET_TEST)
+		return bitmap_port_adt(map, adt, port);
+
+	port_to = port;
+	if (tb[IPSET_ATTR_PORT_TO]) {
+		port_to = ip_set_get_h16(tb[IPSET_ATTR_PORT_TO]);
+		if (port > port_to)
+			swap(port, port_to);
+		if (port_to > map->last_port)
+			return -IPSET_ERR_BITMAP_RANGE;
+	}
+
+	for (; port <= port_to; port++) {
+		ret = bitmap_port_adt(map, adt, port);
+		if (ret && !(ret == -IPSET_ERR_EXIST &&
+			     (flags & IPSET_FLAG_EXIST)))
+			return ret;
+	}
+	return 0;
+}
+
+static void
+bitmap_port_flush(struct ip_set *set)
+{
+	struct bitmap_port *map = set->data;
+
+	memset(map->members, 0, map->memsize);
+	map->elements = 0;
+}
+
+static void
+bitmap_port_destroy(struct ip_set *set)
+{
+	struct bitmap_port *map = set->data;
+
+	if (is_vmalloc_addr(map->members))
+		vfree(map->members);
+	else
+		kfree(map->members);
+	kfree(map);
+
+	set->data = NULL;
+}
+
+static int
+bitmap_port_head(struct ip_set *set, struct sk_buff *skb)
+{
+	const struct bitmap_port *map = set->data;
+	struct nlattr *nested;
+
+	nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
+	if (!nested)
+		goto nla_put_failure;
+	NLA_PUT_BE16(skb, IPSET_ATTR_PORT, htons(map->first_port));
+	NLA_PUT_BE16(skb, IPSET_ATTR_PORT_TO, htons(map->last_port));
+	NLA_PUT_BE32(skb, IPSET_ATTR_ELEMENTS, htonl(map->elements));
+	/* The dump holds a reference itself */
+	NLA_PUT_BE32(skb, IPSET_ATTR_REFERENCES, htonl(set->ref - 1));
+	NLA_PUT_BE32(skb, IPSET_ATTR_MEMSIZE,
+		     htonl(sizeof(*map) + map->memsize));
+	ipset_nest_end(skb, nested);
+
+	return 0;
+nla_put_failure:
+	return -EMSGSIZE;
+}
+
+static int
+bitmap_port_list(const struct ip_set *set,
+		 struct sk_buff *skb, struct netlink_callback *cb)
+{
+	const struct bitmap_port *map = set->data;
+	struct nlattr *atd, *nested;
+	u16 last = map->last_port - map->first_port;
+	long first = cb->args[IPSET_CB_ARG0];
+	u32 id;
+
+	atd = ipset_nest_start(skb, IPSET_ATTR_ADT);
+	if (!atd)
+		return -EMSGSIZE;
+	for (; cb->args[IPSET_CB_ARG0] <= last; cb->args[IPSET_CB_ARG0]++) {
+		id = cb->args[IPSET_CB_ARG0];
+		if (!test_bit(id, map->members))
+			continue;
+		nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
+		if (!nested)
+			goto full;
+		NLA_PUT_BE16(skb, IPSET_ATTR_PORT,
+			     htons(map->first_port + id));
+		ipset_nest_end(skb, nested);
+	}
+	ipset_nest_end(skb, atd);
+	return 0;
+
+nla_put_failure:
+	nla_nest_cancel(skb, nested);
+full:
+	if (cb->args[IPSET_CB_ARG0] == first) {
+		nla_nest_cancel(skb, atd);
+		return -EMSGSIZE;
+	}
+	ipset_nest_end(skb, atd);
+	return -EMSGSIZE;
+}
+
+static const struct ip_set_type_variant bitmap_port_variant = {
+	.kadt	= bitmap_port_kadt,
+	.uadt	= bitmap_port_uadt,
+	.destroy = bitmap_port_destroy,
+	.flush	= bitmap_port_flush,
+	.head	= bitmap_port_head,
+	.list	= bitmap_port_list,
+};
+
+static int
+bitmap_port_create(struct ip_set *set, struct nlattr *tb[], u32 flags)
+{
+	struct bitmap_port *map;
+	u16 first_port, last_port;
+
+	if (unlikely(!tb[IPSET_ATTR_PORT] || !tb[IPSET_ATTR_PORT_TO]))
+		return -IPSET_ERR_PROTOCOL;
+	if (unlikely(tb[IPSET_ATTR_TIMEOUT]))
+		return -IPSET_ERR_TIMEOUT;
+
+	first_port = ip_set_get_h16(tb[IPSET_ATTR_PORT]);
+	last_port = ip_set_get_h16(tb[IPSET_ATTR_PORT_TO]);
+	if (first_port > last_port)
+		swap(first_port, last_port);
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+
+	map->first_port = first_port;
+	map->last_port = last_port;
+	map->memsize = BITS_TO_LONGS(last_port - first_port + 1) *
+		       sizeof(unsigned long);
+	map->members = kzalloc(map->memsize, GFP_KERNEL | __GFP_NOWARN);
+	if (!map->members) {
+		map->members = vmalloc(map->memsize);
+		if (map->members)
+			memset(map->members, 0, map->memsize);
+	}
+	if (!map->members) {
+		kfree(map);
+		return -ENOMEM;
+	}
+
+	set->data = map;
+	set->variant = &bitmap_port_variant;
+	return 0;
+}
+
+static struct ip_set_type bitmap_port_type = {
+	.name		= "bitmap:port",
+	.protocol	= IPSET_PROTOCOL,
+	.dimension	= IPSET_DIM_ONE,
+	.family		= NFPROTO_UNSPEC,
+	.revision	= 0,
+	.create		= bitmap_port_create,
+	.create_policy	= {
+		[IPSET_ATTR_PORT]	= { .type = NLA_U16 },
+		[IPSET_ATTR_PORT_TO]	= { .type = NLA_U16 },
+		[IPSET_ATTR_TIMEOUT]	= { .type = NLA_U32 },
+	},
+	.adt_policy	= {
+		[IPSET_ATTR_PORT]	= { .type = NLA_U16 },
+		[IPSET_ATTR_PORT_TO]	= { .type = NLA_U16 },
+		[IPSET_ATTR_TIMEOUT]	= { .type = NLA_U32 },
+		[IPSET_ATTR_LINENO]	= { .type = NLA_U32 },
+	},
+	.me		= THIS_MODULE,
+};
+
+static int __init
+bitmap_port_init(void)
+{
+	return ip_set_type_register(&bitmap_port_type);
+}
+
+static void __exit
+bitmap_port_fini(void)
+{
+	ip_set_type_unregister(&bitmap_port_type);
+}
+
+module_init(bitmap_port_init);
+module_exit(bitmap_port_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("bitmap:port IP set type");
+MODULE_ALIAS("ip_set_bitmap:port");
@@ -0,0 +1,584 @@
+/*
+ * hash:ip and hash:net set types, IPv4 only.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Elements are chained in a jhash table keyed on the address and prefix
+ * length.  hash:net counts its elements per prefix length, a lookup from
+ * the packet path probes only the prefix lengths in use, longest first.
+ * The table is grown when elements are added from userspace and the
+ * chains become longer than two elements on average; additions from the
+ * SET target never resize and just make the chains longer.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/ip.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <net/netlink.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/ip_set.h>
+
+#define HOST_MASK		32
+#define HASH_DEFAULT_HASHSIZE	1024
+#define HASH_MIN_HASHSIZE	64
+#define HASH_DEFAULT_MAXELEM	65536
+#define HASH_MAX_BITS		20
+
+struct hash_elem {
+	struct hlist_node	node;
+	__be32			ip;
+	u8			cidr;
+};
+
+struct ip_set_hash {
+	struct hlist_head	*table;
+	u8			htable_bits;	/* 2^htable_bits buckets */
+	u32			maxelem;	/* max elements in the hash */
+	u32			elements;	/* current element count */
+	u32			initval;	/* random jhash init value */
+	u32			nets[HOST_MASK + 1]; /* elements per cidr */
+};
+
+static struct kmem_cache *hash_elem_cachep __read_mostly;
+
+static const struct ip_set_type_variant hash_ip4_variant;
+static const struct ip_set_type_variant hash_net4_variant;
+
+static inline bool
+hash_is_net(const struct ip_set *set)
+{
+	return set->variant == &hash_net4_variant;
+}
+
+static inline u32
+hash_bucket(const struct ip_set_hash *h, __be32 ip, u8 cidr, u8 bits)
+{
+	return jhash_2words((__force u32)ip, cidr, h->initval) &
+	       ((1U << bits) - 1);
+}
+
+static size_t
+hash_table_size(u8 bits)
+{
+	return sizeof(struct hlist_head) << bits;
+}
+
+static struct hlist_head *
+hash_table_alloc(u8 bits)
+{
+	size_t size = hash_table_size(bits);
+	struct hlist_head *table;
+
+	table = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!table)
+		table = vmalloc(size);
+	if (table && is_vmalloc_addr(table))
+		memset(table, 0, size);
+	return table;
+}
+
+static void
+hash_table_free(struct hlist_head *table)
+{
+	if (is_vmalloc_addr(table))
+		vfree(table);
+	else
+		kfree(table);
+}
+
+static struct hash_elem *
+hash_find(const struct ip_set_hash *h, __be32 ip, u8 cidr)
+{
+	struct hash_elem *e;
+	struct hlist_node *n;
+
+	hlist_for_each_entry(e, n,
+			     &h->table[hash_bucket(h, ip, cidr, h->htable_bits)],
+			     node)
+		if (e->ip == ip && e->cidr == cidr)
+			return e;
+	return NULL;
+}
+
+/* Longest prefix match among the prefix lengths in use */
+static int
+hash_net_test(const struct ip_set_hash *h, __be32 ip)
+{
+	int cidr;
+
+	for (cidr = HOST_MASK; cidr > 0; cidr--)
+		if (h->nets[cidr] &&
+		    hash_find(h, ip & ip_set_netmask(cidr), cidr))
+			return 1;
+	return 0;
+}
+
+/* Test, add or delete one element, called with the set lock held */
+static int
+hash_adt(struct ip_set_hash *h, enum ipset_adt adt, __be32 ip, u8 cidr)
+{
+	struct hash_elem *e;
+
+	e = hash_find(h, ip, cidr);
+	switch (adt) {
+	case IPSET_TEST:
+		return e != NULL;
+	case IPSET_ADD:
+		if (e)
+			return -IPSET_ERR_EXIST;
+		if (h->elements >= h->maxelem)
+			return -IPSET_ERR_HASH_FULL;
+		e = kmem_cache_alloc(hash_elem_cachep, GFP_ATOMIC);
+		if (!e)
+			return -ENOMEM;
+		e->ip = ip;
+		e->cidr = cidr;
+		hlist_add_head(&e->node,
+			       &h->table[hash_bucket(h, ip, cidr,
+						     h->htable_bits)]);
+		h->elements++;
+		h->nets[cidr]++;
+		return 0;
+	case IPSET_DEL:
+		if (!e)
+			return -IPSET_ERR_EXIST;
+		hlist_del(&e->node);
+		kmem_cache_free(hash_elem_cachep, e);
+		h->elements--;
+		h->nets[cidr]--;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int
+hash_ip4_kadt(struct ip_set *set, const struct sk_buff *skb,
+	      enum ipset_adt adt, u8 pf, u8 dim, u8 flags)
+{
+	__be32 ip = ip_set_ip4addr(skb, flags & IPSET_DIM_ONE_SRC);
+
+	return hash_adt(set->data, adt, ip, HOST_MASK);
+}
+
+static int
+hash_net4_kadt(struct ip_set *set, const struct sk_buff *skb,
+	       enum ipset_adt adt, u8 pf, u8 dim, u8 flags)
+{
+	__be32 ip = ip_set_ip4addr(skb, flags & IPSET_DIM_ONE_SRC);
+
+	if (adt == IPSET_TEST)
+		return hash_net_test(set->data, ip);
+	/* The SET target adds and deletes host entries */
+	return hash_adt(set->data, adt, ip, HOST_MASK);
+}
+
+/* Would adding n more elements overload the table? */
+static inline bool
+hash_need_grow(const struct ip_set_hash *h, u32 n)
+{
+	return h->htable_bits < HASH_MAX_BITS &&
+	       h->elements + n > (2U << h->htable_bits);
+}
+
+static int
+hash_ip4_uadt(struct ip_set *set, struct nlattr *tb[],
+	      enum ipset_adt adt, u32 flags)
+{
+	struct ip_set_hash *h = set->data;
+	u32 ip, ip_to;
+	__be32 nip;
+	int ret;
+
+	if (unlikely(tb[IPSET_ATTR_TIMEOUT]))
+		return -IPSET_ERR_TIMEOUT;
+
+	ret = ip_set_get_ipaddr4(tb[IPSET_ATTR_IP], &nip);
+	if (ret)
+		return ret;
+	if (adt == IPSET_TEST)
+		return hash_adt(h, adt, nip, HOST_MASK);
+
+	ip = ip_to = ntohl(nip);
+	if (tb[IPSET_ATTR_IP_TO]) {
+		ret = ip_set_get_ipaddr4(tb[IPSET_ATTR_IP_TO], &nip);
+		if (ret)
+			return ret;
+		ip_to = ntohl(nip);
+		if (ip > ip_to)
+			swap(ip, ip_to);
+	} else if (tb[IPSET_ATTR_CIDR]) {
+		u8 cidr = nla_get_u8(tb[IPSET_ATTR_CIDR]);
+
+		if (!cidr || cidr > HOST_MASK)
+			return -IPSET_ERR_INVALID_CIDR;
+		ip &= ntohl(ip_set_netmask(cidr));
+		ip_to = ip | ~ntohl(ip_set_netmask(cidr));
+	}
+
+	if (adt == IPSET_ADD) {
+		if (ip_to - ip >= h->maxelem - h->elements)
+			return -IPSET_ERR_HASH_FULL;
+		if (hash_need_grow(h, ip_to - ip + 1))
+			return -EAGAIN;
+	}
+
+	/* Elements of a range which are already (not) there are skipped
+	 * silently with IPSET_FLAG_EXIST
+	 */
+	for (; ; ip++) {
+		ret = hash_adt(h, adt, htonl(ip), HOST_MASK);
+		if (ret && !(ret == -IPSET_ERR_EXIST &&
+			     (flags & IPSET_FLAG_EXIST)))
+			return ret;
+		if (ip == ip_to)
+			break;
+	}
+	return 0;
+}
+
+static int
+hash_net4_uadt(struct ip_set *set, struct nlattr *tb[],
+	       enum ipset_adt adt, u32 flags)
+{
+	struct ip_set_hash *h = set->data;
+	u8 cidr = HOST_MASK;
+	__be32 ip;
+	int ret;
+
+	if (unlikely(tb[IPSET_ATTR_TIMEOUT]))
+		return -IPSET_ERR_TIMEOUT;
+
+	ret = ip_set_get_ipaddr4(tb[IPSET_ATTR_IP], &ip);
+	if (ret)
+		return ret;
+
+	if (tb[IPSET_ATTR_CIDR]) {
+		cidr = nla_get_u8(tb[IPSET_ATTR_CIDR]);
+		if (!cidr || cidr > HOST_MASK)
+			return -IPSET_ERR_INVALID_CIDR;
+	}
+	ip &= ip_set_netmask(cidr);
+
+	if (adt == IPSET_TEST)
+		/* Without a prefix length, test as the packet path does */
+		return tb[IPSET_ATTR_CIDR] ? hash_adt(h, adt, ip, cidr) :
+					     hash_net_test(h, ip);
+
+	if (adt == IPSET_ADD && hash_need_grow(h, 1))
+		return -EAGAIN;
+
+	return hash_adt(h, adt, ip, cidr);
+}
+
+/* Double the table, in process context without the set lock */
+static int
+hash_resize(struct ip_set *set)
+{
+	struct ip_set_hash *h = set->data;
+	struct hlist_head *table, *old;
+	struct hlist_node *n, *next;
+	struct hash_elem *e;
+	u8 bits = h->htable_bits + 1;
+	u32 i;
+
+	/* Only userspace adds resize, serialized by nfnl_lock() */
+	if (bits > HASH_MAX_BITS)
+		return -IPSET_ERR_HASH_FULL;
+
+	table = hash_table_alloc(bits);
+	if (!table)
+		return -ENOMEM;
+
+	write_lock_bh(&set->lock);
+	old = h->table;
+	for (i = 0; i < (1U << h->htable_bits); i++)
+		hlist_for_each_entry_safe(e, n, next, &old[i], node) {
+			hlist_del(&e->node);
+			hlist_add_head(&e->node,
+				       &table[hash_bucket(h, e->ip, e->cidr,
+							  bits)]);
+		}
+	h->table = table;
+	h->htable_bits = bits;
+	write_unlock_bh(&set->lock);
+
+	pr_debug("set %s resized to %u buckets\n", set->name, 1U << bits);
+	hash_table_free(old);
+	return 0;
+}
+
+static void
+hash_flush(struct ip_set *set)
+{
+	struct ip_set_hash *h = set->data;
+	struct hlist_node *n, *next;
+	struct hash_elem *e;
+	u32 i;
+
+	for (i = 0; i < (1U << h->htable_bits); i++) {
+		hlist_for_each_entry_safe(e, n, next, &h->table[i], node)
+			kmem_cache_free(hash_elem_cachep, e);
+		INIT_HLIST_HEAD(&h->table[i]);
+	}
+	h->elements = 0;
+	memset(h->nets, 0, sizeof(h->nets));
+}
+
+static void
+hash_destroy(struct ip_set *set)
+{
+	struct ip_set_hash *h = set->data;
+
+	hash_flush(set);
+	hash_table_free(h->table);
+	kfree(h);
+	set->data = NULL;
+}
+
+static int
+hash_head(struct ip_set *set, struct sk_buff *skb)
+{
+	const struct ip_set_hash *h = set->data;
+	struct nlattr *nested;
+	size_t memsize;
+
+	read_lock_bh(&set->lock);
+	memsize = sizeof(*h) + hash_table_size(h->htable_bits) +
+		  h->elements * sizeof(struct hash_elem);
+	read_unlock_bh(&set->lock);
+
+	nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
+	if (!nested)
+		goto nla_put_failure;
+	NLA_PUT_BE32(skb, IPSET_ATTR_HASHSIZE, htonl(1U << h->htable_bits));
+	NLA_PUT_BE32(skb, IPSET_ATTR_MAXELEM, htonl(h->maxelem));
+	NLA_PUT_BE32(skb, IPSET_ATTR_ELEMENTS, htonl(h->elements));
+	/* The dump holds a reference itself */
+	NLA_PUT_BE32(skb, IPSET_ATTR_REFERENCES, htonl(set->ref - 1));
+	NLA_PUT_BE32(skb, IPSET_ATTR_MEMSIZE, htonl(memsize));
+	ipset_nest_end(skb, nested);
+
+	return 0;
+nla_put_failure:
+	return -EMSGSIZE;
+}
+
+/*
+ * The cursor in cb->args[IPSET_CB_ARG0] is a bucket index, buckets are
+ * listed entirely or not at all.  A resize between two dump calls may
+ * list elements twice or skip some.
+ */
+static int
+hash_list(const struct ip_set *set, struct sk_buff *skb,
+	  struct netlink_callback *cb)
+{
+	const struct ip_set_hash *h = set->data;
+	struct nlattr *atd, *nested;
+	const struct hash_elem *e;
+	struct hlist_node *n;
+	long first = cb->args[IPSET_CB_ARG0];
+	void *incomplete;
+
+	atd = ipset_nest_start(skb, IPSET_ATTR_ADT);
+	if (!atd)
+		return -EMSGSIZE;
+	for (; cb->args[IPSET_CB_ARG0] < (1U << h->htable_bits);
+	     cb->args[IPSET_CB_ARG0]++) {
+		incomplete = skb_tail_pointer(skb);
+		hlist_for_each_entry(e, n, &h->table[cb->args[IPSET_CB_ARG0]],
+				     node) {
+			nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
+			if (!nested)
+				goto nla_put_failure;
+			if (ip_set_put_ipaddr4(skb, IPSET_ATTR_IP, e->ip))
+				goto nla_put_failure;
+			if (hash_is_net(set))
+				NLA_PUT_U8(skb, IPSET_ATTR_CIDR, e->cidr);
+			ipset_nest_end(skb, nested);
+		}
+	}
+	ipset_nest_end(skb, atd);
+	return 0;
+
+nla_put_failure:
+	nlmsg_trim(skb, incomplete);
+	if (cb->args[IPSET_CB_ARG0] == first) {
+		nla_nest_cancel(skb, atd);
+		return -EMSGSIZE;
+	}
+	ipset_nest_end(skb, atd);
+	return -EMSGSIZE;
+}
+
+static const struct ip_set_type_variant hash_ip4_variant = {
+	.kadt	= hash_ip4_kadt,
+	.uadt	= hash_ip4_uadt,
+	.resize	= hash_resize,
+	.destroy = hash_destroy,
+	.flush	= hash_flush,
+	.head	= hash_head,
+	.list	= hash_list,
+};
+
+static const struct ip_set_type_variant hash_net4_variant = {
+	.kadt	= hash_net4_kadt,
+	.uadt	= hash_net4_uadt,
+	.resize	= hash_resize,
+	.destroy = hash_destroy,
+	.flush	= hash_flush,
+	.head	= hash_head,
+	.list	= hash_list,
+};
+
+static int
+hash_create(struct ip_set *set, struct nlattr *tb[],
+	    const struct ip_set_type_variant *variant)
+{
+	u32 hashsize = HASH_DEFAULT_HASHSIZE, maxelem = HASH_DEFAULT_MAXELEM;
+	struct ip_set_hash *h;
+
+	if (set->family != NFPROTO_IPV4)
+		return -IPSET_ERR_INVALID_FAMILY;
+	if (unlikely(tb[IPSET_ATTR_TIMEOUT]))
+		return -IPSET_ERR_TIMEOUT;
+
+	if (tb[IPSET_ATTR_HASHSIZE]) {
+		hashsize = ip_set_get_h32(tb[IPSET_ATTR_HASHSIZE]);
+		if (hashsize < HASH_MIN_HASHSIZE)
+			hashsize = HASH_MIN_HASHSIZE;
+	}
+	if (tb[IPSET_ATTR_MAXELEM])
+		maxelem = ip_set_get_h32(tb[IPSET_ATTR_MAXELEM]);
+
+	h = kzalloc(sizeof(*h), GFP_KERNEL);
+	if (!h)
+		return -ENOMEM;
+
+	h->maxelem = maxelem;
+	h->htable_bits = min(fls(hashsize - 1), HASH_MAX_BITS);
+	h->table = hash_table_alloc(h->htable_bits);
+	if (!h->table) {
+		kfree(h);
+		return -ENOMEM;
+	}
+	get_random_bytes(&h->initval, sizeof(h->initval));
+
+	set->data = h;
+	set->variant = variant;
+
+	pr_debug("create %s hashsize %u maxelem %u\n",
+		 set->name, 1U << h->htable_bits, h->maxelem);
+	return 0;
+}
+
+static int
+hash_ip4_create(struct ip_set *set, struct nlattr *tb[], u32 flags)
+{
+	return hash_create(set, tb, &hash_ip4_variant);
+}
+
+static int
+hash_net4_create(struct ip_set *set, struct nlattr *tb[], u32 flags)
+{
+	return hash_create(set, tb, &hash_net4_variant);
+}
+
+static struct ip_set_type hash_ip_type __read_mostly = {
+	.name		= "hash:ip",
+	.protocol	= IPSET_PROTOCOL,
+	.dimension	= IPSET_DIM_ONE,
+	.family		= NFPROTO_IPV4,
+	.revision	= 0,
+	.create		= hash_ip4_create,
+	.create_policy	= {
+		[IPSET_ATTR_HASHSIZE]	= { .type = NLA_U32 },
+		[IPSET_ATTR_MAXELEM]	= { .type = NLA_U32 },
+		[IPSET_ATTR_PROBES]	= { .type = NLA_U8 },
+		[IPSET_ATTR_RESIZE]	= { .type = NLA_U8  },
+		[IPSET_ATTR_TIMEOUT]	= { .type = NLA_U32 },
+	},
+	.adt_policy	= {
+		[IPSET_ATTR_IP]		= { .type = NLA_NESTED },
+		[IPSET_ATTR_IP_TO]	= { .type = NLA_NESTED },
+		[IPSET_ATTR_CIDR]	= { .type = NLA_U8 },
+		[IPSET_ATTR_TIMEOUT]	= { .type = NLA_U32 },
+		[IPSET_ATTR_LINENO]	= { .type = NLA_U32 },
+	},
+	.me		= THIS_MODULE,
+};
+
+static struct ip_set_type hash_net_type __read_mostly = {
+	.name		= "hash:net",
+	.protocol	= IPSET_PROTOCOL,
+	.dimension	= IPSET_DIM_ONE,
+	.family		= NFPROTO_IPV4,
+	.revision	= 0,
+	.create		= hash_net4_create,
+	.create_policy	= {
+		[IPSET_ATTR_HASHSIZE]	= { .type = NLA_U32 },
+		[IPSET_ATTR_MAXELEM]	= { .type = NLA_U32 },
+		[IPSET_ATTR_PROBES]	= { .type = NLA_U8 },
+		[IPSET_ATTR_RESIZE]	= { .type = NLA_U8  },
+		[IPSET_ATTR_TIMEOUT]	= { .type = NLA_U32 },
+	},
+	.adt_policy	= {
+		[IPSET_ATTR_IP]		= { .type = NLA_NESTED },
+		[IPSET_ATTR_CIDR]	= { .type = NLA_U8 },
+		[IPSET_ATTR_TIMEOUT]	= { .type = NLA_U32 },
+		[IPSET_ATTR_LINENO]	= { .type = NLA_U32 },
+	},
+	.me		= THIS_MODULE,
+};
+
+static int __init
+hash_init(void)
+{
+	int ret;
+
+	hash_elem_cachep = kmem_cache_create("ip_set_hash_elem",
+					     sizeof(struct hash_elem), 0,
+					     0, NULL);
+	if (!hash_elem_cachep)
+		return -ENOMEM;
+
+	ret = ip_set_type_register(&hash_ip_type);
+	if (ret)
+		goto err_cache;
+	ret = ip_set_type_register(&hash_net_type);
+	if (ret)
+		goto err_ip;
+	return 0;
+
+err_ip:
+	ip_set_type_unregister(&hash_ip_type);
+err_cache:
+	kmem_cache_destroy(hash_elem_cachep);
+	return ret;
+}
+
+static void __exit
+hash_fini(void)
+{
+	ip_set_type_unregister(&hash_net_type);
+	ip_set_type_unregister(&hash_ip_type);
+	kmem_cache_destroy(hash_elem_cachep);
+}
+
+module_init(hash_init);
+module_exit(hash_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("hash:ip and hash:net IP set types");
+MODULE_ALIAS("ip_set_hash:ip");
+MODULE_ALIAS("ip_set_hash:net");
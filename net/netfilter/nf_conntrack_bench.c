@@ -0,0 +1,255 @@
+/*
+ * Connection tracking creation rate benchmark.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Reproduces a workload made of many short UDP flows (DNS, SIP): each
+ * thread pushes the first packet of new flows through nf_conntrack_in()
+ * and nf_conntrack_confirm(), keeping "live" flows alive and killing the
+ * oldest one for each new flow.  This exercises conntrack allocation,
+ * the unconfirmed lists, hash insertion and deletion concurrently on all
+ * CPUs.  The run happens at module load time, results go to the kernel log.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/skbuff.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <linux/if_ether.h>
+#include <linux/netfilter.h>
+#include <net/ip.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_core.h>
+
+#define PRINT_PREF KERN_INFO "nf_conntrack_bench: "
+
+static unsigned int threads;
+module_param(threads, uint, S_IRUGO);
+MODULE_PARM_DESC(threads, "Number of threads (default: one per online CPU)");
+
+static unsigned int flows = 100000;
+module_param(flows, uint, S_IRUGO);
+MODULE_PARM_DESC(flows, "Number of flows created by each thread");
+
+static unsigned int live = 512;
+module_param(live, uint, S_IRUGO);
+MODULE_PARM_DESC(live, "Number of flows each thread keeps alive");
+
+static unsigned short dport = 53;
+module_param(dport, ushort, S_IRUGO);
+MODULE_PARM_DESC(dport, "UDP destination port of the flows");
+
+struct ct_bench_thread {
+	unsigned int		id;
+	struct nf_conn		**ring;
+	unsigned long		created;
+	unsigned long		failed;
+	u64			ns;
+	struct completion	done;
+};
+
+static struct sk_buff *ct_bench_build_skb(unsigned int id, unsigned int seq)
+{
+	struct sk_buff *skb;
+	struct iphdr *iph;
+	struct udphdr *uh;
+
+	skb = alloc_skb(sizeof(*iph) + sizeof(*uh), GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	/* 10.<thread>.<seq high bits>, the source port has the low ones */
+	skb_reset_network_header(skb);
+	iph = (struct iphdr *)skb_put(skb, sizeof(*iph));
+	memset(iph, 0, sizeof(*iph));
+	iph->version = 4;
+	iph->ihl = sizeof(*iph) >> 2;
+	iph->ttl = 64;
+	iph->protocol = IPPROTO_UDP;
+	iph->tot_len = htons(sizeof(*iph) + sizeof(*uh));
+	iph->saddr = htonl(0x0a000000 | ((id & 0xff) << 16) | (seq >> 16));
+	iph->daddr = htonl(0xc0a80001);
+	ip_send_check(iph);
+
+	skb_set_transport_header(skb, sizeof(*iph));
+	uh = (struct udphdr *)skb_put(skb, sizeof(*uh));
+	uh->source = htons(seq & 0xffff);
+	uh->dest = htons(dport);
+	uh->len = htons(sizeof(*uh));
+	uh->check = 0;
+
+	skb->protocol = htons(ETH_P_IP);
+	return skb;
+}
+
+/* Returns the confirmed conntrack of a new flow, with a reference held */
+static struct nf_conn *ct_bench_new_flow(unsigned int id, unsigned int seq)
+{
+	enum ip_conntrack_info ctinfo;
+	struct sk_buff *skb;
+	struct nf_conn *ct;
+	unsigned int ret;
+
+	skb = ct_bench_build_skb(id, seq);
+	if (!skb)
+		return NULL;
+
+	/* Same context as the PRE_ROUTING hook */
+	rcu_read_lock();
+	local_bh_disable();
+	ret = nf_conntrack_in(&init_net, PF_INET, NF_INET_PRE_ROUTING, skb);
+	if (ret == NF_ACCEPT)
+		ret = nf_conntrack_confirm(skb);
+	local_bh_enable();
+	rcu_read_unlock();
+
+	ct = nf_ct_get(skb, &ctinfo);
+	if (ret == NF_ACCEPT && ct && nf_ct_is_confirmed(ct))
+		nf_conntrack_get(&ct->ct_general);
+	else
+		ct = NULL;
+
+	kfree_skb(skb);
+	return ct;
+}
+
+static void ct_bench_kill(struct nf_conn **slot)
+{
+	if (*slot) {
+		nf_ct_kill(*slot);
+		nf_ct_put(*slot);
+		*slot = NULL;
+	}
+}
+
+static int ct_bench_thread_fn(void *data)
+{
+	struct ct_bench_thread *t = data;
+	struct nf_conn *ct;
+	ktime_t start;
+	unsigned int i;
+
+	start = ktime_get();
+	for (i = 0; i < flows; i++) {
+		struct nf_conn **slot = &t->ring[i % live];
+
+		ct_bench_kill(slot);
+		ct = ct_bench_new_flow(t->id, i);
+		if (ct) {
+			*slot = ct;
+			t->created++;
+		} else
+			t->failed++;
+
+		if (!(i % 256))
+			cond_resched();
+	}
+	t->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < live; i++)
+		ct_bench_kill(&t->ring[i]);
+
+	complete(&t->done);
+	return 0;
+}
+
+static int __init nf_conntrack_bench_init(void)
+{
+	struct ct_bench_thread *t;
+	unsigned long created = 0, failed = 0;
+	u64 ns = 0, rate;
+	unsigned int i, started;
+	int cpu, err;
+
+	if (!threads)
+		threads = num_online_cpus();
+	if (threads > 256 || !live || !flows) {
+		printk(PRINT_PREF "invalid parameters\n");
+		return -EINVAL;
+	}
+
+	err = nf_ct_l3proto_try_module_get(PF_INET);
+	if (err < 0) {
+		printk(PRINT_PREF "IPv4 connection tracking not available\n");
+		return err;
+	}
+
+	t = kcalloc(threads, sizeof(*t), GFP_KERNEL);
+	if (!t) {
+		err = -ENOMEM;
+		goto out_put;
+	}
+	for (i = 0; i < threads; i++) {
+		t[i].id = i;
+		init_completion(&t[i].done);
+		t[i].ring = kcalloc(live, sizeof(struct nf_conn *), GFP_KERNEL);
+		if (!t[i].ring) {
+			err = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	printk(PRINT_PREF "%u threads, %u flows each, %u live flows each\n",
+	       threads, flows, live);
+
+	cpu = cpumask_first(cpu_online_mask);
+	for (started = 0; started < threads; started++) {
+		struct task_struct *task;
+
+		task = kthread_create(ct_bench_thread_fn, &t[started],
+				      "ct_bench/%u", started);
+		if (IS_ERR(task)) {
+			/* Threads already started still have to finish */
+			err = PTR_ERR(task);
+			break;
+		}
+		kthread_bind(task, cpu);
+		wake_up_process(task);
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+
+	for (i = 0; i < started; i++) {
+		wait_for_completion(&t[i].done);
+		created += t[i].created;
+		failed += t[i].failed;
+		ns = max(ns, t[i].ns);
+	}
+	if (err)
+		goto out_free;
+
+	rate = (u64)created * NSEC_PER_SEC;
+	do_div(rate, ns ? ns : 1);
+	do_div(ns, NSEC_PER_MSEC);
+	printk(PRINT_PREF "%lu flows created, %lu failed in %llu ms: "
+	       "%llu flows/s\n", created, failed,
+	       (unsigned long long)ns, (unsigned long long)rate);
+
+out_free:
+	for (i = 0; i < threads; i++)
+		kfree(t[i].ring);
+	kfree(t);
+out_put:
+	nf_ct_l3proto_module_put(PF_INET);
+	return err;
+}
+module_init(nf_conntrack_bench_init);
+
+static void __exit nf_conntrack_bench_exit(void)
+{
+}
+module_exit(nf_conntrack_bench_exit);
+
+MODULE_DESCRIPTION("Connection tracking creation rate benchmark");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,192 @@
+/*
+ *	xt_set - Netfilter module to match against and to add/delete
+ *	packets to/from IP sets
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	Rules carry the index of the set, which iptables looks up by name
+ *	with getsockopt(SO_IP_SET).  The set is referenced by index when
+ *	the rule is inserted, so the packet path only deals with the index.
+ */
+#include <linux/module.h>
+#include <linux/skbuff.h>
+
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_set.h>
+
+static inline int
+match_set(ip_set_id_t index, const struct sk_buff *skb,
+	  u8 pf, u8 dim, u8 flags, int inv)
+{
+	if (ip_set_test(index, skb, pf, dim, flags))
+		inv = !inv;
+	return inv;
+}
+
+/*
+ * Revision 0 gives the direction of each dimension in u.flags[], up to
+ * the first zero entry.  Convert it in place to the dimension and the
+ * IPSET_DIM_*_SRC flags the set types work with.
+ */
+static void
+compat_flags(struct xt_set_info_v0 *info)
+{
+	u_int8_t i;
+
+	info->u.compat.dim = IPSET_DIM_ZERO;
+	info->u.compat.flags = 0;
+	if (info->u.flags[0] & IPSET_MATCH_INV)
+		info->u.compat.flags |= IPSET_INV_MATCH;
+	for (i = 0; i < IPSET_DIM_MAX - 1 && info->u.flags[i]; i++) {
+		info->u.compat.dim++;
+		if (info->u.flags[i] & IPSET_SRC)
+			info->u.compat.flags |= (1 << info->u.compat.dim);
+	}
+}
+
+/* Reference the set of a rule, and check the dimension */
+static bool
+set_info_get(struct xt_set_info_v0 *info)
+{
+	if (ip_set_get_byindex(info->index) == IPSET_INVALID_ID) {
+		pr_warning("xt_set: cannot find set identified by id %u\n",
+			   info->index);
+		return false;
+	}
+	if (info->u.flags[IPSET_DIM_MAX - 1] != 0) {
+		pr_warning("xt_set: protocol error, set dimension too large\n");
+		ip_set_put_byindex(info->index);
+		return false;
+	}
+	compat_flags(info);
+	return true;
+}
+
+static bool
+set_match(const struct sk_buff *skb, const struct xt_match_param *par)
+{
+	const struct xt_set_info_match_v0 *info = par->matchinfo;
+
+	return match_set(info->match_set.index, skb, par->family,
+			 info->match_set.u.compat.dim,
+			 info->match_set.u.compat.flags,
+			 info->match_set.u.compat.flags & IPSET_INV_MATCH);
+}
+
+static bool
+set_match_checkentry(const struct xt_mtchk_param *par)
+{
+	struct xt_set_info_match_v0 *info = par->matchinfo;
+
+	return set_info_get(&info->match_set);
+}
+
+static void
+set_match_destroy(const struct xt_mtdtor_param *par)
+{
+	struct xt_set_info_match_v0 *info = par->matchinfo;
+
+	ip_set_put_byindex(info->match_set.index);
+}
+
+static unsigned int
+set_target(struct sk_buff *skb, const struct xt_target_param *par)
+{
+	const struct xt_set_info_target_v0 *info = par->targinfo;
+
+	if (info->add_set.index != IPSET_INVALID_ID)
+		ip_set_add(info->add_set.index, skb, par->family,
+			   info->add_set.u.compat.dim,
+			   info->add_set.u.compat.flags);
+	if (info->del_set.index != IPSET_INVALID_ID)
+		ip_set_del(info->del_set.index, skb, par->family,
+			   info->del_set.u.compat.dim,
+			   info->del_set.u.compat.flags);
+
+	return XT_CONTINUE;
+}
+
+static bool
+set_target_checkentry(const struct xt_tgchk_param *par)
+{
+	struct xt_set_info_target_v0 *info = par->targinfo;
+
+	/* IPSET_INVALID_ID means no set */
+	if (info->add_set.index != IPSET_INVALID_ID &&
+	    !set_info_get(&info->add_set))
+		return false;
+	if (info->del_set.index != IPSET_INVALID_ID &&
+	    !set_info_get(&info->del_set)) {
+		if (info->add_set.index != IPSET_INVALID_ID)
+			ip_set_put_byindex(info->add_set.index);
+		return false;
+	}
+	return true;
+}
+
+static void
+set_target_destroy(const struct xt_tgdtor_param *par)
+{
+	const struct xt_set_info_target_v0 *info = par->targinfo;
+
+	if (info->add_set.index != IPSET_INVALID_ID)
+		ip_set_put_byindex(info->add_set.index);
+	if (info->del_set.index != IPSET_INVALID_ID)
+		ip_set_put_byindex(info->del_set.index);
+}
+
+static struct xt_match set_matches[] __read_mostly = {
+	{
+		.name		= "set",
+		.family		= NFPROTO_IPV4,
+		.revision	= 0,
+		.match		= set_match,
+		.matchsize	= sizeof(struct xt_set_info_match_v0),
+		.checkentry	= set_match_checkentry,
+		.destroy	= set_match_destroy,
+		.me		= THIS_MODULE
+	},
+};
+
+static struct xt_target set_targets[] __read_mostly = {
+	{
+		.name		= "SET",
+		.revision	= 0,
+		.family		= NFPROTO_IPV4,
+		.target		= set_target,
+		.targetsize	= sizeof(struct xt_set_info_target_v0),
+		.checkentry	= set_target_checkentry,
+		.destroy	= set_target_destroy,
+		.me		= THIS_MODULE
+	},
+};
+
+static int __init xt_set_init(void)
+{
+	int ret = xt_register_matches(set_matches, ARRAY_SIZE(set_matches));
+
+	if (!ret) {
+		ret = xt_register_targets(set_targets,
+					  ARRAY_SIZE(set_targets));
+		if (ret)
+			xt_unregister_matches(set_matches,
+					      ARRAY_SIZE(set_matches));
+	}
+	return ret;
+}
+
+static void __exit xt_set_fini(void)
+{
+	xt_unregister_matches(set_matches, ARRAY_SIZE(set_matches));
+	xt_unregister_targets(set_targets, ARRAY_SIZE(set_targets));
+}
+
+module_init(xt_set_init);
+module_exit(xt_set_fini);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Xtables: IP set match and target module");
+MODULE_ALIAS("xt_SET");
+MODULE_ALIAS("ipt_set");
+MODULE_ALIAS("ipt_SET");